@@ -0,0 +1,118 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Replay a trace of RTTs of a single upstream address and compare retransmit
+ * timeouts: the adaptive one from kr_nsrep_rto() against the former
+ * score + 10 ms.  Each line of the trace holds an RTT in milliseconds,
+ * or "-" for a query that got no answer.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "contrib/ucw/lib.h"
+#include "lib/defines.h"
+#include "lib/nsrep.h"
+
+#define p_out(...) do { \
+	printf(__VA_ARGS__); \
+	fflush(stdout); \
+	} while (0)
+#define p_err(...) fprintf(stderr, __VA_ARGS__)
+
+static int die(const char *cause)
+{
+	fprintf(stderr, "%s: %s\n", cause, strerror(errno));
+	exit(1);
+}
+
+struct policy_stats {
+	size_t spurious;   /**< answered queries retransmitted before the answer came */
+	uint64_t lost_ms;  /**< time waited for the retransmit of unanswered queries */
+	uint64_t rto_ms;   /**< sum of the timeouts */
+};
+
+static void stats_add(struct policy_stats *st, unsigned timeout, unsigned rtt, bool lost)
+{
+	st->rto_ms += timeout;
+	if (lost) {
+		st->lost_ms += timeout;
+	} else if (rtt > timeout) {
+		++st->spurious;
+	}
+}
+
+static void stats_print(const char *name, const struct policy_stats *st, size_t count)
+{
+	p_err("%s:\tspurious retransmits ", name);
+	p_out("%zu,", st->spurious);
+	p_err("\twaited on timeouts [ms] ");
+	p_out("%" PRIu64 ",", st->lost_ms);
+	p_err("\tmean timeout [ms] ");
+	p_out("%" PRIu64 ",", count ? st->rto_ms / count : 0);
+	p_err("\n");
+}
+
+static void usage(const char *progname)
+{
+	p_err("usage: %s <trace>\n", progname);
+	p_err("Standard output contains csv-formatted lines.\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+		usage(argv[0]);
+	FILE *f = fopen(argv[1], "r");
+	if (!f)
+		die("fopen");
+
+	kr_nsrep_rtt_lru_t *cache = NULL;
+	lru_create(&cache, 1, NULL, NULL);
+	if (!cache)
+		die("malloc");
+	struct sockaddr_in addr = { .sin_family = AF_INET };
+	const struct sockaddr *sa = (const struct sockaddr *)&addr;
+
+	struct policy_stats adaptive = { 0 }, fixed = { 0 };
+	unsigned old_score = 0; /* the former score, smoothed over two measurements */
+	size_t count = 0, lost_count = 0;
+	char line[64];
+	while (fgets(line, sizeof(line), f)) {
+		const bool lost = line[0] == '-';
+		const unsigned rtt = lost ? KR_NS_DEAD : MAX(atoi(line), KR_NS_GLUED + 1);
+
+		const kr_nsrep_rtt_lru_entry_t *entry =
+			lru_get_try(cache, kr_inaddr(sa), kr_inaddr_len(sa));
+		unsigned timeout = kr_nsrep_rto(entry);
+		timeout = timeout ? MIN(timeout, KR_CONN_RETRY) : KR_CONN_RETRY;
+		stats_add(&adaptive, timeout, rtt, lost);
+		timeout = old_score > KR_NS_GLUED ? MIN(old_score + 10, KR_CONN_RETRY) : KR_CONN_RETRY;
+		stats_add(&fixed, timeout, rtt, lost);
+
+		kr_nsrep_update_rtt(NULL, sa, rtt, cache,
+				    lost ? KR_NS_LOST : KR_NS_UPDATE);
+		old_score = count == 0 && !lost ? rtt : (old_score + rtt) / 2;
+		++count;
+		lost_count += lost;
+	}
+	fclose(f);
+
+	p_err("samples: ");
+	p_out("%zu,", count);
+	p_err("\tlost: ");
+	p_out("%zu,", lost_count);
+	p_err("\n");
+	stats_print("adaptive", &adaptive, count);
+	stats_print("score+10", &fixed, count);
+	p_out("\n");
+
+	lru_free(cache);
+	return 0;
+}
@@ -4,6 +4,7 @@
 
 #include "daemon/bindings/impl.h"
 #include "lib/cache/cdb_lmdb.h"
+#include "lib/cache/cdb_memory.h"
 
 #include "daemon/worker.h"
 #include "daemon/zimport.h"
@@ -94,12 +95,37 @@ static int cache_stats(lua_State *L)
 	add_stat(match_miss);
 	add_stat(read_leq);
 	add_stat(read_leq_miss);
+	add_stat(l1_hit);
+	add_stat(l1_miss);
 	/* usage_percent statistics special case - double */
-	struct libknot_lmdb_env *libknot_db = knot_db_t_kres2libknot(cache->db);
-	cache->stats.usage_percent = cache->api->usage_percent(libknot_db);
+	if (cache->api == kr_cdb_lmdb()) {
+		struct libknot_lmdb_env *libknot_db = knot_db_t_kres2libknot(cache->db);
+		cache->stats.usage_percent = cache->api->usage_percent(libknot_db);
+		free(libknot_db);
+	} else {
+		cache->stats.usage_percent = cache->api->usage_percent(cache->db);
+	}
+	/* Sharded cache: figures of each shard, and usage of the fullest one. */
+	struct kr_cdb_shard_stats shard;
+	if (cache->api->shard_stats && cache->api->shard_stats(cache->db, 1, &shard) == 0) {
+		cache->stats.usage_percent = 0;
+		lua_newtable(L);
+		for (unsigned i = 0; cache->api->shard_stats(cache->db, i, &shard) == 0; ++i) {
+			if (shard.usage_percent > cache->stats.usage_percent)
+				cache->stats.usage_percent = shard.usage_percent;
+			lua_newtable(L);
+			lua_pushinteger(L, shard.entries);
+			lua_setfield(L, -2, "entries");
+			lua_pushinteger(L, shard.commit);
+			lua_setfield(L, -2, "commit");
+			lua_pushnumber(L, shard.usage_percent);
+			lua_setfield(L, -2, "usage_percent");
+			lua_rawseti(L, -2, i + 1);
+		}
+		lua_setfield(L, -2, "shards");
+	}
 	lua_pushnumber(L, cache->stats.usage_percent);
 	lua_setfield(L, -2, "usage_percent");
-	free(libknot_db);
 #undef add_stat
 
 	return 1;
@@ -172,8 +198,8 @@ static int cache_open(lua_State *L)
 {
 	/* Check parameters */
 	int n = lua_gettop(L);
-	if (n < 1 || !lua_isnumber(L, 1))
-		lua_error_p(L, "expected 'open(number max_size, string config = \"\")'");
+	if (n < 1 || !lua_isnumber(L, 1) || (n > 2 && !lua_isnil(L, 3) && !lua_isnumber(L, 3)))
+		lua_error_p(L, "expected 'open(number max_size, string config = \"\", number shards = 1)'");
 
 	/* Select cache storage backend */
 	struct engine *engine = engine_luaget(L);
@@ -184,6 +210,9 @@ static int cache_open(lua_State *L)
 				STR(SIZE_MAX)  ">");
 	}
 	size_t cache_size = csize_lua;
+	lua_Integer shards = n > 2 && !lua_isnil(L, 3) ? lua_tointeger(L, 3) : 1;
+	if (shards < 1 || shards > 64)
+		lua_error_p(L, "invalid number of cache shards, it must be in range <1, 64>");
 
 	const char *conf = n > 1 ? lua_tostring(L, 2) : NULL;
 	const char *uri = conf;
@@ -197,7 +226,8 @@ static int cache_open(lua_State *L)
 	/* Reopen cache */
 	struct kr_cdb_opts opts = {
 		(conf && strlen(conf)) ? conf : ".",
-		cache_size
+		cache_size,
+		shards
 	};
 	int ret = kr_cache_open(&engine->resolver.cache, api, &opts, engine->pool);
 	if (ret != 0) {
@@ -215,6 +245,9 @@ static int cache_open(lua_State *L)
 	lua_pushstring(L, "current_storage");
 	lua_pushstring(L, uri);
 	lua_rawset(L, -3);
+	lua_pushstring(L, "current_shards");
+	lua_pushinteger(L, shards);
+	lua_rawset(L, -3);
 	lua_pop(L, 1);
 
 	lua_pushboolean(L, 1);
@@ -363,6 +396,132 @@ static int cache_ns_tout(lua_State *L)
 	return 1;
 }
 
+/** Get/set sharing of NS RTT and reputation with other instances through the cache. */
+static int cache_ns_share(lua_State *L)
+{
+	struct engine *engine = engine_luaget(L);
+	struct kr_context *ctx = &engine->resolver;
+
+	int n = lua_gettop(L);
+	if (n >= 1) {
+		if (!lua_isboolean(L, 1))
+			lua_error_p(L, "expected 'cache.ns_share(true|false)'");
+		ctx->cache_infra_shared = lua_toboolean(L, 1);
+	}
+	lua_pushboolean(L, ctx->cache_infra_shared);
+	return 1;
+}
+
+/** Get/set the size and maximum TTL of the worker's packet cache. */
+static int cache_packet_cache(lua_State *L)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker) {
+		return 0;
+	}
+	struct packet_cache *pc = &worker->pcache;
+	const int n = lua_gettop(L);
+	if (n > 2 || (n >= 1 && !lua_isnumber(L, 1)) || (n == 2 && !lua_isnumber(L, 2)))
+		lua_error_p(L, "expected 'cache.packet_cache([size [, max_ttl]])'");
+	if (n >= 1) {
+		lua_Integer size = lua_tointeger(L, 1);
+		if (size < 0 || size > UINT16_MAX)
+			lua_error_p(L, "packet_cache size must be within <0, " STR(UINT16_MAX) ">");
+		lua_Integer max_ttl = n == 2 ? lua_tointeger(L, 2)
+			: (pc->max_ttl ? pc->max_ttl : PACKET_CACHE_MAX_TTL_DEFAULT);
+		if (max_ttl < 1 || max_ttl > UINT32_MAX)
+			lua_error_p(L, "packet_cache max_ttl must be a positive number of seconds");
+		lua_error_maybe(L, packet_cache_set(pc, size, max_ttl));
+	}
+	lua_pushinteger(L, pc->size);
+	lua_pushinteger(L, pc->max_ttl ? pc->max_ttl : PACKET_CACHE_MAX_TTL_DEFAULT);
+	return 2;
+}
+
+/** Get/set the number of slots of the in-memory L1 cache. */
+static int cache_l1(lua_State *L)
+{
+	struct kr_cache *cache = &engine_luaget(L)->resolver.cache;
+	const int n = lua_gettop(L);
+	if (n > 1 || (n == 1 && !lua_isnumber(L, 1)))
+		lua_error_p(L, "expected 'cache.l1([slots])'");
+	if (n == 1) {
+		lua_Integer slots = lua_tointeger(L, 1);
+		if (slots < 0 || slots > (1 << 24))
+			lua_error_p(L, "cache.l1: slots must be within <0, 16777216>");
+		lua_error_maybe(L, kr_cache_l1_set(cache, slots));
+	}
+	lua_pushinteger(L, kr_cache_l1_slots(cache));
+	return 1;
+}
+
+static void cache_flush_cb(uv_timer_t *timer)
+{
+	struct worker_ctx *worker = timer->data;
+	(void)kr_cache_flush(&worker->engine->resolver.cache);
+}
+
+/** Get/set buffering of cache writes: max. pending records and flush interval. */
+static int cache_write_back(lua_State *L)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker) {
+		return 0;
+	}
+	struct kr_cache *cache = &worker->engine->resolver.cache;
+	const int n = lua_gettop(L);
+	if (n > 2 || (n >= 1 && !lua_isnumber(L, 1)) || (n == 2 && !lua_isnumber(L, 2)))
+		lua_error_p(L, "expected 'cache.write_back([max_records [, interval_ms]])'");
+	if (n >= 1) {
+		lua_Integer max = lua_tointeger(L, 1);
+		lua_Integer interval = n == 2 ? lua_tointeger(L, 2)
+			: (worker->cache_flush_ms ? worker->cache_flush_ms
+						  : CACHE_FLUSH_MS_DEFAULT);
+		if (max < 0 || max > UINT16_MAX)
+			lua_error_p(L, "write_back max_records must be within <0, " STR(UINT16_MAX) ">");
+		if (interval < 1 || interval > 10000)
+			lua_error_p(L, "write_back interval_ms must be within <1, 10000>");
+		uv_timer_stop(&worker->cache_flush);
+		worker->cache_flush_ms = max ? interval : 0;
+		lua_error_maybe(L, kr_cache_write_back(cache, max));
+		if (max) {
+			worker->cache_flush.data = worker;
+			uv_timer_start(&worker->cache_flush, cache_flush_cb, interval, interval);
+		}
+	}
+	lua_pushinteger(L, kr_cache_write_back_max(cache));
+	lua_pushinteger(L, worker->cache_flush_ms ? worker->cache_flush_ms : CACHE_FLUSH_MS_DEFAULT);
+	return 2;
+}
+
+/** Export cache contents into a file; return the number of records. */
+static int cache_snapshot(lua_State *L)
+{
+	struct kr_cache *cache = cache_assert_open(L);
+	if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+		lua_error_p(L, "expected 'cache.snapshot(path)'");
+	const int ret = kr_cache_snapshot(cache, lua_tostring(L, 1));
+	if (ret == kr_error(ENOTSUP))
+		lua_error_p(L, "cache backend '%s' doesn't support snapshots", cache->api->name);
+	lua_error_maybe(L, ret < 0 ? ret : 0);
+	lua_pushinteger(L, ret);
+	return 1;
+}
+
+/** Load a file written by cache.snapshot(); return the number of records. */
+static int cache_restore(lua_State *L)
+{
+	struct kr_cache *cache = cache_assert_open(L);
+	if (lua_gettop(L) != 1 || !lua_isstring(L, 1))
+		lua_error_p(L, "expected 'cache.restore(path)'");
+	const int ret = kr_cache_restore(cache, lua_tostring(L, 1));
+	if (ret == kr_error(ENOTSUP))
+		lua_error_p(L, "snapshot is from a different cache version");
+	lua_error_maybe(L, ret < 0 ? ret : 0);
+	lua_pushinteger(L, ret);
+	return 1;
+}
+
 /** Zone import completion callback.
  * Deallocates zone import context. */
 static void cache_zone_import_cb(int state, void *param)
@@ -453,6 +612,12 @@ int kr_bindings_cache(lua_State *L)
 		{ "max_ttl", cache_max_ttl },
 		{ "min_ttl", cache_min_ttl },
 		{ "ns_tout", cache_ns_tout },
+		{ "ns_share", cache_ns_share },
+		{ "packet_cache", cache_packet_cache },
+		{ "l1", cache_l1 },
+		{ "write_back", cache_write_back },
+		{ "snapshot", cache_snapshot },
+		{ "restore", cache_restore },
 		{ "zone_import", cache_zone_import },
 		{ NULL, NULL }
 	};
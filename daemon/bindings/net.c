@@ -4,6 +4,8 @@
 
 #include "daemon/bindings/impl.h"
 
+#include "kresconfig.h"
+
 #include "contrib/base64.h"
 #include "daemon/network.h"
 #include "daemon/tls.h"
@@ -23,6 +25,8 @@ static int net_list_add(const char *key, void *val, void *ext)
 
 		if (ep->flags.kind) {
 			lua_pushstring(L, ep->flags.kind);
+		} else if (ep->flags.xdp) {
+			lua_pushliteral(L, "xdp");
 		} else if (ep->flags.tls) {
 			lua_pushliteral(L, "tls");
 		} else {
@@ -42,6 +46,11 @@ static int net_list_add(const char *key, void *val, void *ext)
 		case AF_UNIX:
 			lua_pushliteral(L, "unix");
 			break;
+		case AF_UNSPEC:
+			if (ep->flags.xdp) {
+				lua_pushliteral(L, "inet4+inet6");
+				break;
+			} /* fall through */
 		default:
 			lua_pushliteral(L, "invalid");
 			assert(!EINVAL);
@@ -49,7 +58,11 @@ static int net_list_add(const char *key, void *val, void *ext)
 		lua_setfield(L, -2, "family");
 
 		lua_pushstring(L, key);
-		if (ep->family != AF_UNIX) {
+		if (ep->flags.xdp) {
+			lua_setfield(L, -2, "interface");
+			lua_pushinteger(L, ep->nic_queue < 0 ? 0 : ep->nic_queue);
+			lua_setfield(L, -2, "nic_queue");
+		} else if (ep->family != AF_UNIX) {
 			lua_setfield(L, -2, "ip");
 		} else {
 			lua_setfield(L, -2, "path");
@@ -97,7 +110,8 @@ static int net_list(lua_State *L)
 /** Listen on an address list represented by the top of lua stack.
  * \note kind ownership is not transferred
  * \return success */
-static bool net_listen_addrs(lua_State *L, int port, bool tls, const char *kind, bool freebind)
+static bool net_listen_addrs(lua_State *L, int port, bool tls, const char *kind, bool freebind,
+			     bool xdp, int16_t nic_queue)
 {
 	/* Case: table with 'addr' field; only follow that field directly. */
 	lua_getfield(L, -1, "addr");
@@ -113,23 +127,32 @@ static bool net_listen_addrs(lua_State *L, int port, bool tls, const char *kind,
 		struct engine *engine = engine_luaget(L);
 		int ret = 0;
 		endpoint_flags_t flags = { .tls = tls, .freebind = freebind };
-		if (!kind && !flags.tls) { /* normal UDP */
+		if (xdp) { /* UDP only, str is the interface name */
+			flags.xdp = true;
 			flags.sock_type = SOCK_DGRAM;
-			ret = network_listen(&engine->net, str, port, flags);
-		}
-		if (!kind && ret == 0) { /* common for normal TCP and TLS */
-			flags.sock_type = SOCK_STREAM;
-			ret = network_listen(&engine->net, str, port, flags);
-		}
-		if (kind) {
-			flags.kind = strdup(kind);
-			flags.sock_type = SOCK_STREAM; /* TODO: allow to override this? */
-			ret = network_listen(&engine->net, str, port, flags);
+			ret = network_listen(&engine->net, str, port, nic_queue, flags);
+		} else {
+			if (!kind && !flags.tls) { /* normal UDP */
+				flags.sock_type = SOCK_DGRAM;
+				ret = network_listen(&engine->net, str, port, -1, flags);
+			}
+			if (!kind && ret == 0) { /* common for normal TCP and TLS */
+				flags.sock_type = SOCK_STREAM;
+				ret = network_listen(&engine->net, str, port, -1, flags);
+			}
+			if (kind) {
+				flags.kind = strdup(kind);
+				flags.sock_type = SOCK_STREAM; /* TODO: allow to override this? */
+				ret = network_listen(&engine->net, str, port, -1, flags);
+			}
 		}
 		if (ret != 0) {
 			if (str[0] == '/') {
 				kr_log_error("[system] bind to '%s' (UNIX): %s\n",
 						str, kr_strerror(ret));
+			} else if (xdp) {
+				kr_log_error("[system] listen on interface '%s@%d' (XDP): %s\n",
+						str, port, kr_strerror(ret));
 			} else {
 				const char *stype = flags.sock_type == SOCK_DGRAM ? "UDP" : "TCP";
 				kr_log_error("[system] bind to '%s@%d' (%s): %s\n",
@@ -144,7 +167,7 @@ static bool net_listen_addrs(lua_State *L, int port, bool tls, const char *kind,
 		lua_error_p(L, "bad type for address");
 	lua_pushnil(L);
 	while (lua_next(L, -2)) {
-		if (!net_listen_addrs(L, port, tls, kind, freebind))
+		if (!net_listen_addrs(L, port, tls, kind, freebind, xdp, nic_queue))
 			return false;
 		lua_pop(L, 1);
 	}
@@ -185,6 +208,8 @@ static int net_listen(lua_State *L)
 
 	bool tls = (port == KR_DNS_TLS_PORT);
 	bool freebind = false;
+	bool xdp = false;
+	int16_t nic_queue = -1;
 	const char *kind = NULL;
 	if (n > 2 && !lua_isnil(L, 3)) {
 		if (!lua_istable(L, 3))
@@ -200,9 +225,24 @@ static int net_listen(lua_State *L)
 		if (k && strcasecmp(k, "tls") == 0) {
 			tls = true;
 		} else
+		if (k && strcasecmp(k, "xdp") == 0) {
+			tls = false;
+			xdp = true;
+		} else
 		if (k) {
 			kind = k;
 		}
+
+		lua_getfield(L, 3, "nic_queue");
+		if (lua_isnumber(L, -1)) {
+			lua_Integer q = lua_tointeger(L, -1);
+			if (!xdp || q < 0 || q > INT16_MAX)
+				lua_error_p(L, "nic_queue must be within <0, " STR(INT16_MAX)
+						"> and only used with kind = 'xdp'");
+			nic_queue = q;
+		} else if (!lua_isnil(L, -1)) {
+			lua_error_p(L, "wrong type of nic_queue (number expected)");
+		}
 	}
 
 	/* Memory management of `kind` string is difficult due to longjmp etc.
@@ -216,7 +256,7 @@ static int net_listen(lua_State *L)
 
 	/* Now focus on the first argument. */
 	lua_settop(L, 1);
-	if (!net_listen_addrs(L, port, tls, kind, freebind))
+	if (!net_listen_addrs(L, port, tls, kind, freebind, xdp, nic_queue))
 		lua_error_p(L, "net.listen() failed to bind");
 	lua_pushboolean(L, true);
 	return 1;
@@ -333,6 +373,37 @@ static int net_pipeline(lua_State *L)
 	return 1;
 }
 
+/** Configure the pool of outgoing UDP sockets. */
+static int net_udp_pool(lua_State *L)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker) {
+		return 0;
+	}
+	struct udp_pool *pool = &worker->udp_pool;
+	const int n = lua_gettop(L);
+	if (n > 2 || (n >= 1 && !lua_isnumber(L, 1)) || (n == 2 && !lua_isnumber(L, 2)))
+		lua_error_p(L, "net.udp_pool takes up to two numbers: size, max_uses");
+	if (n >= 1) {
+		lua_Integer size = lua_tointeger(L, 1);
+		if (size < 0 || size > UINT16_MAX)
+			lua_error_p(L, "udp_pool size must be within <0, " STR(UINT16_MAX) ">");
+		pool->size = size;
+	}
+	if (n == 2) {
+		lua_Integer max_uses = lua_tointeger(L, 2);
+		if (max_uses < 1 || max_uses > UINT16_MAX)
+			lua_error_p(L, "udp_pool max_uses must be within <1, " STR(UINT16_MAX) ">");
+		pool->max_uses = max_uses;
+	}
+	if (n >= 1) {
+		worker_udp_pool_flush(worker);
+	}
+	lua_pushinteger(L, pool->size);
+	lua_pushinteger(L, pool->max_uses);
+	return 2;
+}
+
 static int net_tls(lua_State *L)
 {
 	struct engine *engine = engine_luaget(L);
@@ -736,6 +807,22 @@ static int net_tls_padding(lua_State *L)
 	return 1;
 }
 
+static int net_tls_ktls(lua_State *L)
+{
+	struct network *net = &engine_luaget(L)->net;
+	const int n = lua_gettop(L);
+	if (n > 1 || (n == 1 && !lua_isboolean(L, 1)))
+		lua_error_p(L, "net.tls_ktls takes one optional boolean parameter");
+	if (n == 1) {
+		const bool enable = lua_toboolean(L, 1);
+		if (enable && !ENABLE_KTLS)
+			lua_error_p(L, "net.tls_ktls: kresd was built without kernel TLS support");
+		net->tls_ktls = enable;
+	}
+	lua_pushboolean(L, net->tls_ktls);
+	return 1;
+}
+
 /** Shorter salt can't contain much entropy. */
 #define net_tls_sticket_MIN_SECRET_LEN 32
 
@@ -851,6 +938,9 @@ static int net_outgoing(lua_State *L, int family)
 	if ((lua_gettop(L) != 1) || (!lua_isstring(L, 1) && !lua_isnil(L, 1)))
 		lua_error_p(L, "net.outgoing_vX takes one address string parameter or nil");
 
+	/* Pooled sockets are bound to the previous address. */
+	worker_udp_pool_flush(the_worker);
+
 	if (lua_isnil(L, 1)) {
 		addr->ip.sa_family = AF_UNSPEC;
 		return 1;
@@ -1010,11 +1100,13 @@ int kr_bindings_net(lua_State *L)
 		{ "interfaces",   net_interfaces },
 		{ "bufsize",      net_bufsize },
 		{ "tcp_pipeline", net_pipeline },
+		{ "udp_pool",     net_udp_pool },
 		{ "tls",          net_tls },
 		{ "tls_server",   net_tls },
 		{ "tls_client",   net_tls_client },
 		{ "tls_client_clear", net_tls_client_clear },
 		{ "tls_padding",  net_tls_padding },
+		{ "tls_ktls",     net_tls_ktls },
 		{ "tls_sticket_secret", net_tls_sticket_secret_string },
 		{ "tls_sticket_secret_file", net_tls_sticket_secret_file },
 		{ "outgoing_v4",  net_outgoing_v4 },
@@ -5,6 +5,9 @@
 #include "daemon/bindings/impl.h"
 
 #include "daemon/worker.h"
+#include "lib/dnssec/nsec3.h"
+#include "lib/dnssec/signature.h"
+#include "lib/zonecut.h"
 
 static inline double getseconds(uv_timeval_t *tv)
 {
@@ -25,6 +28,8 @@ static int wrk_stats(lua_State *L)
 	lua_setfield(L, -2, "concurrent");
 	lua_pushnumber(L, worker->stats.dropped);
 	lua_setfield(L, -2, "dropped");
+	lua_pushnumber(L, worker->stats.pcache_hits);
+	lua_setfield(L, -2, "pcache_hits");
 
 	lua_pushnumber(L, worker->stats.timeout);
 	lua_setfield(L, -2, "timeout");
@@ -38,6 +43,26 @@ static int wrk_stats(lua_State *L)
 	lua_setfield(L, -2, "ipv4");
 	lua_pushnumber(L, worker->stats.ipv6);
 	lua_setfield(L, -2, "ipv6");
+	lua_pushnumber(L, worker->stats.race);
+	lua_setfield(L, -2, "race");
+	lua_pushnumber(L, worker->stats.ns_bg);
+	lua_setfield(L, -2, "ns_bg");
+
+	const struct kr_nsec3_hash_stats nsec3 = kr_nsec3_hash_stats();
+	lua_pushnumber(L, nsec3.hit);
+	lua_setfield(L, -2, "nsec3_hash_hit");
+	lua_pushnumber(L, nsec3.miss);
+	lua_setfield(L, -2, "nsec3_hash_miss");
+	const struct kr_signature_memo_stats sig = kr_signature_memo_stats();
+	lua_pushnumber(L, sig.hit);
+	lua_setfield(L, -2, "rrsig_verify_hit");
+	lua_pushnumber(L, sig.miss);
+	lua_setfield(L, -2, "rrsig_verify_miss");
+	const struct kr_zonecut_memo_stats cut = kr_zonecut_memo_stats();
+	lua_pushnumber(L, cut.hit);
+	lua_setfield(L, -2, "zonecut_hit");
+	lua_pushnumber(L, cut.miss);
+	lua_setfield(L, -2, "zonecut_miss");
 
 	/* Add subset of rusage that represents counters. */
 	uv_rusage_t rusage;
@@ -62,10 +87,84 @@ static int wrk_stats(lua_State *L)
 	return 1;
 }
 
+/** Get/set coalescing of identical client requests. */
+static int wrk_coalesce(lua_State *L)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker) {
+		return 0;
+	}
+	const int n = lua_gettop(L);
+	if (n > 1 || (n == 1 && !lua_isboolean(L, 1)))
+		lua_error_p(L, "expected 'worker.coalesce([true|false])'");
+	if (n == 1) {
+		worker->coalesce = lua_toboolean(L, 1);
+	}
+	lua_pushboolean(L, worker->coalesce);
+	return 1;
+}
+
+/** Get/set racing of upstream addresses. */
+static int wrk_race(lua_State *L)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker) {
+		return 0;
+	}
+	const int n = lua_gettop(L);
+	if (n > 3 || (n >= 1 && !lua_isnumber(L, 1)) || (n >= 2 && !lua_isnumber(L, 2))
+	    || (n == 3 && !lua_isboolean(L, 3)))
+		lua_error_p(L, "expected 'worker.race([count [, budget [, hedge]]])'");
+	if (n >= 1) {
+		lua_Integer count = lua_tointeger(L, 1);
+		if (count < 1 || count > MAX_PENDING)
+			lua_error_p(L, "race count must be within <1, " STR(MAX_PENDING) ">");
+		lua_Integer budget = n >= 2 ? lua_tointeger(L, 2) : worker->race.budget;
+		if (budget < 0 || budget > 300)
+			lua_error_p(L, "race budget must be within <0, 300>");
+		worker->race.count = count;
+		worker->race.budget = budget;
+		if (n == 3) {
+			worker->race.hedge = lua_toboolean(L, 3);
+		}
+	}
+	lua_pushinteger(L, worker->race.count);
+	lua_pushinteger(L, worker->race.budget);
+	lua_pushboolean(L, worker->race.hedge);
+	return 3;
+}
+
+/** Enable/disable background lookups of NS addresses and limit them. */
+static int wrk_ns_bg(lua_State *L)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker) {
+		return 0;
+	}
+	const int n = lua_gettop(L);
+	if (n > 2 || (n >= 1 && !lua_isboolean(L, 1)) || (n == 2 && !lua_isnumber(L, 2)))
+		lua_error_p(L, "expected 'worker.ns_bg([true|false [, max]])'");
+	if (n == 2) {
+		lua_Integer max = lua_tointeger(L, 2);
+		if (max < 1 || max > 1000)
+			lua_error_p(L, "ns_bg max must be within <1, 1000>");
+		worker->ns_bg.max = max;
+	}
+	if (n >= 1) {
+		worker->ns_bg.enabled = lua_toboolean(L, 1);
+	}
+	lua_pushboolean(L, worker->ns_bg.enabled);
+	lua_pushinteger(L, worker->ns_bg.max);
+	return 2;
+}
+
 int kr_bindings_worker(lua_State *L)
 {
 	static const luaL_Reg lib[] = {
 		{ "stats",    wrk_stats },
+		{ "coalesce", wrk_coalesce },
+		{ "race",     wrk_race },
+		{ "ns_bg",    wrk_ns_bg },
 		{ NULL, NULL }
 	};
 	luaL_register(L, "worker", lib);
@@ -25,6 +25,10 @@
 #include "lib/cache/api.h"
 #include "lib/defines.h"
 #include "lib/cache/cdb_lmdb.h"
+#include "lib/cache/cdb_memory.h"
+#include "lib/dnssec.h"
+#include "lib/dnssec/nsec3.h"
+#include "lib/dnssec/signature.h"
 #include "lib/dnssec/ta.h"
 
 /* Magic defaults for the engine. */
@@ -41,6 +45,18 @@
 	#define LRU_COOKIES_SIZE LRU_ASSOC /* simpler than guards everywhere */
 	#endif
 #endif
+#ifndef LRU_NSEC3_SIZE
+#define LRU_NSEC3_SIZE 4096 /**< memo of NSEC3 hashes */
+#endif
+#ifndef LRU_SIGNATURE_SIZE
+#define LRU_SIGNATURE_SIZE 4096 /**< memo of verified RRSIGs */
+#endif
+#ifndef DNSKEY_MEMO_SIZE
+#define DNSKEY_MEMO_SIZE 1024 /**< parsed DNSKEYs kept by the validator */
+#endif
+#ifndef ZONECUT_MEMO_SIZE
+#define ZONECUT_MEMO_SIZE 4096 /**< zone cuts kept materialized */
+#endif
 
 /**@internal Maximum number of incomplete TCP connections in queue.
 * Default is from empirical testing - in our case, more isn't necessarily better.
@@ -455,13 +471,22 @@ static int init_resolver(struct engine *engine)
 	lru_create(&engine->resolver.cache_rtt, LRU_RTT_SIZE, NULL, NULL);
 	lru_create(&engine->resolver.cache_rep, LRU_REP_SIZE, NULL, NULL);
 	lru_create(&engine->resolver.cache_cookie, LRU_COOKIES_SIZE, NULL, NULL);
+	kr_nsec3_hash_memo(LRU_NSEC3_SIZE);
+	kr_signature_memo(LRU_SIGNATURE_SIZE);
+	kr_dnssec_key_memo(DNSKEY_MEMO_SIZE);
+	kr_zonecut_memo(ZONECUT_MEMO_SIZE);
 
 	/* Load basic modules */
 	engine_register(engine, "iterate", NULL, NULL);
 	engine_register(engine, "validate", NULL, NULL);
 	engine_register(engine, "cache", NULL, NULL);
 
-	return array_push(engine->backends, kr_cdb_lmdb());
+	/* The first one is the default. */
+	if (array_push(engine->backends, kr_cdb_lmdb()) < 0
+	    || array_push(engine->backends, kr_cdb_memory()) < 0) {
+		return kr_error(ENOMEM);
+	}
+	return kr_ok();
 }
 
 static int init_state(struct engine *engine)
@@ -636,12 +661,20 @@ void engine_deinit(struct engine *engine)
 		engine_unload(engine, engine->modules.at[i]);
 	}
 	kr_zonecut_deinit(&engine->resolver.root_hints);
+	(void)kr_nsrep_infra_flush(&engine->resolver);
 	kr_cache_close(&engine->resolver.cache);
+	kr_cache_l1_set(&engine->resolver.cache, 0);
+	kr_cache_write_back(&engine->resolver.cache, 0);
 
 	/* The LRUs are currently malloc-ated and need to be freed. */
 	lru_free(engine->resolver.cache_rtt);
 	lru_free(engine->resolver.cache_rep);
 	lru_free(engine->resolver.cache_cookie);
+	trie_free(engine->resolver.cache_infra_dirty);
+	kr_nsec3_hash_memo(0);
+	kr_signature_memo(0);
+	kr_dnssec_key_memo(0);
+	kr_zonecut_memo(0);
 
 	network_deinit(&engine->net);
 	ffimodule_deinit(engine->L);
@@ -2,6 +2,8 @@
  *  SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include "kresconfig.h"
+
 #include <string.h>
 #include <libknot/errcode.h>
 #include <contrib/ucw/lib.h>
@@ -14,6 +16,11 @@
 #include "daemon/tls.h"
 #include "daemon/session.h"
 
+#if ENABLE_XDP
+#include <libknot/xdp/xdp.h>
+#include "daemon/xdp_eth.h"
+#endif
+
 #define negotiate_bufsize(func, handle, bufsize_want) do { \
     int bufsize = 0; (func)((handle), &bufsize); \
 	if (bufsize < (bufsize_want)) { \
@@ -68,8 +75,14 @@ void udp_recv(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf,
 	}
 	if (nread <= 0) {
 		if (nread < 0) { /* Error response, notify resolver */
-			worker_submit(s, NULL, NULL);
+			worker_submit(s, NULL, NULL, NULL, NULL, NULL);
 		} /* nread == 0 is for freeing buffers, we don't need to do this */
+#if ENABLE_RECVMMSG
+		if (flags & UV_UDP_MMSG_FREE) {
+			/* The whole recvmmsg() batch has been submitted. */
+			mp_flush(worker->pkt_pool.ctx);
+		}
+#endif
 		return;
 	}
 	if (addr->sa_family == AF_UNSPEC) {
@@ -84,12 +97,24 @@ void udp_recv(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf,
 			return;
 		}
 	}
+	bool batched = false;
+#if ENABLE_RECVMMSG
+	if (flags & UV_UDP_MMSG_CHUNK) {
+		/* Each datagram of the batch lies in its own slice of wire_buf;
+		 * packets are released at once by the final UV_UDP_MMSG_FREE call. */
+		int ret = session_wirebuf_seek(s, (const uint8_t *)buf->base);
+		assert(ret == 0); (void)ret;
+		batched = true;
+	}
+#endif
 	ssize_t consumed = session_wirebuf_consume(s, (const uint8_t *)buf->base,
 						   nread);
 	assert(consumed == nread); (void)consumed;
 	session_wirebuf_process(s, addr);
 	session_wirebuf_discard(s);
-	mp_flush(worker->pkt_pool.ctx);
+	if (!batched) {
+		mp_flush(worker->pkt_pool.ctx);
+	}
 }
 
 static int family_to_freebind_option(sa_family_t sa_family, int *level, int *name)
@@ -166,7 +191,12 @@ int io_listen_udp(uv_loop_t *loop, uv_udp_t *handle, int fd)
 	if (!handle) {
 		return kr_error(EINVAL);
 	}
+#if ENABLE_RECVMMSG
+	/* Read up to RECVMMSG_BATCH datagrams per syscall, see udp_recv(). */
+	int ret = uv_udp_init_ex(loop, handle, AF_UNSPEC | UV_UDP_RECVMMSG);
+#else
 	int ret = uv_udp_init(loop, handle);
+#endif
 	if (ret) return ret;
 
 	ret = uv_udp_open(handle, fd);
@@ -189,6 +219,191 @@ int io_listen_udp(uv_loop_t *loop, uv_udp_t *handle, int fd)
 	return io_start_read(h);
 }
 
+#if ENABLE_XDP
+/** Number of frames taken from the AF_XDP RX ring at once. */
+#define XDP_RX_BATCH 64
+
+/** AF_XDP listener; the uv_poll_t watches the socket's fd for RX. */
+struct xdp_handle_data {
+	uv_poll_t handle;             /**< must be the first member, see io_deinit() */
+	knot_xdp_socket_t *socket;
+	/** Tasks with answers in the TX ring, completed by xdp_tx_check(). */
+	array_t(struct qr_task *) sent;
+};
+
+/** Global state for AF_XDP listeners. */
+static struct {
+	/** Listeners that might have a non-empty xdp_handle_data::sent. */
+	array_t(struct xdp_handle_data *) waiting;
+	uv_check_t check_handle;
+	bool initialized;
+} xdp_state = {0};
+
+static void xdp_complete(struct xdp_handle_data *xhd, int status)
+{
+	for (size_t i = 0; i < xhd->sent.len; ++i) {
+		qr_task_on_send(xhd->sent.at[i], NULL, status);
+		worker_task_unref(xhd->sent.at[i]);
+	}
+	xhd->sent.len = 0;
+}
+
+/** Kick the kernel to transmit everything queued during this loop iteration. */
+static void xdp_tx_check(uv_check_t *handle)
+{
+	for (size_t i = 0; i < xdp_state.waiting.len; ++i) {
+		struct xdp_handle_data *xhd = xdp_state.waiting.at[i];
+		int ret = knot_xdp_send_finish(xhd->socket);
+		if (ret != KNOT_EOK) {
+			kr_log_verbose("[xdp] TX kick failed: %s\n", knot_strerror(ret));
+		}
+		xdp_complete(xhd, ret == KNOT_EOK ? kr_ok() : kr_error(EIO));
+	}
+	xdp_state.waiting.len = 0;
+}
+
+static void xdp_rx(uv_poll_t *handle, int status, int events)
+{
+	if (status < 0) {
+		kr_log_error("[xdp] poll error: %s\n", uv_strerror(status));
+		return;
+	}
+	if (!(events & UV_READABLE)) {
+		return;
+	}
+	struct xdp_handle_data *xhd = (struct xdp_handle_data *)handle;
+	struct session *s = handle->data;
+	struct worker_ctx *worker = handle->loop->data;
+
+	knot_xdp_msg_t msgs[XDP_RX_BATCH];
+	uint32_t rcvd = 0;
+	int ret = knot_xdp_recv(xhd->socket, msgs, XDP_RX_BATCH, &rcvd);
+	if (ret != KNOT_EOK) {
+		kr_log_verbose("[xdp] RX failed: %s\n", knot_strerror(ret));
+		return;
+	}
+	for (uint32_t i = 0; i < rcvd; ++i) {
+		const knot_xdp_msg_t *msg = &msgs[i];
+		knot_pkt_t *pkt = knot_pkt_new(msg->payload.iov_base, msg->payload.iov_len,
+						&worker->pkt_pool);
+		if (!pkt) {
+			continue;
+		}
+		/* The request copies the query, so the frames can be released below. */
+		worker_submit(s, (const struct sockaddr *)&msg->ip_from,
+				(const struct sockaddr *)&msg->ip_to,
+				msg->eth_from, msg->eth_to, pkt);
+	}
+	knot_xdp_recv_finish(xhd->socket, msgs, rcvd);
+	mp_flush(worker->pkt_pool.ctx);
+}
+
+int io_listen_xdp(uv_loop_t *loop, struct endpoint *ep, const char *ifname)
+{
+	if (!ep || ep->handle || !ep->flags.xdp) {
+		assert(!EINVAL);
+		return kr_error(EINVAL);
+	}
+	if (!xdp_state.initialized) {
+		int ret = uv_check_init(loop, &xdp_state.check_handle);
+		if (!ret) ret = uv_check_start(&xdp_state.check_handle, xdp_tx_check);
+		if (ret) return ret;
+		xdp_state.initialized = true;
+	}
+
+	struct xdp_handle_data *xhd = calloc(1, sizeof(*xhd));
+	if (!xhd) {
+		return kr_error(ENOMEM);
+	}
+	const int queue = ep->nic_queue < 0 ? 0 : ep->nic_queue;
+	int ret = knot_xdp_init(&xhd->socket, ifname, queue, ep->port,
+				KNOT_XDP_LOAD_BPF_MAYBE);
+	if (ret != KNOT_EOK) {
+		kr_log_error("[xdp] failed to open interface '%s' queue %d: %s\n",
+				ifname, queue, knot_strerror(ret));
+		free(xhd);
+		return ret;
+	}
+	ret = uv_poll_init(loop, &xhd->handle, knot_xdp_socket_fd(xhd->socket));
+	if (ret) {
+		knot_xdp_deinit(xhd->socket);
+		free(xhd);
+		return ret;
+	}
+	/* From now on the handle is closed by endpoint_close() on errors. */
+	ep->handle = (uv_handle_t *)&xhd->handle;
+
+	struct session *s = session_new(ep->handle, false);
+	if (!s) {
+		return kr_error(ENOMEM);
+	}
+	session_flags(s)->outgoing = false;
+	return uv_poll_start(&xhd->handle, UV_READABLE, xdp_rx);
+}
+
+int io_xdp_push(struct session *session, const struct sockaddr *peer,
+		const struct sockaddr *dst, const uint8_t eth_addrs[2][6],
+		const knot_pkt_t *pkt, struct qr_task *task)
+{
+	uv_handle_t *handle = session_get_handle(session);
+	if (handle->type != UV_POLL) {
+		assert(!EINVAL);
+		return kr_error(EINVAL);
+	}
+	struct xdp_handle_data *xhd = (struct xdp_handle_data *)handle;
+
+	knot_xdp_send_prepare(xhd->socket); /* reclaim frames already transmitted */
+	knot_xdp_msg_t out;
+	int ret = knot_xdp_send_alloc(xhd->socket, peer->sa_family == AF_INET6,
+					&out, NULL);
+	if (ret != KNOT_EOK) {
+		return kr_error(ENOBUFS);
+	}
+	/* Address the reply from us to the peer. */
+	xdp_eth_reply_addrs(eth_addrs, out.eth_from, out.eth_to);
+	memcpy(&out.ip_from, dst, kr_sockaddr_len(dst));
+	memcpy(&out.ip_to, peer, kr_sockaddr_len(peer));
+	const bool fits = pkt->size <= out.payload.iov_len;
+	if (fits) {
+		memcpy(out.payload.iov_base, pkt->wire, pkt->size);
+		out.payload.iov_len = pkt->size;
+	} else {
+		/* Shouldn't happen, see request_start(); an empty payload
+		 * just returns the frame. */
+		assert(false);
+		out.payload.iov_len = 0;
+	}
+	uint32_t sent = 0;
+	ret = knot_xdp_send(xhd->socket, &out, 1, &sent);
+	if (ret != KNOT_EOK || !fits) {
+		return kr_error(fits ? EIO : EMSGSIZE);
+	}
+
+	if (array_push(xhd->sent, task) < 0) {
+		return kr_error(ENOMEM);
+	}
+	worker_task_ref(task);
+	if (xhd->sent.len == 1) {
+		array_push(xdp_state.waiting, xhd);
+	}
+	return kr_ok();
+}
+
+static void xdp_deinit(struct xdp_handle_data *xhd)
+{
+	for (size_t i = 0; i < xdp_state.waiting.len; ++i) {
+		if (xdp_state.waiting.at[i] == xhd) {
+			array_del(xdp_state.waiting, i);
+			break;
+		}
+	}
+	xdp_complete(xhd, kr_error(ECANCELED));
+	array_clear(xhd->sent);
+	knot_xdp_deinit(xhd->socket);
+	xhd->socket = NULL;
+}
+#endif
+
 void tcp_timeout_trigger(uv_timer_t *timer)
 {
 	struct session *s = timer->data;
@@ -645,6 +860,11 @@ void io_deinit(uv_handle_t *handle)
 		session_free(handle->data);
 		handle->data = NULL;
 	}
+#if ENABLE_XDP
+	if (handle->type == UV_POLL) {
+		xdp_deinit((struct xdp_handle_data *)handle);
+	}
+#endif
 }
 
 void io_free(uv_handle_t *handle)
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include "kresconfig.h"
+
 #include <lua.h>
 #include <uv.h>
 #include <libknot/packet/pkt.h>
@@ -24,6 +26,18 @@ int io_listen_tcp(uv_loop_t *loop, uv_tcp_t *handle, int fd, int tcp_backlog, bo
 /** Initialize a pipe handle and start listening. */
 int io_listen_pipe(uv_loop_t *loop, uv_pipe_t *handle, int fd);
 
+#if ENABLE_XDP
+/** Open an AF_XDP socket on interface ifname and start listening.
+ * On success (and on some errors) ep->handle is set to a uv_poll_t. */
+int io_listen_xdp(uv_loop_t *loop, struct endpoint *ep, const char *ifname);
+/** Queue an answer into the TX ring of the AF_XDP listener of the session.
+ * eth_addrs are our and peer's MAC addresses.  The task is completed
+ * after the ring is flushed, at the end of the current loop iteration. */
+int io_xdp_push(struct session *session, const struct sockaddr *peer,
+		const struct sockaddr *dst, const uint8_t eth_addrs[2][6],
+		const knot_pkt_t *pkt, struct qr_task *task);
+#endif
+
 /** Control socket / TTY - related functions. */
 void io_tty_process_input(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf);
 void io_tty_alloc(uv_handle_t *handle, size_t suggested, uv_buf_t *buf);
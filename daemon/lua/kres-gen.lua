@@ -193,6 +193,7 @@ struct kr_request {
 	unsigned int uid;
 	unsigned int count_no_nsaddr;
 	unsigned int count_fail_row;
+	unsigned int count_ns_bg;
 };
 enum kr_rank {KR_RANK_INITIAL, KR_RANK_OMIT, KR_RANK_TRY, KR_RANK_INDET = 4, KR_RANK_BOGUS, KR_RANK_MISMATCH, KR_RANK_MISSING, KR_RANK_INSECURE, KR_RANK_AUTH = 16, KR_RANK_SECURE = 32};
 struct kr_cdb_stats {
@@ -210,6 +211,8 @@ struct kr_cdb_stats {
 	uint64_t match_miss;
 	uint64_t read_leq;
 	uint64_t read_leq_miss;
+	uint64_t l1_hit;
+	uint64_t l1_miss;
 	double usage_percent;
 };
 struct kr_cache {
@@ -220,6 +223,9 @@ struct kr_cache {
 	uint32_t ttl_max;
 	struct timeval checkpoint_walltime;
 	uint64_t checkpoint_monotime;
+	uint32_t generation;
+	struct kr_cache_l1 *l1;
+	struct kr_cache_pending *pending;
 };
 typedef struct kr_layer {
 	int state;
@@ -390,6 +396,7 @@ typedef struct {
 	_Bool tls;
 	const char *kind;
 	_Bool freebind;
+	_Bool xdp;
 } endpoint_flags_t;
 typedef struct {
 	char **at;
@@ -428,6 +435,7 @@ struct endpoint {
 	int fd;
 	int family;
 	uint16_t port;
+	int16_t nic_queue;
 	_Bool engaged;
 	endpoint_flags_t flags;
 };
@@ -21,6 +21,7 @@ void network_init(struct network *net, uv_loop_t *loop, int tcp_backlog)
 		net->endpoints = map_make(NULL);
 		net->endpoint_kinds = trie_create(NULL);
 		net->tls_client_params = NULL;
+		net->tls_ktls = false;
 		net->tls_session_ticket_ctx = /* unsync. random, by default */
 		tls_session_ticket_ctx_create(loop, NULL, 0);
 		net->tcp.in_idle_timeout = 10000;
@@ -139,7 +140,7 @@ static void endpoint_close(struct network *net, struct endpoint *ep, bool force)
 	}
 
 	if (ep->flags.kind && !control) {
-		assert(!ep->handle);
+		assert(!ep->handle && !ep->flags.xdp);
 		/* Special lua-handled endpoint. */
 		if (ep->engaged) {
 			endpoint_close_lua_cb(net, ep);
@@ -245,6 +246,23 @@ static int open_endpoint(struct network *net, struct endpoint *ep,
 			 const struct sockaddr *sa, const char *log_addr)
 {
 	bool control = ep->flags.kind && strcmp(ep->flags.kind, "control") == 0;
+	if (ep->flags.xdp) {
+		/* The socket is opened by libknot on the interface named log_addr. */
+		if (sa || ep->fd != -1 || ep->flags.kind || ep->flags.tls) {
+			assert(!EINVAL);
+			return kr_error(EINVAL);
+		}
+		if (ep->handle) {
+			return kr_error(EEXIST);
+		}
+		ep->engaged = true;
+#if ENABLE_XDP
+		return io_listen_xdp(net->loop, ep, log_addr);
+#else
+		kr_log_error("[system] kresd was built without XDP support\n");
+		return kr_error(ENOTSUP);
+#endif
+	}
 	if ((sa != NULL) == (ep->fd != -1)) {
 		assert(!EINVAL);
 		return kr_error(EINVAL);
@@ -380,6 +398,7 @@ int network_listen_fd(struct network *net, int fd, endpoint_flags_t flags)
 		.flags = flags,
 		.family = ss.ss_family,
 		.fd = fd,
+		.nic_queue = -1,
 	};
 	/* Extract address string and port. */
 	char addr_buf[INET6_ADDRSTRLEN]; /* https://tools.ietf.org/html/rfc4291 */
@@ -411,7 +430,7 @@ int network_listen_fd(struct network *net, int fd, endpoint_flags_t flags)
 }
 
 int network_listen(struct network *net, const char *addr, uint16_t port,
-		   endpoint_flags_t flags)
+		   int16_t nic_queue, endpoint_flags_t flags)
 {
 	if (net == NULL || addr == 0 || port == 0) {
 		assert(!EINVAL);
@@ -421,6 +440,17 @@ int network_listen(struct network *net, const char *addr, uint16_t port,
 		return kr_error(EADDRINUSE); /* Already listening */
 	}
 
+	if (flags.xdp) { /* addr is an interface name */
+		struct endpoint ep = {
+			.flags = flags,
+			.fd = -1,
+			.port = port,
+			.nic_queue = nic_queue,
+			.family = AF_UNSPEC,
+		};
+		return create_endpoint(net, addr, &ep, NULL);
+	}
+
 	/* Parse address. */
 	const struct sockaddr *sa = kr_straddr_socket(addr, port, NULL);
 	if (!sa) {
@@ -430,6 +460,7 @@ int network_listen(struct network *net, const char *addr, uint16_t port,
 		.flags = flags,
 		.fd = -1,
 		.port = port,
+		.nic_queue = -1,
 		.family = sa->sa_family,
 	};
 	int ret = create_endpoint(net, addr, &ep, sa);
@@ -497,6 +528,9 @@ static int set_bpf_cb(const char *key, void *val, void *ext)
 
 	for (size_t i = 0; i < endpoints->len; i++) {
 		struct endpoint *endpoint = &endpoints->at[i];
+		if (endpoint->flags.xdp) {
+			continue; /* AF_XDP has its own BPF program on the interface */
+		}
 		uv_os_fd_t sockfd = -1;
 		if (endpoint->handle != NULL)
 			uv_fileno(endpoint->handle, &sockfd);
@@ -535,6 +569,9 @@ static int clear_bpf_cb(const char *key, void *val, void *ext)
 
 	for (size_t i = 0; i < endpoints->len; i++) {
 		struct endpoint *endpoint = &endpoints->at[i];
+		if (endpoint->flags.xdp) {
+			continue; /* AF_XDP has its own BPF program on the interface */
+		}
 		uv_os_fd_t sockfd = -1;
 		if (endpoint->handle != NULL)
 			uv_fileno(endpoint->handle, &sockfd);
@@ -22,11 +22,12 @@ typedef struct {
 	bool tls;         /**< only used together with .kind == NULL and .tcp */
 	const char *kind; /**< tag for other types than the three usual */
 	bool freebind;    /**< used for binding to non-local address **/
+	bool xdp;         /**< AF_XDP socket on a network interface; .sock_type == SOCK_DGRAM */
 } endpoint_flags_t;
 
 static inline bool endpoint_flags_eq(endpoint_flags_t f1, endpoint_flags_t f2)
 {
-	if (f1.sock_type != f2.sock_type)
+	if (f1.sock_type != f2.sock_type || f1.xdp != f2.xdp)
 		return false;
 	if (f1.kind && f2.kind)
 		return strcasecmp(f1.kind, f2.kind);
@@ -39,12 +40,14 @@ static inline bool endpoint_flags_eq(endpoint_flags_t f1, endpoint_flags_t f2)
  *
  * LATER: .family might be unexpected for IPv4-in-IPv6 addresses.
  * ATM AF_UNIX is only supported with flags.kind != NULL
+ * With flags.xdp the endpoint is keyed by interface name and .family is AF_UNSPEC.
  */
 struct endpoint {
 	uv_handle_t *handle; /**< uv_udp_t or uv_tcp_t; NULL in case flags.kind != NULL */
-	int fd;              /**< POSIX file-descriptor; always used. */
+	int fd;              /**< POSIX file-descriptor; always used, except for flags.xdp. */
 	int family;          /**< AF_INET or AF_INET6 or AF_UNIX */
 	uint16_t port;       /**< TCP/UDP port.  Meaningless with AF_UNIX. */
+	int16_t nic_queue;   /**< -1 or queue number of the interface for AF_XDP use. */
 	bool engaged;        /**< to some module or internally */
 	endpoint_flags_t flags;
 };
@@ -76,6 +79,7 @@ struct network {
 	struct tls_credentials *tls_credentials;
 	tls_client_params_t *tls_client_params; /**< Use tls_client_params_*() functions. */
 	struct tls_session_ticket_ctx *tls_session_ticket_ctx;
+	bool tls_ktls; /**< Hand record encryption of DoT answers to the kernel. */
 	struct net_tcp_param tcp;
 	int tcp_backlog;
 };
@@ -84,13 +88,14 @@ void network_init(struct network *net, uv_loop_t *loop, int tcp_backlog);
 void network_deinit(struct network *net);
 
 /** Start listenting on addr#port with flags.
+ * \param nic_queue only used with flags.xdp; addr is the interface name then.
  * \note if we did listen on that combination already,
  *       nothing is done and kr_error(EADDRINUSE) is returned.
  * \note there's no short-hand to listen both on UDP and TCP.
  * \note ownership of flags.* is taken on success.  TODO: non-success?
  */
 int network_listen(struct network *net, const char *addr, uint16_t port,
-		   endpoint_flags_t flags);
+		   int16_t nic_queue, endpoint_flags_t flags);
 
 /** Start listenting on an open file-descriptor.
  * \note flags.sock_type isn't meaningful here.
@@ -0,0 +1,230 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "daemon/packet_cache.h"
+
+#include <libknot/descriptor.h>
+#include <libknot/packet/wire.h>
+#include <libknot/rrtype/opt.h>
+
+#include "contrib/wire.h"
+#include "lib/cache/api.h"
+#include "lib/defines.h"
+#include "lib/utils.h"
+
+/** Larger answers aren't stored; that's the usual EDNS buffer size. */
+#define PACKET_CACHE_WIRE_MAX 1232
+/** Answers with more records aren't stored. */
+#define PACKET_CACHE_TTL_MAX 32
+/** flags + EDNS payload + qtype + qclass + qname */
+#define PACKET_CACHE_KEY_MAXLEN (1 + 3 * sizeof(uint16_t) + KNOT_DNAME_MAXLEN)
+
+struct packet_cache_entry {
+	uint64_t stored;  /**< kr_now() when stored */
+	uint64_t expires; /**< kr_now() when no longer usable */
+	uint16_t size;
+	uint16_t ttl_count;
+	uint16_t ttl_off[PACKET_CACHE_TTL_MAX]; /**< positions of TTL fields in wire */
+	uint8_t wire[PACKET_CACHE_WIRE_MAX];
+};
+
+int packet_cache_set(struct packet_cache *pc, unsigned size, uint32_t max_ttl)
+{
+	if (pc->lru) {
+		lru_free(pc->lru);
+		pc->lru = NULL;
+	}
+	pc->size = size;
+	pc->max_ttl = max_ttl;
+	if (size == 0) {
+		return kr_ok();
+	}
+	lru_create(&pc->lru, size, NULL, NULL);
+	if (!pc->lru) {
+		pc->size = 0;
+		return kr_error(ENOMEM);
+	}
+	return kr_ok();
+}
+
+/** Drop everything if records were removed from the cache since the last time. */
+static void packet_cache_sync(struct packet_cache *pc, const struct kr_cache *cache)
+{
+	if (pc->generation != cache->generation) {
+		lru_reset(pc->lru);
+		pc->generation = cache->generation;
+	}
+}
+
+/** Compose the key for query; return its length, or 0 if the query isn't eligible. */
+static int packet_cache_key(uint8_t key[PACKET_CACHE_KEY_MAXLEN], const knot_pkt_t *query)
+{
+	const uint8_t *wire = query->wire;
+	const knot_rrset_t *opt = query->opt_rr;
+	if (knot_wire_get_opcode(wire) != KNOT_OPCODE_QUERY
+	    || knot_wire_get_qdcount(wire) != 1
+	    || knot_wire_get_ancount(wire) != 0
+	    || knot_wire_get_nscount(wire) != 0
+	    || knot_wire_get_arcount(wire) != (opt ? 1 : 0)
+	    || query->tsig_rr) {
+		return 0;
+	}
+	/* EDNS options (cookies, ECS, padding...) make the answer client-specific. */
+	if (opt && (knot_edns_get_version(opt) != 0 || opt->rrs.rdata->len != 0)) {
+		return 0;
+	}
+
+	const uint8_t flags = (knot_wire_get_rd(wire) ? 1 << 0 : 0)
+			    | (knot_wire_get_cd(wire) ? 1 << 1 : 0)
+			    | (knot_wire_get_ad(wire) ? 1 << 2 : 0)
+			    | (opt ? 1 << 3 : 0)
+			    | (opt && knot_edns_do(opt) ? 1 << 4 : 0);
+	const uint16_t payload = opt ? knot_edns_get_payload(opt) : 0;
+	const uint16_t qtype = knot_pkt_qtype(query);
+	const uint16_t qclass = knot_pkt_qclass(query);
+
+	uint8_t *pos = key;
+	*pos++ = flags;
+	memcpy(pos, &payload, sizeof(payload));
+	pos += sizeof(payload);
+	memcpy(pos, &qtype, sizeof(qtype));
+	pos += sizeof(qtype);
+	memcpy(pos, &qclass, sizeof(qclass));
+	pos += sizeof(qclass);
+	memcpy(pos, knot_pkt_qname(query), query->qname_size);
+	knot_dname_to_lower(pos);
+	return pos + query->qname_size - key;
+}
+
+/** Return position after the (possibly compressed) name at pos, or -1. */
+static int skip_name(const uint8_t *wire, int size, int pos)
+{
+	while (pos < size) {
+		const uint8_t len = wire[pos];
+		if (len == 0) {
+			return pos + 1;
+		} else if ((len & 0xC0) == 0xC0) {
+			return pos + 2 <= size ? pos + 2 : -1;
+		} else if (len & 0xC0) {
+			return -1;
+		}
+		pos += 1 + len;
+	}
+	return -1;
+}
+
+/** Find the TTL fields of all records except OPT and lower ttl_min to their minimum.
+ * @return the number of records, or -1 if they don't fit or the wire is malformed. */
+static int find_ttls(const uint8_t *wire, int size, uint16_t off[PACKET_CACHE_TTL_MAX],
+		     uint32_t *ttl_min)
+{
+	int pos = skip_name(wire, size, KNOT_WIRE_HEADER_SIZE);
+	/* qtype, qclass */
+	if (pos < 0 || pos + 4 > size) {
+		return -1;
+	}
+	pos += 4;
+
+	const int rrcount = knot_wire_get_ancount(wire) + knot_wire_get_nscount(wire)
+			  + knot_wire_get_arcount(wire);
+	int count = 0;
+	for (int i = 0; i < rrcount; ++i) {
+		pos = skip_name(wire, size, pos);
+		/* type, class, TTL, rdlength */
+		if (pos < 0 || pos + 10 > size) {
+			return -1;
+		}
+		if (wire_read_u16(wire + pos) != KNOT_RRTYPE_OPT) {
+			if (count == PACKET_CACHE_TTL_MAX) {
+				return -1;
+			}
+			off[count++] = pos + 4;
+			*ttl_min = MIN(*ttl_min, wire_read_u32(wire + pos + 4));
+		}
+		pos += 10 + wire_read_u16(wire + pos + 8);
+	}
+	return pos == size ? count : -1;
+}
+
+int packet_cache_answer(struct packet_cache *pc, const struct kr_cache *cache,
+			uv_udp_t *handle, const struct sockaddr *peer,
+			const knot_pkt_t *query)
+{
+	if (!pc->lru) {
+		return kr_error(ENOENT);
+	}
+	packet_cache_sync(pc, cache);
+	uint8_t key[PACKET_CACHE_KEY_MAXLEN];
+	const int key_len = packet_cache_key(key, query);
+	if (key_len == 0) {
+		return kr_error(ENOENT);
+	}
+	const struct packet_cache_entry *e = lru_get_try(pc->lru, (const char *)key, key_len);
+	const uint64_t now = kr_now();
+	if (!e || e->expires <= now) {
+		return kr_error(ENOENT);
+	}
+	const uint16_t answer_max = query->opt_rr
+		? MAX(knot_edns_get_payload(query->opt_rr), KNOT_WIRE_MIN_PKTSIZE)
+		: KNOT_WIRE_MIN_PKTSIZE;
+	if (e->size > answer_max) {
+		return kr_error(EMSGSIZE);
+	}
+
+	uint8_t wire[PACKET_CACHE_WIRE_MAX];
+	memcpy(wire, e->wire, e->size);
+	knot_wire_set_id(wire, knot_wire_get_id(query->wire));
+	/* Echo the question with the letter case the client used. */
+	memcpy(wire + KNOT_WIRE_HEADER_SIZE, knot_pkt_qname(query), query->qname_size);
+	/* The entry expires with the lowest TTL, so this can't underflow. */
+	const uint32_t elapsed = (now - e->stored) / 1000;
+	for (int i = 0; i < e->ttl_count; ++i) {
+		uint8_t *ttl = wire + e->ttl_off[i];
+		wire_write_u32(ttl, wire_read_u32(ttl) - elapsed);
+	}
+
+	uv_buf_t buf = { .base = (char *)wire, .len = e->size };
+	const int ret = uv_udp_try_send(handle, &buf, 1, peer);
+	return ret == e->size ? kr_ok() : kr_error(EAGAIN);
+}
+
+void packet_cache_insert(struct packet_cache *pc, const struct kr_cache *cache,
+			 const knot_pkt_t *query, const knot_pkt_t *answer)
+{
+	if (!pc->lru || !query || !answer) {
+		return;
+	}
+	const uint8_t *wire = answer->wire;
+	const uint8_t rcode = knot_wire_get_rcode(wire);
+	if (answer->size > PACKET_CACHE_WIRE_MAX
+	    || knot_wire_get_tc(wire)
+	    || knot_wire_get_qdcount(wire) != 1
+	    || (rcode != KNOT_RCODE_NOERROR && rcode != KNOT_RCODE_NXDOMAIN)) {
+		return;
+	}
+	packet_cache_sync(pc, cache);
+	uint8_t key[PACKET_CACHE_KEY_MAXLEN];
+	const int key_len = packet_cache_key(key, query);
+	if (key_len == 0) {
+		return;
+	}
+
+	uint16_t ttl_off[PACKET_CACHE_TTL_MAX];
+	uint32_t ttl_min = pc->max_ttl;
+	const int ttl_count = find_ttls(wire, answer->size, ttl_off, &ttl_min);
+	if (ttl_count < 0 || ttl_min == 0) {
+		return;
+	}
+
+	struct packet_cache_entry *e = lru_get_new(pc->lru, (const char *)key, key_len, NULL);
+	if (!e) {
+		return;
+	}
+	e->stored = kr_now();
+	e->expires = e->stored + 1000 * (uint64_t)ttl_min;
+	e->size = answer->size;
+	e->ttl_count = ttl_count;
+	memcpy(e->ttl_off, ttl_off, ttl_count * sizeof(ttl_off[0]));
+	memcpy(e->wire, wire, answer->size);
+}
@@ -0,0 +1,37 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <uv.h>
+#include <libknot/packet/pkt.h>
+#include "lib/generic/lru.h"
+
+struct kr_cache;
+struct packet_cache_entry;
+
+/** Default for the longest time an answer is served from the packet cache, in seconds. */
+#define PACKET_CACHE_MAX_TTL_DEFAULT 10
+
+/** Rendered answers to plain UDP queries, served without creating a request.
+ * See cache.packet_cache() for the limitations. */
+struct packet_cache {
+	lru_t(struct packet_cache_entry) *lru; /**< NULL if disabled */
+	unsigned size;
+	uint32_t max_ttl;
+	uint32_t generation; /**< kr_cache::generation the entries come from */
+};
+
+/** Drop all entries and resize; size 0 disables the cache and frees it. */
+int packet_cache_set(struct packet_cache *pc, unsigned size, uint32_t max_ttl);
+
+/** Send a cached answer to query over the UDP handle.
+ * @return kr_ok() if the answer has been sent, an error code on miss. */
+int packet_cache_answer(struct packet_cache *pc, const struct kr_cache *cache,
+			uv_udp_t *handle, const struct sockaddr *peer,
+			const knot_pkt_t *query);
+
+/** Remember the finished answer to query, if it is suitable. */
+void packet_cache_insert(struct packet_cache *pc, const struct kr_cache *cache,
+			 const knot_pkt_t *query, const knot_pkt_t *answer);
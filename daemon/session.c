@@ -41,6 +41,7 @@ struct session {
 	ssize_t wire_buf_end_idx;     /**< Data end offset in wire_buf. */
 	uint64_t last_activity;       /**< Time of last IO activity (if any occurs).
 				       *   Otherwise session creation time. */
+	unsigned recycled;            /**< Outgoing UDP: how many times the socket was reused. */
 };
 
 static void on_session_close(uv_handle_t *handle)
@@ -109,6 +110,23 @@ void session_close(struct session *session)
 	}
 }
 
+int session_recycle(struct session *session)
+{
+	if (!session->sflags.outgoing || session->handle->type != UV_UDP
+	    || session->sflags.closing || !session_is_empty(session)) {
+		return kr_error(EINVAL);
+	}
+	/* Late answers stay in the socket buffer; they get filtered
+	 * by peer address and message ID once the socket is reused. */
+	io_stop_read(session->handle);
+	uv_timer_stop(&session->timeout);
+	memset(&session->peer, 0, sizeof(session->peer));
+	session->sflags.throttled = false;
+	session->sflags.wirebuf_error = false;
+	session->recycled += 1;
+	return session->recycled;
+}
+
 int session_start_read(struct session *session)
 {
 	return io_start_read(session->handle);
@@ -654,6 +672,23 @@ void session_wirebuf_discard(struct session *session)
 	session->wire_buf_end_idx = 0;
 }
 
+int session_wirebuf_seek(struct session *session, const uint8_t *data)
+{
+	if (session->handle->type != UV_UDP ||
+	    session->wire_buf_start_idx != session->wire_buf_end_idx) {
+		/* shouldn't happen */
+		return kr_error(EINVAL);
+	}
+	if (data < session->wire_buf ||
+	    data >= session->wire_buf + session->wire_buf_size) {
+		/* shouldn't happen */
+		return kr_error(EINVAL);
+	}
+	session->wire_buf_start_idx = data - session->wire_buf;
+	session->wire_buf_end_idx = session->wire_buf_start_idx;
+	return kr_ok();
+}
+
 void session_wirebuf_compress(struct session *session)
 {
 	if (session->wire_buf_start_idx == 0) {
@@ -718,7 +753,7 @@ int session_wirebuf_process(struct session *session, const struct sockaddr *peer
 	while (((query = session_produce_packet(session, &worker->pkt_pool)) != NULL) &&
 	       (ret < max_iterations)) {
 		assert (!session_wirebuf_error(session));
-		int res = worker_submit(session, peer, query);
+		int res = worker_submit(session, peer, NULL, NULL, NULL, query);
 		if (res != kr_error(EILSEQ)) {
 			/* Packet has been successfully parsed. */
 			ret += 1;
@@ -747,7 +782,9 @@ void session_kill_ioreq(struct session *s, struct qr_task *task)
 	session_tasklist_del(s, task);
 	if (s->handle->type == UV_UDP) {
 		assert(session_tasklist_is_empty(s));
-		session_close(s);
+		if (worker_udp_pool_put(s) != 0) {
+			session_close(s);
+		}
 		return;
 	}
 }
@@ -31,6 +31,9 @@ void session_free(struct session *session);
 void session_clear(struct session *session);
 /** Close session. */
 void session_close(struct session *session);
+/** Reset an idle outgoing UDP session so that its socket can serve another query.
+ * @return the number of times the session was recycled, or an error code. */
+int session_recycle(struct session *session);
 /** Start reading from underlying libuv IO handle. */
 int session_start_read(struct session *session);
 /** Stop reading from underlying libuv IO handle. */
@@ -117,6 +120,9 @@ uint8_t *session_wirebuf_get_free_start(struct session *session);
 size_t session_wirebuf_get_free_size(struct session *session);
 /** Discard all data in session wirebuffer. */
 void session_wirebuf_discard(struct session *session);
+/** Move the empty session wirebuffer so that the free space starts at data.
+ * Only for UDP, where libuv's recvmmsg mode puts datagrams into separate slices. */
+int session_wirebuf_seek(struct session *session, const uint8_t *data);
 /** Move all data to the beginning of the buffer. */
 void session_wirebuf_compress(struct session *session);
 int session_wirebuf_process(struct session *session, const struct sockaddr *peer);
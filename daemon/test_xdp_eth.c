@@ -0,0 +1,49 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "tests/unit/test.h"
+#include "daemon/xdp_eth.h"
+
+static const uint8_t mac_ours[6] = { 0x02, 0, 0, 0, 0, 0x01 };
+static const uint8_t mac_peer[6] = { 0x02, 0, 0, 0, 0, 0x02 };
+
+/** Ethernet header: destination MAC, source MAC and EtherType. */
+#define ETH_HDR_LEN 14
+static void eth_hdr_init(uint8_t hdr[ETH_HDR_LEN], const uint8_t *from, const uint8_t *to)
+{
+	memcpy(hdr, to, 6);
+	memcpy(hdr + 6, from, 6);
+	hdr[12] = 0x08; /* IPv4 */
+	hdr[13] = 0x00;
+}
+
+static void test_xdp_eth_reply(void **state)
+{
+	/* A query frame comes from the peer to us; xdp_rx() passes pointers
+	 * into its header, which request_create() stores. */
+	uint8_t query[ETH_HDR_LEN];
+	eth_hdr_init(query, mac_peer, mac_ours);
+	uint8_t eth_addrs[2][6];
+	xdp_eth_addrs_set(eth_addrs, query + 6, query);
+	memset(query, 0, sizeof(query)); /* the frame is released meanwhile */
+
+	/* io_xdp_push() addresses the reply within its frame. */
+	uint8_t reply[ETH_HDR_LEN];
+	memset(reply, 0, sizeof(reply));
+	reply[12] = 0x08;
+	xdp_eth_reply_addrs((const uint8_t (*)[6])eth_addrs, reply + 6, reply);
+
+	uint8_t expected[ETH_HDR_LEN];
+	eth_hdr_init(expected, mac_ours, mac_peer);
+	assert_memory_equal(reply, expected, ETH_HDR_LEN);
+}
+
+int main(void)
+{
+	const UnitTest tests[] = {
+		unit_test(test_xdp_eth_reply),
+	};
+
+	return run_tests(tests);
+}
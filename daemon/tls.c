@@ -18,6 +18,14 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#include "kresconfig.h"
+#if ENABLE_KTLS
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
 #include "contrib/ucw/lib.h"
 #include "contrib/base64.h"
 #include "daemon/io.h"
@@ -101,15 +109,9 @@ static bool stream_queue_is_empty(struct tls_common_ctx *t)
 	return (t->write_queue_size == 0);
 }
 
-static ssize_t kres_gnutls_vec_push(gnutls_transport_ptr_t h, const giovec_t * iov, int iovcnt)
+/** Write the buffers to the TCP stream, copying them only if they can't go out at once. */
+static ssize_t tls_stream_writev(struct tls_common_ctx *t, const giovec_t * iov, int iovcnt)
 {
-	struct tls_common_ctx *t = (struct tls_common_ctx *)h;
-
-	if (t == NULL) {
-		errno = EFAULT;
-		return -1;
-	}
-
 	if (iovcnt == 0) {
 		return 0;
 	}
@@ -140,7 +142,7 @@ static ssize_t kres_gnutls_vec_push(gnutls_transport_ptr_t h, const giovec_t * i
 	if (stream_queue_is_empty(t)) {
 		ret = uv_try_write(handle, uv_buf, iovcnt);
 		DEBUG_MSG("[%s] push %zu <%p> = %d\n",
-		    t->client_side ? "tls_client" : "tls", total_len, h, ret);
+		    t->client_side ? "tls_client" : "tls", total_len, t, ret);
 		/* from libuv documentation -
 		   uv_try_write will return either:
 		     > 0: number of bytes written (can be less than the supplied buffer size).
@@ -221,11 +223,162 @@ static ssize_t kres_gnutls_vec_push(gnutls_transport_ptr_t h, const giovec_t * i
 	}
 
 	DEBUG_MSG("[%s] queued %zu <%p> = %d\n",
-	    t->client_side ? "tls_client" : "tls", total_len, h, ret);
+	    t->client_side ? "tls_client" : "tls", total_len, t, ret);
 
 	return ret;
 }
 
+static ssize_t kres_gnutls_vec_push(gnutls_transport_ptr_t h, const giovec_t * iov, int iovcnt)
+{
+	struct tls_common_ctx *t = (struct tls_common_ctx *)h;
+
+	if (t == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+
+	if (t->ktls_tx) {
+		/* The kernel owns the write sequence now, so any record framed
+		 * by gnutls (alert, KeyUpdate, rehandshake) would get corrupted. */
+		errno = EPIPE;
+		return -1;
+	}
+
+	return tls_stream_writev(t, iov, iovcnt);
+}
+
+#if ENABLE_KTLS
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+/** Copy gnutls write state into the salt/iv/key/rec_seq layout of linux/tls.h */
+static bool ktls_gcm_fill(uint8_t salt[4], uint8_t iv_out[8], uint8_t *key_out, size_t key_len,
+			  uint8_t rec_seq[8], bool tls13, const gnutls_datum_t *iv,
+			  const gnutls_datum_t *key, const unsigned char seq[8])
+{
+	if (key->size != key_len || iv->size != (tls13 ? 12 : 4)) {
+		return false;
+	}
+	memcpy(salt, iv->data, 4);
+	/* TLS 1.3 derives the whole nonce, TLS 1.2 in gnutls sends
+	 * the sequence number as the explicit part. */
+	memcpy(iv_out, tls13 ? iv->data + 4 : seq, 8);
+	memcpy(key_out, key->data, key_len);
+	memcpy(rec_seq, seq, 8);
+	return true;
+}
+
+/** Hand encryption of outgoing records to the kernel; return true on success.
+ *
+ * Only AES-GCM with TLS 1.2 or 1.3 is attempted, otherwise gnutls keeps the work.
+ * Receiving stays in gnutls, as libuv reads can't handle the non-data records
+ * (e.g. TLS 1.3 KeyUpdate) that TLS_RX would surface as errors. */
+static bool tls_ktls_tx_enable(struct tls_common_ctx *ctx)
+{
+	uv_stream_t *handle = (uv_stream_t *)session_get_handle(ctx->session);
+	/* Records framed by gnutls must all reach the socket before we switch. */
+	if (!stream_queue_is_empty(ctx) || handle->write_queue_size > 0
+	    || gnutls_record_check_corked(ctx->tls_session) > 0) {
+		return false;
+	}
+
+	bool tls13;
+	switch (gnutls_protocol_get_version(ctx->tls_session)) {
+	case GNUTLS_TLS1_2:
+		tls13 = false;
+		break;
+#if GNUTLS_VERSION_NUMBER >= 0x030603 && defined(TLS_1_3_VERSION)
+	case GNUTLS_TLS1_3:
+		tls13 = true;
+		break;
+#endif
+	default:
+		return false;
+	}
+
+	gnutls_datum_t iv, key;
+	unsigned char seq[8];
+	if (gnutls_record_get_state(ctx->tls_session, 0, NULL, &iv, &key, seq) != GNUTLS_E_SUCCESS) {
+		return false;
+	}
+
+	union {
+		struct tls12_crypto_info_aes_gcm_128 gcm128;
+#ifdef TLS_CIPHER_AES_GCM_256
+		struct tls12_crypto_info_aes_gcm_256 gcm256;
+#endif
+	} ci;
+	memset(&ci, 0, sizeof(ci));
+	socklen_t ci_len = 0;
+	bool ok = false;
+	switch (gnutls_cipher_get(ctx->tls_session)) {
+	case GNUTLS_CIPHER_AES_128_GCM:
+		ci.gcm128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+		ok = ktls_gcm_fill(ci.gcm128.salt, ci.gcm128.iv, ci.gcm128.key,
+				   sizeof(ci.gcm128.key), ci.gcm128.rec_seq,
+				   tls13, &iv, &key, seq);
+		ci_len = sizeof(ci.gcm128);
+		break;
+#ifdef TLS_CIPHER_AES_GCM_256
+	case GNUTLS_CIPHER_AES_256_GCM:
+		ci.gcm256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+		ok = ktls_gcm_fill(ci.gcm256.salt, ci.gcm256.iv, ci.gcm256.key,
+				   sizeof(ci.gcm256.key), ci.gcm256.rec_seq,
+				   tls13, &iv, &key, seq);
+		ci_len = sizeof(ci.gcm256);
+		break;
+#endif
+	default:
+		break;
+	}
+#if GNUTLS_VERSION_NUMBER >= 0x030603 && defined(TLS_1_3_VERSION)
+	ci.gcm128.info.version = tls13 ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+#else
+	ci.gcm128.info.version = TLS_1_2_VERSION;
+#endif
+
+	/* A socket with the ULP attached but without TLS_TX still sends plain data,
+	 * so failing at the second step leaves the connection usable by gnutls. */
+	int fd = -1;
+	ok = ok && uv_fileno((uv_handle_t *)handle, &fd) == 0
+		&& setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0
+		&& setsockopt(fd, SOL_TLS, TLS_TX, &ci, ci_len) == 0;
+	gnutls_memset(&ci, 0, sizeof(ci));
+	return ok;
+}
+
+/** Send close_notify as an alert record through the kernel, if nothing is queued before it. */
+static void tls_ktls_close_notify(struct tls_common_ctx *ctx)
+{
+	uv_handle_t *handle = session_get_handle(ctx->session);
+	int fd = -1;
+	if (!stream_queue_is_empty(ctx) || ((uv_stream_t *)handle)->write_queue_size > 0
+	    || uv_fileno(handle, &fd) != 0) {
+		return;
+	}
+	uint8_t alert[2] = { GNUTLS_AL_WARNING, GNUTLS_A_CLOSE_NOTIFY };
+	struct iovec iov = { .iov_base = alert, .iov_len = sizeof(alert) };
+	char cbuf[CMSG_SPACE(sizeof(uint8_t))];
+	memset(cbuf, 0, sizeof(cbuf));
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+	*CMSG_DATA(cmsg) = 21; /* content type: alert */
+	(void)sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+#endif /* ENABLE_KTLS */
+
 /** Perform TLS handshake and handle error codes according to the documentation.
   * See See https://gnutls.org/manual/html_node/TLS-handshake.html#TLS-handshake
   * The function returns kr_ok() or success or non fatal error, kr_error(EAGAIN) on blocking, or kr_error(EIO) on fatal error.
@@ -241,6 +394,15 @@ static int tls_handshake(struct tls_common_ctx *ctx, tls_handshake_cb handshake_
 		struct sockaddr *peer = session_get_peer(session);
 		kr_log_verbose("[%s] TLS handshake with %s has completed\n",
 			       logstring,  kr_straddr(peer));
+#if ENABLE_KTLS
+		if (!ctx->client_side && !ctx->ktls_tx && ctx->worker->engine->net.tls_ktls) {
+			ctx->ktls_tx = tls_ktls_tx_enable(ctx);
+			if (ctx->ktls_tx) {
+				kr_log_verbose("[%s] kernel TLS enabled for %s\n",
+					       logstring, kr_straddr(peer));
+			}
+		}
+#endif
 		if (handshake_cb) {
 			if (handshake_cb(session, 0) != kr_ok()) {
 				return kr_error(EIO);
@@ -365,6 +527,12 @@ void tls_close(struct tls_common_ctx *ctx)
 			       ctx->client_side ? "tls_client" : "tls",
 			       kr_straddr(peer));
 		ctx->handshake_state = TLS_HS_CLOSING;
+#if ENABLE_KTLS
+		if (ctx->ktls_tx) {
+			tls_ktls_close_notify(ctx);
+			return;
+		}
+#endif
 		gnutls_bye(ctx->tls_session, GNUTLS_SHUT_RDWR);
 	}
 }
@@ -401,6 +569,22 @@ int tls_write(uv_write_t *req, uv_handle_t *handle, knot_pkt_t *pkt, uv_write_cb
 	const char *logstring = tls_ctx->client_side ? client_logstring : server_logstring;
 	gnutls_session_t tls_session = tls_ctx->tls_session;
 
+	if (tls_ctx->ktls_tx) {
+		/* The kernel does the framing; one writev makes one record. */
+		giovec_t iov[2] = {
+			{ .iov_base = (void *)&pkt_size, .iov_len = sizeof(pkt_size) },
+			{ .iov_base = pkt->wire, .iov_len = pkt->size },
+		};
+		if (tls_stream_writev(tls_ctx, iov, 2) < 0) {
+			kr_log_error("[%s] kTLS write failed: %s\n",
+				     logstring, strerror(errno));
+			return kr_error(EIO);
+		}
+		req->handle = (uv_stream_t *)handle;
+		cb(req, 0);
+		return kr_ok();
+	}
+
 	gnutls_record_cork(tls_session);
 	ssize_t count = 0;
 	if ((count = gnutls_record_send(tls_session, &pkt_size, sizeof(pkt_size)) < 0) ||
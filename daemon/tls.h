@@ -123,6 +123,7 @@ struct tls_common_ctx {
 	tls_handshake_cb handshake_cb;
 	struct worker_ctx *worker;
 	size_t write_queue_size;
+	bool ktls_tx; /**< The kernel encrypts our records; gnutls must not write. */
 };
 
 struct tls_ctx_t {
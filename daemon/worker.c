@@ -27,6 +27,7 @@
 #include "daemon/session.h"
 #include "daemon/tls.h"
 #include "daemon/udp_queue.h"
+#include "daemon/xdp_eth.h"
 #include "daemon/zimport.h"
 #include "lib/layer.h"
 #include "lib/utils.h"
@@ -46,6 +47,27 @@
 #ifndef MAX_PIPELINED
 #define MAX_PIPELINED 100
 #endif
+#ifndef XDP_ANSWER_MAX
+#define XDP_ANSWER_MAX 1232 /**< Max. answer size over AF_XDP; well below the UMEM frame size */
+#endif
+#ifndef UDP_POOL_SIZE
+#define UDP_POOL_SIZE 0 /**< Default max. number of idle outgoing UDP sockets; see net.udp_pool() */
+#endif
+#ifndef UDP_POOL_MAX_USES
+#define UDP_POOL_MAX_USES 16 /**< Default nr. of queries after which a UDP socket is retired */
+#endif
+#ifndef UDP_POOL_IDLE_MAX
+#define UDP_POOL_IDLE_MAX 2000 /**< Idle UDP sockets are closed after this many ms */
+#endif
+#ifndef BG_LOOKUPS_MAX
+#define BG_LOOKUPS_MAX 16 /**< Default max. nr. of background lookups queued or running */
+#endif
+#ifndef INFRA_FLUSH_INTERVAL
+#define INFRA_FLUSH_INTERVAL 100 /**< Shared NS records are written at most once per this many ms */
+#endif
+#ifndef RACE_BURST
+#define RACE_BURST 100 /**< Max. nr. of racing queries the unused budget is saved up for */
+#endif
 
 #define VERBOSE_MSG(qry, ...) QRVERBOSE(qry, "wrkr", __VA_ARGS__)
 
@@ -57,12 +79,18 @@ struct request_ctx
 	struct {
 		/** Requestor's address; separate because of UDP session "sharing". */
 		union inaddr addr;
+		/** Our address the request came to; only set for AF_XDP. */
+		union inaddr dst_addr;
 		/** NULL if the request didn't come over network. */
 		struct session *session;
+		/** MAC addresses for AF_XDP; ours [0] and theirs [1]. */
+		uint8_t eth_addrs[2][6];
 	} source;
 
 	struct worker_ctx *worker;
 	struct qr_task *task;
+	/** Set if started by bg_lookups_cb(); removed from ns_bg.inflight when freed. */
+	struct bg_lookup ns_bg;
 };
 
 /** Query resolution task. */
@@ -71,17 +99,22 @@ struct qr_task
 	struct request_ctx *ctx;
 	knot_pkt_t *pktbuf;
 	qr_tasklist_t waiting;
+	qr_tasklist_t coalesced; /**< client requests waiting for this one, see coalesce_lead() */
 	struct session *pending[MAX_PENDING];
 	uint16_t pending_count;
 	uint16_t addrlist_count;
 	uint16_t addrlist_turn;
 	uint16_t timeouts;
 	uint16_t iter_count;
+	uint16_t race_hedge; /**< racers to send when the retransmit timer fires */
+	uint16_t race_rest;  /**< ms from then until the regular retransmit */
 	struct sockaddr *addrlist;
 	uint32_t refs;
 	bool finished : 1;
 	bool leading  : 1;
 	uint64_t creation_time;
+	char *coalesce_key; /**< set if leading identical client requests */
+	int coalesce_klen;
 };
 
 
@@ -106,6 +139,8 @@ static void qr_task_free(struct qr_task *task);
 static int qr_task_step(struct qr_task *task,
 			const struct sockaddr *packet_source,
 			knot_pkt_t *packet);
+static int qr_task_produce(struct qr_task *task, int state,
+			   const struct sockaddr *packet_source, knot_pkt_t *packet);
 static int qr_task_send(struct qr_task *task, struct session *session,
 			const struct sockaddr *addr, knot_pkt_t *pkt);
 static int qr_task_finalize(struct qr_task *task, int state);
@@ -122,6 +157,35 @@ static void on_tcp_connect_timeout(uv_timer_t *timer);
 struct worker_ctx the_worker_value; /**< Static allocation is suitable for the singleton. */
 struct worker_ctx *the_worker = NULL;
 
+static void infra_flush_cb(uv_timer_t *timer)
+{
+	struct worker_ctx *worker = timer->data;
+	(void)kr_nsrep_infra_flush(&worker->engine->resolver);
+}
+
+/** Schedule writing of the NS records shared through the cache, if any changed.
+ * Batching them keeps the write transactions out of each resolution step. */
+static void infra_flush_schedule(struct worker_ctx *worker)
+{
+	const trie_t *dirty = worker->engine->resolver.cache_infra_dirty;
+	if (dirty && trie_weight(dirty) > 0
+	    && !uv_is_active((uv_handle_t *)&worker->infra_flush)) {
+		uv_timer_start(&worker->infra_flush, infra_flush_cb, INFRA_FLUSH_INTERVAL, 0);
+	}
+}
+
+/** Mark an upstream address as unusable, e.g. on failed TCP connection. */
+static void upstream_penalize(struct worker_ctx *worker, const struct sockaddr *peer,
+			      const struct kr_qflags *flags)
+{
+	unsigned score = flags->FORWARD || flags->STUB ? KR_NS_FWD_DEAD : KR_NS_DEAD;
+	/* Without a particular NS, only the context is needed to share the change. */
+	struct kr_nsrep ns = { .ctx = &worker->engine->resolver };
+	kr_nsrep_update_rtt(&ns, peer, score, worker->engine->resolver.cache_rtt,
+			    KR_NS_LOST);
+	infra_flush_schedule(worker);
+}
+
 /*! @internal Create a UDP/TCP handle for an outgoing AF_INET* connection.
  *  socktype is SOCK_* */
 static uv_handle_t *ioreq_spawn(struct worker_ctx *worker,
@@ -182,6 +246,113 @@ static uv_handle_t *ioreq_spawn(struct worker_ctx *worker,
 	return handle;
 }
 
+/** @internal Close pooled sockets idle for too long; the pool is ordered by age. */
+static void udp_pool_expire(struct udp_pool *pool, uint64_t now)
+{
+	size_t i = 0;
+	while (i < pool->idle.len && now - pool->idle.at[i].idle_since > UDP_POOL_IDLE_MAX) {
+		session_close(pool->idle.at[i].session);
+		++i;
+	}
+	if (i > 0) {
+		pool->idle.len -= i;
+		memmove(pool->idle.at, pool->idle.at + i,
+			pool->idle.len * sizeof(pool->idle.at[0]));
+	}
+}
+
+static void udp_pool_expire_cb(uv_timer_t *timer);
+
+/** @internal Wake up when the oldest idle socket is due to be closed,
+ * so that sockets don't stay open on an instance without further queries. */
+static void udp_pool_schedule(struct udp_pool *pool, uint64_t now)
+{
+	if (pool->idle.len == 0 || uv_is_active((uv_handle_t *)&pool->timer)) {
+		return;
+	}
+	const uint64_t due = pool->idle.at[0].idle_since + UDP_POOL_IDLE_MAX + 1;
+	uv_timer_start(&pool->timer, udp_pool_expire_cb, due > now ? due - now : 0, 0);
+}
+
+static void udp_pool_expire_cb(uv_timer_t *timer)
+{
+	struct udp_pool *pool = timer->data;
+	const uint64_t now = kr_now();
+	udp_pool_expire(pool, now);
+	udp_pool_schedule(pool, now);
+}
+
+/*! @internal Take an idle UDP socket that was used with the same upstream.
+ * Sockets are never shared among different upstreams, so that a port learned
+ * by one server (e.g. controlled by an attacker) can't help to spoof answers
+ * from another one.  Among eligible sockets pick one at random. */
+static uv_handle_t *udp_pool_take(struct worker_ctx *worker, const struct sockaddr *peer)
+{
+	struct udp_pool *pool = &worker->udp_pool;
+	udp_pool_expire(pool, kr_now());
+	const size_t len = pool->idle.len;
+	if (len == 0) {
+		return NULL;
+	}
+	const size_t start = kr_rand_bytes(sizeof(uint32_t)) % len;
+	for (size_t k = 0; k < len; ++k) {
+		const size_t i = (start + k) % len;
+		if (kr_sockaddr_cmp(&pool->idle.at[i].peer.ip, peer) != 0) {
+			continue;
+		}
+		struct session *session = pool->idle.at[i].session;
+		memmove(pool->idle.at + i, pool->idle.at + i + 1,
+			(len - i - 1) * sizeof(pool->idle.at[0]));
+		pool->idle.len -= 1;
+		return session_get_handle(session);
+	}
+	return NULL;
+}
+
+int worker_udp_pool_put(struct session *session)
+{
+	struct worker_ctx *worker = the_worker;
+	assert(worker);
+	struct udp_pool *pool = &worker->udp_pool;
+	if (pool->size == 0) {
+		return kr_error(ENOSPC);
+	}
+	const struct sockaddr *peer = session_get_peer(session);
+	if (peer->sa_family != AF_INET && peer->sa_family != AF_INET6) {
+		return kr_error(EINVAL);
+	}
+	struct udp_pool_entry entry = { .session = session, .idle_since = kr_now() };
+	memcpy(&entry.peer, peer, kr_sockaddr_len(peer));
+
+	int uses = session_recycle(session);
+	if (uses < 0 || (unsigned)uses >= pool->max_uses) {
+		return kr_error(ENOSPC);
+	}
+	udp_pool_expire(pool, entry.idle_since);
+	if (pool->idle.len >= pool->size) {
+		/* Replace the oldest one. */
+		session_close(pool->idle.at[0].session);
+		pool->idle.len -= 1;
+		memmove(pool->idle.at, pool->idle.at + 1,
+			pool->idle.len * sizeof(pool->idle.at[0]));
+	}
+	if (array_push(pool->idle, entry) < 0) {
+		return kr_error(ENOMEM);
+	}
+	udp_pool_schedule(pool, entry.idle_since);
+	return kr_ok();
+}
+
+void worker_udp_pool_flush(struct worker_ctx *worker)
+{
+	struct udp_pool *pool = &worker->udp_pool;
+	for (size_t i = 0; i < pool->idle.len; ++i) {
+		session_close(pool->idle.at[i].session);
+	}
+	pool->idle.len = 0;
+	uv_timer_stop(&pool->timer);
+}
+
 static void ioreq_kill_pending(struct qr_task *task)
 {
 	for (uint16_t i = 0; i < task->pending_count; ++i) {
@@ -260,6 +431,9 @@ static int subreq_key(char *dst, knot_pkt_t *pkt)
 static struct request_ctx *request_create(struct worker_ctx *worker,
 					  struct session *session,
 					  const struct sockaddr *peer,
+					  const struct sockaddr *dst_addr,
+					  const uint8_t *eth_from,
+					  const uint8_t *eth_to,
 					  uint32_t uid)
 {
 	knot_mm_t pool = {
@@ -295,6 +469,13 @@ static struct request_ctx *request_create(struct worker_ctx *worker,
 		/* We need to store a copy of peer address. */
 		memcpy(&ctx->source.addr.ip, peer, kr_sockaddr_len(peer));
 		req->qsource.addr = &ctx->source.addr.ip;
+		if (dst_addr) { /* AF_XDP listens on a whole interface */
+			memcpy(&ctx->source.dst_addr.ip, dst_addr, kr_sockaddr_len(dst_addr));
+			req->qsource.dst_addr = &ctx->source.dst_addr.ip;
+		}
+		if (eth_from && eth_to) {
+			xdp_eth_addrs_set(ctx->source.eth_addrs, eth_from, eth_to);
+		}
 	}
 
 	worker->stats.rconcurrent += 1;
@@ -317,6 +498,10 @@ static int request_start(struct request_ctx *ctx, knot_pkt_t *query)
 		answer_max = MAX(knot_edns_get_payload(query->opt_rr),
 				 KNOT_WIRE_MIN_PKTSIZE);
 	}
+	if (s && session_get_handle(s)->type == UV_POLL) {
+		/* AF_XDP: the answer has to fit into a single UMEM frame. */
+		answer_max = MIN(answer_max, XDP_ANSWER_MAX);
+	}
 	req->qsource.size = query->size;
 	if (knot_pkt_has_tsig(query)) {
 		req->qsource.size += query->tsig_wire.len;
@@ -367,10 +552,15 @@ static void request_free(struct request_ctx *ctx)
 		lua_pop(L, 1);
 		ctx->req.vars_ref = LUA_NOREF;
 	}
+	/* The lookup lives in ctx, i.e. in the mempool released below. */
+	if (ctx->ns_bg.name) {
+		bg_lookup_done(worker, &ctx->ns_bg);
+	}
 	/* Return mempool to ring or free it if it's full */
 	pool_release(worker, ctx->req.pool.ctx);
 	/* @note The 'task' is invalidated from now on. */
 	worker->stats.rconcurrent -= 1;
+	infra_flush_schedule(worker);
 }
 
 static struct qr_task *qr_task_create(struct request_ctx *ctx)
@@ -402,6 +592,7 @@ static struct qr_task *qr_task_create(struct request_ctx *ctx)
 	task->ctx = ctx;
 	task->pktbuf = pktbuf;
 	array_init(task->waiting);
+	array_init(task->coalesced);
 	task->refs = 0;
 	assert(ctx->task == NULL);
 	ctx->task = task;
@@ -529,6 +720,52 @@ static void on_write(uv_write_t *req, int status)
 	free(req);
 }
 
+/** Like on_write(), but the request is not owned; see qr_task_send(). */
+static void on_tls_write(uv_write_t *req, int status)
+{
+	struct qr_task *task = req->data;
+	uv_handle_t *h = (uv_handle_t *)req->handle;
+	qr_task_on_send(task, h, status);
+	qr_task_unref(task);
+}
+
+/** @internal Update statistics about an outgoing message. */
+static void qr_task_count_send(struct worker_ctx *worker, struct session *session,
+			       const struct sockaddr *addr)
+{
+	if (!session_flags(session)->outgoing || !addr) {
+		return;
+	}
+	if (session_flags(session)->has_tls)
+		worker->stats.tls += 1;
+	else if (session_get_handle(session)->type == UV_UDP)
+		worker->stats.udp += 1;
+	else
+		worker->stats.tcp += 1;
+
+	if (addr->sa_family == AF_INET6)
+		worker->stats.ipv6 += 1;
+	else if (addr->sa_family == AF_INET)
+		worker->stats.ipv4 += 1;
+}
+
+/** @internal Bookkeeping after a message was successfully handed over for sending. */
+static void qr_task_sent(struct qr_task *task, struct session *session,
+			 const struct sockaddr *addr)
+{
+	struct worker_ctx *worker = task->ctx->worker;
+	session_touch(session);
+	if (session_flags(session)->outgoing) {
+		session_tasklist_add(session, task);
+	}
+	if (worker->too_many_open &&
+	    worker->stats.rconcurrent <
+		worker->rconcurrent_highwatermark - 10) {
+		worker->too_many_open = false;
+	}
+	qr_task_count_send(worker, session, addr);
+}
+
 static int qr_task_send(struct qr_task *task, struct session *session,
 			const struct sockaddr *addr, knot_pkt_t *pkt)
 {
@@ -567,28 +804,41 @@ static int qr_task_send(struct qr_task *task, struct session *session,
 		worker_task_pkt_set_msgid(task, msg_id);
 	}
 
-	uv_handle_t *ioreq = malloc(is_stream ? sizeof(uv_write_t) : sizeof(uv_udp_send_t));
-	if (!ioreq) {
-		return qr_task_on_send(task, handle, kr_error(ENOMEM));
-	}
-
-	/* Pending ioreq on current task */
-	qr_task_ref(task);
-
 	struct worker_ctx *worker = ctx->worker;
-	/* Send using given protocol */
 	assert(!session_flags(session)->closing);
-	if (session_flags(session)->has_tls) {
-		uv_write_t *write_req = (uv_write_t *)ioreq;
-		write_req->data = task;
-		ret = tls_write(write_req, handle, pkt, &on_write);
-	} else if (handle->type == UV_UDP) {
-		uv_udp_send_t *send_req = (uv_udp_send_t *)ioreq;
+	if (!is_stream && session_flags(session)->outgoing) {
+		/* Each upstream query has its own socket, so there's nothing
+		 * to batch; just avoid the request allocation and the deferred
+		 * completion if the datagram can be sent right away. */
 		uv_buf_t buf = { (char *)pkt->wire, pkt->size };
-		send_req->data = task;
-		ret = uv_udp_send(send_req, (uv_udp_t *)handle, &buf, 1, addr, &on_send);
-	} else if (handle->type == UV_TCP) {
-		uv_write_t *write_req = (uv_write_t *)ioreq;
+		if (uv_udp_try_send((uv_udp_t *)handle, &buf, 1, addr) >= 0) {
+			qr_task_sent(task, session, addr);
+			return qr_task_on_send(task, handle, kr_ok());
+		}
+		/* Otherwise retry the usual way, e.g. the send queue is non-empty. */
+	}
+
+	if (session_flags(session)->has_tls) {
+		/* tls_write() hands the data over to gnutls and calls the callback
+		 * before returning, so the request doesn't need to outlive this call. */
+		uv_write_t write_req = { .data = task };
+		qr_task_ref(task);
+		ret = tls_write(&write_req, handle, pkt, &on_tls_write);
+		if (ret == 0) {
+			qr_task_sent(task, session, addr);
+		} else {
+			qr_task_unref(task);
+			qr_task_count_send(worker, session, addr);
+		}
+		return ret;
+	}
+
+	/* TCP: write the message right away if the socket can take it whole,
+	 * otherwise queue just the rest. */
+	uv_buf_t tcp_buf[3];
+	uv_buf_t *tcp_buf_left = tcp_buf;
+	unsigned tcp_buf_cnt = 0;
+	if (is_stream) {
 		/* We need to write message length in native byte order,
 		 * but we don't have a convenient place to store those bytes.
 		 * The problem is that all memory referenced from buf[] MUST retain
@@ -604,27 +854,54 @@ static int qr_task_send(struct qr_task *task, struct session *session,
 			lsbi  = 0;
 			slsbi = 1;
 		}
-		uv_buf_t buf[3] = {
-			{ (char *)&pkt->size + slsbi, 1 },
-			{ (char *)&pkt->size + lsbi,  1 },
-			{ (char *)pkt->wire, pkt->size },
-		};
+		tcp_buf[0] = uv_buf_init((char *)&pkt->size + slsbi, 1);
+		tcp_buf[1] = uv_buf_init((char *)&pkt->size + lsbi,  1);
+		tcp_buf[2] = uv_buf_init((char *)pkt->wire, pkt->size);
+		tcp_buf_cnt = 3;
+
+		int written = uv_try_write((uv_stream_t *)handle, tcp_buf, tcp_buf_cnt);
+		if (written == (int)(2 + pkt->size)) {
+			qr_task_sent(task, session, addr);
+			return qr_task_on_send(task, handle, kr_ok());
+		}
+		/* Partial write, or UV_EAGAIN and such (left to uv_write()). */
+		while (written > 0) {
+			size_t skip = MIN((size_t)written, tcp_buf_left->len);
+			tcp_buf_left->base += skip;
+			tcp_buf_left->len -= skip;
+			written -= skip;
+			if (tcp_buf_left->len == 0) {
+				++tcp_buf_left;
+				--tcp_buf_cnt;
+			}
+		}
+	}
+
+	uv_handle_t *ioreq = malloc(is_stream ? sizeof(uv_write_t) : sizeof(uv_udp_send_t));
+	if (!ioreq) {
+		return qr_task_on_send(task, handle, kr_error(ENOMEM));
+	}
+
+	/* Pending ioreq on current task */
+	qr_task_ref(task);
+
+	/* Send using given protocol */
+	if (handle->type == UV_UDP) {
+		uv_udp_send_t *send_req = (uv_udp_send_t *)ioreq;
+		uv_buf_t buf = { (char *)pkt->wire, pkt->size };
+		send_req->data = task;
+		ret = uv_udp_send(send_req, (uv_udp_t *)handle, &buf, 1, addr, &on_send);
+	} else if (handle->type == UV_TCP) {
+		uv_write_t *write_req = (uv_write_t *)ioreq;
 		write_req->data = task;
-		ret = uv_write(write_req, (uv_stream_t *)handle, buf, 3, &on_write);
+		ret = uv_write(write_req, (uv_stream_t *)handle, tcp_buf_left, tcp_buf_cnt,
+				&on_write);
 	} else {
 		assert(false);
 	}
 
 	if (ret == 0) {
-		session_touch(session);
-		if (session_flags(session)->outgoing) {
-			session_tasklist_add(session, task);
-		}
-		if (worker->too_many_open &&
-		    worker->stats.rconcurrent <
-			worker->rconcurrent_highwatermark - 10) {
-			worker->too_many_open = false;
-		}
+		qr_task_sent(task, session, addr);
 	} else {
 		free(ioreq);
 		qr_task_unref(task);
@@ -633,21 +910,7 @@ static int qr_task_send(struct qr_task *task, struct session *session,
 			worker->rconcurrent_highwatermark = worker->stats.rconcurrent;
 			ret = kr_error(UV_EMFILE);
 		}
-	}
-
-	/* Update statistics */
-	if (session_flags(session)->outgoing && addr) {
-		if (session_flags(session)->has_tls)
-			worker->stats.tls += 1;
-		else if (handle->type == UV_UDP)
-			worker->stats.udp += 1;
-		else
-			worker->stats.tcp += 1;
-
-		if (addr->sa_family == AF_INET6)
-			worker->stats.ipv6 += 1;
-		else if (addr->sa_family == AF_INET)
-			worker->stats.ipv4 += 1;
+		qr_task_count_send(worker, session, addr);
 	}
 	return ret;
 }
@@ -674,11 +937,7 @@ static int session_tls_hs_cb(struct session *session, int status)
 	if (status) {
 		struct qr_task *task = session_waitinglist_get(session);
 		if (task) {
-			struct kr_qflags *options = &task->ctx->req.options;
-			unsigned score = options->FORWARD || options->STUB ? KR_NS_FWD_DEAD : KR_NS_DEAD;
-			kr_nsrep_update_rtt(NULL, peer, score,
-					    worker->engine->resolver.cache_rtt,
-					    KR_NS_UPDATE_NORESET);
+			upstream_penalize(worker, peer, &task->ctx->req.options);
 		}
 #ifndef NDEBUG
 		else {
@@ -856,11 +1115,7 @@ static void on_connect(uv_connect_t *req, int status)
 			/* Penalize upstream.
 			 * In case of UV_ETIMEDOUT upstream has been
 			 * already penalized in on_tcp_connect_timeout() */
-			struct kr_qflags *options = &task->ctx->req.options;
-			unsigned score = options->FORWARD || options->STUB ? KR_NS_FWD_DEAD : KR_NS_DEAD;
-			kr_nsrep_update_rtt(NULL, peer, score,
-					    worker->engine->resolver.cache_rtt,
-					    KR_NS_UPDATE_NORESET);
+			upstream_penalize(worker, peer, &task->ctx->req.options);
 		}
 		assert(session_tasklist_is_empty(session));
 		session_waitinglist_retry(session, false);
@@ -942,10 +1197,7 @@ static void on_tcp_connect_timeout(uv_timer_t *timer)
 			    peer_str ? peer_str : "");
 	}
 
-	unsigned score = qry->flags.FORWARD || qry->flags.STUB ? KR_NS_FWD_DEAD : KR_NS_DEAD;
-	kr_nsrep_update_rtt(NULL, peer, score,
-			    worker->engine->resolver.cache_rtt,
-			    KR_NS_UPDATE_NORESET);
+	upstream_penalize(worker, peer, &qry->flags);
 
 	worker->stats.timeout += session_waitinglist_get_len(session);
 	session_waitinglist_retry(session, true);
@@ -985,7 +1237,7 @@ static void on_udp_timeout(uv_timer_t *timer)
 			unsigned score = qry->flags.FORWARD || qry->flags.STUB ? KR_NS_FWD_DEAD : KR_NS_DEAD;
 			kr_nsrep_update_rtt(&qry->ns, choice, score,
 					    worker->engine->resolver.cache_rtt,
-					    KR_NS_UPDATE_NORESET);
+					    KR_NS_LOST);
 		}
 	}
 	task->timeouts += 1;
@@ -1009,11 +1261,14 @@ static uv_handle_t *retransmit(struct qr_task *task)
 		if (kr_resolve_checkout(&ctx->req, NULL, (struct sockaddr *)choice, SOCK_DGRAM, task->pktbuf) != 0) {
 			return ret;
 		}
-		ret = ioreq_spawn(ctx->worker, SOCK_DGRAM, choice->sin6_family, false);
+		struct sockaddr *addr = (struct sockaddr *)choice;
+		ret = udp_pool_take(ctx->worker, addr);
+		if (!ret) {
+			ret = ioreq_spawn(ctx->worker, SOCK_DGRAM, choice->sin6_family, false);
+		}
 		if (!ret) {
 			return ret;
 		}
-		struct sockaddr *addr = (struct sockaddr *)choice;
 		struct session *session = ret->data;
 		struct sockaddr *peer = session_get_peer(session);
 		assert (peer->sa_family == AF_UNSPEC && session_flags(session)->outgoing);
@@ -1033,6 +1288,48 @@ static uv_handle_t *retransmit(struct qr_task *task)
 	return ret;
 }
 
+/** Return the number of addresses to race with the first one and earn the budget for them. */
+static unsigned race_count(struct qr_task *task)
+{
+	struct worker_ctx *worker = task->ctx->worker;
+	if (worker->race.count <= 1) {
+		return 0;
+	}
+	worker->race.credit = MIN(worker->race.credit + worker->race.budget, RACE_BURST * 100);
+	return MIN(worker->race.count, task->addrlist_count) - 1;
+}
+
+/** Return the hedging delay of the racers in ms, i.e. how much slower the last one
+ * is expected to be than the first address, or 0 if either of them has no RTT yet. */
+static unsigned race_delay(struct qr_task *task, unsigned racers)
+{
+	kr_nsrep_rtt_lru_t *rtt = task->ctx->worker->engine->resolver.cache_rtt;
+	const struct sockaddr_in6 *addrlist = (const struct sockaddr_in6 *)task->addrlist;
+	const struct sockaddr *first = (const struct sockaddr *)&addrlist[0];
+	const struct sockaddr *last = (const struct sockaddr *)&addrlist[racers];
+	const kr_nsrep_rtt_lru_entry_t *first_rtt =
+		lru_get_try(rtt, kr_inaddr(first), kr_inaddr_len(first));
+	const kr_nsrep_rtt_lru_entry_t *last_rtt =
+		lru_get_try(rtt, kr_inaddr(last), kr_inaddr_len(last));
+	if (!first_rtt || !last_rtt || last_rtt->score <= first_rtt->score) {
+		return 0;
+	}
+	return last_rtt->score - first_rtt->score;
+}
+
+/** Send the query to the next addresses in the list, as far as the budget allows. */
+static void race_send(struct qr_task *task, unsigned count)
+{
+	struct worker_ctx *worker = task->ctx->worker;
+	for (; count > 0 && worker->race.credit >= 100; --count) {
+		if (retransmit(task) == NULL) {
+			break;
+		}
+		worker->race.credit -= 100;
+		worker->stats.race += 1;
+	}
+}
+
 static void on_retransmit(uv_timer_t *req)
 {
 	struct session *session = req->data;
@@ -1040,7 +1337,12 @@ static void on_retransmit(uv_timer_t *req)
 
 	uv_timer_stop(req);
 	struct qr_task *task = session_tasklist_get_first(session);
-	if (retransmit(task) == NULL) {
+	if (task->race_hedge > 0) {
+		/* The hedging delay is over; the regular retransmit follows later. */
+		race_send(task, task->race_hedge);
+		task->race_hedge = 0;
+		uv_timer_start(req, on_retransmit, task->race_rest, 0);
+	} else if (retransmit(task) == NULL) {
 		/* Not possible to spawn request, start timeout timer with remaining deadline. */
 		struct kr_qflags *options = &task->ctx->req.options;
 		uint64_t timeout = options->FORWARD || options->STUB ? KR_NS_FWD_TIMEOUT / 2 :
@@ -1125,6 +1427,109 @@ static bool subreq_enqueue(struct qr_task *task)
 	return true;
 }
 
+/** Create a key for coalescing a client request: the initial question,
+ * DO and CD bits, and the state that policy and view rules left in the request.
+ * @param key Destination buffer for key size, MUST be COALESCE_KEY_LEN or larger.
+ * @return key length, or an error if the request isn't suitable.
+ */
+#define COALESCE_KEY_LEN (KR_RRKEY_LEN + 1 + 2 * sizeof(struct kr_qflags) \
+			  + KR_NSREP_MAXADDR * sizeof(union inaddr))
+static int coalesce_key(char *dst, const struct kr_request *req)
+{
+	if (req->rplan.pending.len != 1 || !req->qsource.packet) {
+		return kr_error(EINVAL);
+	}
+	const struct kr_query *qry = array_tail(req->rplan.pending);
+	int len = kr_rrkey(dst, qry->sclass, qry->sname, qry->stype, qry->stype);
+	if (len <= 0) {
+		return kr_error(EINVAL);
+	}
+	const knot_pkt_t *query = req->qsource.packet;
+	dst[len++] = (knot_pkt_has_dnssec(query) ? 1 : 0)
+		   | (knot_wire_get_cd(query->wire) ? 2 : 0);
+	memcpy(dst + len, &req->options, sizeof(req->options));
+	len += sizeof(req->options);
+	memcpy(dst + len, &qry->flags, sizeof(qry->flags));
+	len += sizeof(qry->flags);
+	/* FORWARD and STUB targets are set on the query by policy rules. */
+	if (qry->flags.FORWARD || qry->flags.STUB) {
+		memcpy(dst + len, qry->ns.addr, KR_NSREP_MAXADDR * sizeof(union inaddr));
+		len += KR_NSREP_MAXADDR * sizeof(union inaddr);
+	}
+	return len;
+}
+
+/** Make the task wait for an identical client request in progress.
+ * @return true if enqueued; it will be resumed by coalesce_finalize(). */
+static bool coalesce_enqueue(struct qr_task *task)
+{
+	char key[COALESCE_KEY_LEN];
+	const int klen = coalesce_key(key, &task->ctx->req);
+	if (klen < 0)
+		return false;
+	trie_t *leaders = task->ctx->worker->coalesce_in;
+	struct qr_task **leader = (struct qr_task **)trie_get_try(leaders, key, klen);
+	if (!leader || !*leader)
+		return false;
+	int ret = array_push_mm((*leader)->coalesced, task,
+				kr_memreserve, &(*leader)->ctx->req.pool);
+	if (unlikely(ret < 0)) /*ENOMEM*/
+		return false;
+	qr_task_ref(task);
+	return true;
+}
+
+/** Announce the task as the one resolving its client request. */
+static void coalesce_lead(struct qr_task *task)
+{
+	struct kr_request *req = &task->ctx->req;
+	char key[COALESCE_KEY_LEN];
+	const int klen = coalesce_key(key, req);
+	if (klen < 0)
+		return;
+	/* The request changes during resolution, so the key is kept. */
+	char *key_copy = mm_alloc(&req->pool, klen);
+	if (unlikely(!key_copy))
+		return; /*ENOMEM*/
+	struct qr_task **tvp = (struct qr_task **)
+		trie_get_ins(task->ctx->worker->coalesce_in, key, klen);
+	if (unlikely(!tvp))
+		return; /*ENOMEM*/
+	if (unlikely(*tvp != NULL)) {
+		assert(false);
+		return;
+	}
+	*tvp = task;
+	memcpy(key_copy, key, klen);
+	task->coalesce_key = key_copy;
+	task->coalesce_klen = klen;
+}
+
+/** Withdraw the leader and resume the requests waiting for it.
+ * They continue their own resolution, normally straight from the cache. */
+static void coalesce_finalize(struct qr_task *task)
+{
+	if (!task->coalesce_key)
+		return;
+	void *val_deleted;
+	int ret = trie_del(task->ctx->worker->coalesce_in,
+			   task->coalesce_key, task->coalesce_klen, &val_deleted);
+	assert(ret == KNOT_EOK && val_deleted == task); (void)ret;
+	task->coalesce_key = NULL;
+	for (size_t i = 0; i < task->coalesced.len; ++i) {
+		struct qr_task *follower = task->coalesced.at[i];
+		if (follower->finished) {
+			/* nothing to do */
+		} else if (kr_now() - worker_task_creation_time(follower) >= KR_RESOLVE_TIME_LIMIT) {
+			qr_task_finalize(follower, KR_STATE_FAIL);
+		} else {
+			qr_task_produce(follower, KR_STATE_PRODUCE, NULL, NULL);
+		}
+		qr_task_unref(follower);
+	}
+	task->coalesced.len = 0;
+}
+
 static int qr_task_finalize(struct qr_task *task, int state)
 {
 	assert(task && task->leading == false);
@@ -1136,11 +1541,17 @@ static int qr_task_finalize(struct qr_task *task, int state)
 	kr_resolve_finish(&ctx->req, state);
 
 	task->finished = true;
+	coalesce_finalize(task);
 	if (source_session == NULL) {
 		(void) qr_task_on_send(task, NULL, kr_error(EIO));
 		return state == KR_STATE_DONE ? 0 : kr_error(EIO);
 	}
 
+	if (state == KR_STATE_DONE && session_get_handle(source_session)->type == UV_UDP) {
+		packet_cache_insert(&ctx->worker->pcache, &ctx->req.ctx->cache,
+				    ctx->req.qsource.packet, ctx->req.answer);
+	}
+
 	/* Reference task as the callback handler can close it */
 	qr_task_ref(task);
 
@@ -1150,7 +1561,19 @@ static int qr_task_finalize(struct qr_task *task, int state)
 
 	int ret;
 	const uv_handle_t *src_handle = session_get_handle(source_session);
-	if (src_handle->type != UV_UDP && src_handle->type != UV_TCP) {
+	if (src_handle->type == UV_POLL) {
+#if ENABLE_XDP
+		/* AF_XDP; like with UDP, failing to send isn't fatal for the session. */
+		if (io_xdp_push(source_session, &ctx->source.addr.ip, &ctx->source.dst_addr.ip,
+				ctx->source.eth_addrs, ctx->req.answer, task) != 0) {
+			(void) qr_task_on_send(task, NULL, kr_error(EIO));
+		}
+		ret = kr_ok();
+#else
+		assert(false);
+		ret = kr_error(EINVAL);
+#endif
+	} else if (src_handle->type != UV_UDP && src_handle->type != UV_TCP) {
 		assert(false);
 		ret = kr_error(EINVAL);
 	} else if (src_handle->type == UV_UDP && ENABLE_SENDMMSG) {
@@ -1204,11 +1627,17 @@ static int udp_task_step(struct qr_task *task,
 	/* Check current query NSLIST */
 	struct kr_query *qry = array_tail(req->rplan.pending);
 	assert(qry != NULL);
-	/* Retransmit at default interval, or more frequently if the mean
-	 * RTT of the server is better. If the server is glued, use default rate. */
-	size_t timeout = qry->ns.score;
-	if (timeout > KR_NS_GLUED) {
-		/* We don't have information about variance in RTT, expect +10ms */
+	/* Retransmit at default interval, or sooner if the adaptive timeout
+	 * of the first address is shorter, see kr_nsrep_rto(). */
+	const struct sockaddr *first = task->addrlist;
+	const kr_nsrep_rtt_lru_entry_t *rtt = req->ctx->cache_rtt
+		? lru_get_try(req->ctx->cache_rtt, kr_inaddr(first), kr_inaddr_len(first))
+		: NULL;
+	size_t timeout = kr_nsrep_rto(rtt);
+	if (timeout > 0) {
+		timeout = MIN(timeout, KR_CONN_RETRY);
+	} else if (qry->ns.score > KR_NS_GLUED) {
+		/* No RTT measured for the address, expect +10ms to the score. */
 		timeout = MIN(qry->ns.score + 10, KR_CONN_RETRY);
 	} else {
 		timeout = KR_CONN_RETRY;
@@ -1219,6 +1648,20 @@ static int udp_task_step(struct qr_task *task,
 	subreq_lead(task);
 	struct session *session = handle->data;
 	assert(session_get_handle(session) == handle && (handle->type == UV_UDP));
+	/* Race the next addresses, either right away or once the first one
+	 * is late by the spread of their RTTs. */
+	task->race_hedge = 0;
+	const unsigned racers = race_count(task);
+	if (racers > 0) {
+		const size_t delay = ctx->worker->race.hedge ? race_delay(task, racers) : 0;
+		if (delay == 0) {
+			race_send(task, racers);
+		} else if (delay < timeout) {
+			task->race_hedge = racers;
+			task->race_rest = timeout - delay;
+			timeout = delay;
+		}
+	}
 	int ret = session_timer_start(session, on_retransmit, timeout, 0);
 	/* Start next step with timeout, fatal if can't start a timer. */
 	if (ret != 0) {
@@ -1361,10 +1804,7 @@ static int tcp_task_make_connection(struct qr_task *task, const struct sockaddr
 		worker_del_tcp_waiting(worker, addr);
 		free(conn);
 		session_close(session);
-		unsigned score = qry->flags.FORWARD || qry->flags.STUB ? KR_NS_FWD_DEAD : KR_NS_DEAD;
-		kr_nsrep_update_rtt(NULL, peer, score,
-				    worker->engine->resolver.cache_rtt,
-				    KR_NS_UPDATE_NORESET);
+		upstream_penalize(worker, peer, &qry->flags);
 		WITH_VERBOSE (qry) {
 			const char *peer_str = kr_straddr(peer);
 			kr_log_verbose( "[wrkr]=> connect to '%s' failed (%s), flagged as 'bad'\n",
@@ -1453,10 +1893,6 @@ static int qr_task_step(struct qr_task *task,
 	assert(ctx);
 	struct kr_request *req = &ctx->req;
 	struct worker_ctx *worker = ctx->worker;
-	int sock_type = -1;
-	task->addrlist = NULL;
-	task->addrlist_count = 0;
-	task->addrlist_turn = 0;
 
 	if (worker->too_many_open) {
 		/* */
@@ -1473,7 +1909,31 @@ static int qr_task_step(struct qr_task *task,
 		}
 	}
 
+	const bool is_new = packet && kr_rplan_empty(&req->rplan);
 	int state = kr_resolve_consume(req, packet_source, packet);
+	if (is_new && state == KR_STATE_PRODUCE && worker->coalesce
+	    && ctx->source.session) {
+		/* Policy rules have been applied by now, see coalesce_key(). */
+		if (coalesce_enqueue(task)) {
+			return kr_ok();
+		}
+		coalesce_lead(task);
+	}
+	return qr_task_produce(task, state, packet_source, packet);
+}
+
+/** Produce and send the next outgoing query, or finish the request. */
+static int qr_task_produce(struct qr_task *task, int state,
+			   const struct sockaddr *packet_source, knot_pkt_t *packet)
+{
+	struct request_ctx *ctx = task->ctx;
+	struct kr_request *req = &ctx->req;
+	struct worker_ctx *worker = ctx->worker;
+	int sock_type = -1;
+	task->addrlist = NULL;
+	task->addrlist_count = 0;
+	task->addrlist_turn = 0;
+
 	while (state == KR_STATE_PRODUCE) {
 		state = kr_resolve_produce(req, &task->addrlist,
 					   &sock_type, task->pktbuf);
@@ -1562,7 +2022,9 @@ static int parse_packet(knot_pkt_t *query)
 	return ret;
 }
 
-int worker_submit(struct session *session, const struct sockaddr *peer, knot_pkt_t *query)
+int worker_submit(struct session *session, const struct sockaddr *peer,
+		  const struct sockaddr *dst_addr, const uint8_t *eth_from,
+		  const uint8_t *eth_to, knot_pkt_t *query)
 {
 	if (!session) {
 		assert(false);
@@ -1596,7 +2058,15 @@ int worker_submit(struct session *session, const struct sockaddr *peer, knot_pkt
 	struct qr_task *task = NULL;
 	const struct sockaddr *addr = NULL;
 	if (!is_outgoing) { /* request from a client */
+		if (handle->type == UV_UDP && ret == kr_ok()
+		    && packet_cache_answer(&worker->pcache, &worker->engine->resolver.cache,
+					   (uv_udp_t *)handle, peer, query) == kr_ok()) {
+			worker->stats.queries += 1;
+			worker->stats.pcache_hits += 1;
+			return kr_ok();
+		}
 		struct request_ctx *ctx = request_create(worker, session, peer,
+							 dst_addr, eth_from, eth_to,
 							 knot_wire_get_id(query->wire));
 		if (!ctx) {
 			return kr_error(ENOMEM);
@@ -1838,7 +2308,8 @@ struct qr_task *worker_resolve_start(knot_pkt_t *query, struct kr_qflags options
 	}
 
 
-	struct request_ctx *ctx = request_create(worker, NULL, NULL, worker->next_request_uid);
+	struct request_ctx *ctx = request_create(worker, NULL, NULL, NULL, NULL, NULL,
+						 worker->next_request_uid);
 	if (!ctx) {
 		return NULL;
 	}
@@ -1879,6 +2350,139 @@ int worker_resolve_exec(struct qr_task *task, knot_pkt_t *query)
 	return qr_task_step(task, NULL, query);
 }
 
+/** Key of a background lookup in worker_ctx::ns_bg.inflight.
+ * @return the key length */
+static size_t bg_lookup_key(uint8_t buf[2 + KNOT_DNAME_MAXLEN], const struct bg_lookup *l)
+{
+	memcpy(buf, &l->type, sizeof(l->type));
+	const size_t name_len = knot_dname_size(l->name);
+	memcpy(buf + sizeof(l->type), l->name, name_len);
+	return sizeof(l->type) + name_len;
+}
+
+static void bg_lookups_cb(uv_timer_t *timer);
+
+/** The lookup is done, or it couldn't start; allow it again
+ * and have the task that asked for it resumed from the timer. */
+static void bg_lookup_done(struct worker_ctx *worker, struct bg_lookup *l)
+{
+	uint8_t key[2 + KNOT_DNAME_MAXLEN];
+	const size_t key_len = bg_lookup_key(key, l);
+	if (worker->ns_bg.inflight) {
+		trie_del(worker->ns_bg.inflight, (const char *)key, key_len, NULL);
+	}
+	free(l->name);
+	l->name = NULL;
+	if (!l->waiter) {
+		return;
+	}
+	if (array_push(worker->ns_bg.resume, l->waiter) < 0) {
+		qr_task_unref(l->waiter);
+	} else if (!uv_is_active((uv_handle_t *)&worker->ns_bg.timer)) {
+		uv_timer_start(&worker->ns_bg.timer, bg_lookups_cb, 0, 0);
+	}
+	l->waiter = NULL;
+}
+
+/** Continue the task with another NS if its address has arrived, see kr_resolve_ns_arrived().
+ * Only a single outstanding UDP query that no other task waits for is abandoned. */
+static void bg_resume(struct qr_task *task)
+{
+	if (task->finished || !task->leading || task->waiting.len > 0
+	    || task->pending_count == 0) {
+		return;
+	}
+	if (!kr_resolve_ns_arrived(&task->ctx->req)) {
+		return;
+	}
+	/* Like on a step, but the abandoned query doesn't count as a timeout. */
+	subreq_finalize(task, NULL, NULL);
+	(void)qr_task_produce(task, KR_STATE_PRODUCE, NULL, NULL);
+}
+
+/** Start the queued background lookups and resume the tasks waiting for those done. */
+static void bg_lookups_cb(uv_timer_t *timer)
+{
+	struct worker_ctx *worker = timer->data;
+	for (size_t i = 0; i < worker->ns_bg.queue.len; ++i) {
+		struct bg_lookup *l = &worker->ns_bg.queue.at[i];
+		char name_str[KNOT_DNAME_TXT_MAXLEN];
+		const struct kr_qflags options = { 0 };
+		knot_pkt_t *pkt = knot_dname_to_str(name_str, l->name, sizeof(name_str))
+			? worker_resolve_mk_pkt(name_str, l->type, KNOT_CLASS_IN, &options)
+			: NULL;
+		struct qr_task *task = pkt ? worker_resolve_start(pkt, options) : NULL;
+		if (task) {
+			/* The request takes over the name; see request_free(). */
+			task->ctx->ns_bg = *l;
+			worker->stats.ns_bg += 1;
+			(void)worker_resolve_exec(task, pkt);
+		} else {
+			bg_lookup_done(worker, l);
+		}
+		knot_pkt_free(pkt);
+	}
+	worker->ns_bg.queue.len = 0;
+
+	/* Resuming may finish other lookups, so take the list first. */
+	qr_tasklist_t resume = worker->ns_bg.resume;
+	array_init(worker->ns_bg.resume);
+	for (size_t i = 0; i < resume.len; ++i) {
+		bg_resume(resume.at[i]);
+		qr_task_unref(resume.at[i]);
+	}
+	array_clear(resume);
+}
+
+/** Queue a lookup; it's started from the event loop, outside of the current request.
+ * Lookups already queued or running, also for other requests, aren't repeated.
+ * The request is resumed once the lookup is done.  See kr_context::resolve_bg */
+static int bg_lookup_queue(struct kr_request *req, const knot_dname_t *name, uint16_t type)
+{
+	struct worker_ctx *worker = the_worker;
+	if (!worker || !worker->ns_bg.enabled) {
+		return kr_error(ENOTSUP);
+	}
+	if (!worker->ns_bg.inflight && !(worker->ns_bg.inflight = trie_create(NULL))) {
+		return kr_error(ENOMEM);
+	}
+	/* All requests of the worker are embedded in struct request_ctx. */
+	struct request_ctx *ctx = (struct request_ctx *)req;
+	struct bg_lookup l = {
+		.name = knot_dname_copy(name, NULL),
+		.type = type,
+		.waiter = ctx ? ctx->task : NULL,
+	};
+	if (!l.name) {
+		return kr_error(ENOMEM);
+	}
+	knot_dname_to_lower(l.name);
+	uint8_t key[2 + KNOT_DNAME_MAXLEN];
+	const size_t key_len = bg_lookup_key(key, &l);
+	int ret = kr_ok();
+	if (trie_get_try(worker->ns_bg.inflight, (const char *)key, key_len)) {
+		ret = kr_error(EEXIST);
+	} else if (trie_weight(worker->ns_bg.inflight) >= worker->ns_bg.max) {
+		ret = kr_error(ENOSPC);
+	} else if (array_push(worker->ns_bg.queue, l) < 0) {
+		ret = kr_error(ENOMEM);
+	} else if (!trie_get_ins(worker->ns_bg.inflight, (const char *)key, key_len)) {
+		--worker->ns_bg.queue.len;
+		ret = kr_error(ENOMEM);
+	}
+	if (ret) {
+		free(l.name);
+		return ret;
+	}
+	if (l.waiter) {
+		qr_task_ref(l.waiter);
+	}
+	if (worker->ns_bg.queue.len == 1) {
+		uv_timer_start(&worker->ns_bg.timer, bg_lookups_cb, 0, 0);
+	}
+	return kr_ok();
+}
+
 int worker_task_numrefs(const struct qr_task *task)
 {
 	return task->refs;
@@ -1980,6 +2584,7 @@ static int worker_reserve(struct worker_ctx *worker, size_t ring_maxlen)
 	worker->tcp_connected = map_make(NULL);
 	worker->tcp_waiting = map_make(NULL);
 	worker->subreq_out = trie_create(NULL);
+	worker->coalesce_in = trie_create(NULL);
 
 	array_init(worker->pool_mp);
 	if (array_reserve(worker->pool_mp, ring_maxlen)) {
@@ -2010,10 +2615,25 @@ void worker_deinit(void)
 		zi_free(worker->z_import);
 		worker->z_import = NULL;
 	}
+	worker_udp_pool_flush(worker);
+	array_clear(worker->udp_pool.idle);
+	(void)packet_cache_set(&worker->pcache, 0, 0);
+	uv_timer_stop(&worker->cache_flush);
+	uv_timer_stop(&worker->ns_bg.timer);
+	uv_timer_stop(&worker->infra_flush);
+	for (size_t i = 0; i < worker->ns_bg.queue.len; ++i) {
+		free(worker->ns_bg.queue.at[i].name);
+	}
+	array_clear(worker->ns_bg.queue);
+	array_clear(worker->ns_bg.resume);
+	trie_free(worker->ns_bg.inflight);
+	worker->ns_bg.inflight = NULL;
 	map_clear(&worker->tcp_connected);
 	map_clear(&worker->tcp_waiting);
 	trie_free(worker->subreq_out);
 	worker->subreq_out = NULL;
+	trie_free(worker->coalesce_in);
+	worker->coalesce_in = NULL;
 
 	reclaim_mp_freelist(&worker->pool_mp);
 	mp_delete(worker->pkt_pool.ctx);
@@ -2035,6 +2655,19 @@ int worker_init(struct engine *engine, int worker_id, int worker_count)
 
 	uv_loop_t *loop = uv_default_loop();
 	worker->loop = loop;
+	uv_timer_init(loop, &worker->cache_flush);
+	uv_unref((uv_handle_t *)&worker->cache_flush);
+	uv_timer_init(loop, &worker->ns_bg.timer);
+	uv_unref((uv_handle_t *)&worker->ns_bg.timer);
+	worker->ns_bg.timer.data = worker;
+	worker->ns_bg.max = BG_LOOKUPS_MAX;
+	engine->resolver.resolve_bg = bg_lookup_queue;
+	uv_timer_init(loop, &worker->infra_flush);
+	uv_unref((uv_handle_t *)&worker->infra_flush);
+	worker->infra_flush.data = worker;
+	uv_timer_init(loop, &worker->udp_pool.timer);
+	uv_unref((uv_handle_t *)&worker->udp_pool.timer);
+	worker->udp_pool.timer.data = &worker->udp_pool;
 
 	worker->id = worker_id;
 	worker->count = worker_count;
@@ -2047,6 +2680,10 @@ int worker_init(struct engine *engine, int worker_id, int worker_count)
 	lua_pop(engine->L, 1);
 
 	worker->tcp_pipeline_max = MAX_PIPELINED;
+	worker->udp_pool.size = UDP_POOL_SIZE;
+	worker->udp_pool.max_uses = UDP_POOL_MAX_USES;
+	worker->race.count = 1;
+	worker->race.budget = RACE_BUDGET_DEFAULT;
 	worker->out_addr4.sin_family = AF_UNSPEC;
 	worker->out_addr6.sin6_family = AF_UNSPEC;
 
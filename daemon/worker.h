@@ -5,6 +5,7 @@
 #pragma once
 
 #include "daemon/engine.h"
+#include "daemon/packet_cache.h"
 #include "lib/generic/array.h"
 #include "lib/generic/map.h"
 
@@ -33,10 +34,15 @@ void worker_deinit(void);
  *
  * @param session  session the packet came from
  * @param peer     address the packet came from
+ * @param dst_addr address the packet was sent to; NULL means the session's sockname
+ * @param eth_from MAC address of the peer (AF_XDP only, otherwise NULL)
+ * @param eth_to   our MAC address (AF_XDP only, otherwise NULL)
  * @param query    the packet, or NULL on an error from the transport layer
  * @return 0 or an error code
  */
-int worker_submit(struct session *session, const struct sockaddr *peer, knot_pkt_t *query);
+int worker_submit(struct session *session, const struct sockaddr *peer,
+		  const struct sockaddr *dst_addr, const uint8_t *eth_from,
+		  const uint8_t *eth_to, knot_pkt_t *query);
 
 /**
  * End current DNS/TCP session, this disassociates pending tasks from this session
@@ -95,6 +101,12 @@ int worker_del_tcp_waiting(struct worker_ctx *worker,
 			   const struct sockaddr* addr);
 knot_pkt_t *worker_task_get_pktbuf(const struct qr_task *task);
 
+/** Return an idle outgoing UDP session into the pool for reuse with the same upstream.
+ * @return 0 if taken over, otherwise the caller should close the session. */
+int worker_udp_pool_put(struct session *session);
+/** Close all pooled outgoing UDP sockets, e.g. after changing outgoing addresses. */
+void worker_udp_pool_flush(struct worker_ctx *worker);
+
 struct request_ctx *worker_task_get_request(struct qr_task *task);
 
 struct session *worker_request_get_source_session(struct request_ctx *);
@@ -116,6 +128,7 @@ struct worker_stats {
 	size_t concurrent;  /**< The number of requests currently in processing. */
 	size_t rconcurrent; /*< TODO: remove?  I see no meaningful difference from .concurrent. */
 	size_t dropped;     /**< The number of requests dropped due to being badly formed.  See #471. */
+	size_t pcache_hits; /**< The number of requests answered from the packet cache; included in .queries */
 
 	size_t timeout; /**< Number of outbound queries that timed out. */
 	size_t udp;  /**< Number of outbound queries over UDP. */
@@ -123,6 +136,8 @@ struct worker_stats {
 	size_t tls;  /**< Number of outbound queries over TLS. */
 	size_t ipv4; /**< Number of outbound queries over IPv4.*/
 	size_t ipv6; /**< Number of outbound queries over IPv6. */
+	size_t race; /**< Number of outbound racing queries, see worker.race(); included in .udp */
+	size_t ns_bg; /**< Number of NS address lookups started in background; included in .queries */
 };
 
 /** @cond internal */
@@ -133,9 +148,28 @@ struct worker_stats {
 /** Maximum response time from TCP upstream, milliseconds */
 #define MAX_TCP_INACTIVITY (KR_RESOLVE_TIME_LIMIT + KR_CONN_RTT_MAX)
 
+/** Default interval of flushing buffered cache writes, milliseconds */
+#define CACHE_FLUSH_MS_DEFAULT 50
+
+/** Default number of racing queries allowed per 100 regular ones, see worker.race() */
+#define RACE_BUDGET_DEFAULT 10
+
 #ifndef RECVMMSG_BATCH /* see check_bufsize() */
+#if ENABLE_RECVMMSG
+/** Maximum number of datagrams read by one recvmmsg() call (UV__MMSG_MAXWIDTH). */
+#define RECVMMSG_BATCH 20
+#else
 #define RECVMMSG_BATCH 1
 #endif
+#endif
+
+/** Space for a single datagram in worker_ctx::wire_buf.
+ * In recvmmsg mode libuv cuts the buffer into slices of exactly 64 KiB. */
+#if ENABLE_RECVMMSG
+#define RECVMMSG_SLICE (64 * 1024)
+#else
+#define RECVMMSG_SLICE KNOT_WIRE_MAX_PKTSIZE
+#endif
 
 /** Freelist of available mempools. */
 typedef array_t(struct mempool *) mp_freelist_t;
@@ -143,6 +177,28 @@ typedef array_t(struct mempool *) mp_freelist_t;
 /** List of query resolution tasks. */
 typedef array_t(struct qr_task *) qr_tasklist_t;
 
+/** Lookup queued by kr_context::resolve_bg. */
+struct bg_lookup {
+	knot_dname_t *name; /**< malloc()-ed */
+	uint16_t type;
+	struct qr_task *waiter; /**< referenced task to resume once done; see bg_resume() */
+};
+
+/** Idle outgoing UDP socket, bound to a random port and used with a single upstream. */
+struct udp_pool_entry {
+	struct session *session;
+	union inaddr peer;   /**< the only upstream the socket may be reused for */
+	uint64_t idle_since; /**< kr_now() when the socket became idle */
+};
+
+/** Pool of idle outgoing UDP sockets, ordered by idle_since. */
+struct udp_pool {
+	array_t(struct udp_pool_entry) idle;
+	unsigned size;     /**< Max. number of idle sockets; 0 disables the pool. */
+	unsigned max_uses; /**< Retire a socket after sending this many queries. */
+	uv_timer_t timer;  /**< Closes sockets that stay idle, see udp_pool_expire(). */
+};
+
 /** \details Worker state is meant to persist during the whole life of daemon. */
 struct worker_ctx {
 	struct engine *engine;
@@ -156,7 +212,7 @@ struct worker_ctx {
 	struct sockaddr_in out_addr4;
 	struct sockaddr_in6 out_addr6;
 
-	uint8_t wire_buf[RECVMMSG_BATCH * KNOT_WIRE_MAX_PKTSIZE];
+	uint8_t wire_buf[RECVMMSG_BATCH * RECVMMSG_SLICE];
 
 	struct worker_stats stats;
 
@@ -169,6 +225,35 @@ struct worker_ctx {
 	map_t tcp_waiting;
 	/** Subrequest leaders (struct qr_task*), indexed by qname+qtype+qclass. */
 	trie_t *subreq_out;
+	/** Client requests being resolved (struct qr_task*), indexed by coalesce_key(). */
+	trie_t *coalesce_in;
+	/** Make identical client requests wait for the first one, see worker.coalesce(). */
+	bool coalesce;
+	/** Racing of upstream addresses, see worker.race(). */
+	struct {
+		unsigned count;  /**< addresses queried in parallel; 1 disables racing */
+		unsigned budget; /**< racing queries allowed per 100 regular ones */
+		bool hedge;      /**< delay the racers by the spread of RTTs */
+		unsigned credit; /**< unused budget, in hundredths of a query */
+	} race;
+	/** Outgoing UDP sockets waiting for reuse. */
+	struct udp_pool udp_pool;
+	/** Rendered answers to plain UDP queries, see cache.packet_cache(). */
+	struct packet_cache pcache;
+	/** Flushes buffered cache writes, see cache.write_back(). */
+	uv_timer_t cache_flush;
+	uint64_t cache_flush_ms; /**< 0 if not running */
+	/** Lookups to start in requests of their own, see kr_context::resolve_bg. */
+	struct {
+		bool enabled;   /**< see worker.ns_bg() */
+		unsigned max;   /**< limit on the lookups queued or running at once */
+		array_t(struct bg_lookup) queue; /**< waiting for the timer to start them */
+		trie_t *inflight; /**< queued and running lookups, by bg_lookup_key() */
+		qr_tasklist_t resume; /**< waiters of the lookups done, for the timer */
+		uv_timer_t timer;
+	} ns_bg;
+	/** Writes NS records shared through the cache, see cache.ns_share(). */
+	uv_timer_t infra_flush;
 	mp_freelist_t pool_mp;
 	knot_mm_t pkt_pool;
 	unsigned int next_request_uid;
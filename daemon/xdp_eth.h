@@ -0,0 +1,28 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/** MAC addresses of an AF_XDP request are kept as eth_addrs: ours [0] and theirs [1]. */
+
+/** Store MAC addresses of a received frame into eth_addrs. */
+static inline void xdp_eth_addrs_set(uint8_t eth_addrs[2][6],
+				     const uint8_t *eth_from, const uint8_t *eth_to)
+{
+	memcpy(eth_addrs[0], eth_to, sizeof(eth_addrs[0]));
+	memcpy(eth_addrs[1], eth_from, sizeof(eth_addrs[1]));
+}
+
+/** Write MAC addresses of the reply, i.e. from us to the peer.
+ * eth_from and eth_to point into the header of the reply frame,
+ * as set up by knot_xdp_send_alloc(). */
+static inline void xdp_eth_reply_addrs(const uint8_t eth_addrs[2][6],
+				       uint8_t *eth_from, uint8_t *eth_to)
+{
+	memcpy(eth_from, eth_addrs[0], sizeof(eth_addrs[0]));
+	memcpy(eth_to, eth_addrs[1], sizeof(eth_addrs[1]));
+}
@@ -25,6 +25,7 @@
 #include "lib/resolve.h"
 #include "lib/rplan.h"
 #include "lib/utils.h"
+#include "lib/zonecut.h"
 
 #include "lib/cache/impl.h"
 
@@ -69,7 +70,7 @@ static int assert_right_version(struct kr_cache *cache)
 	uint8_t key_str[4] = "VERS";
 	knot_db_val_t key = { .data = key_str, .len = sizeof(key_str) };
 	knot_db_val_t val = { NULL, 0 };
-	int ret = cache_op(cache, read, &key, &val, 1);
+	int ret = cache_read(cache, &key, &val);
 	if (ret == 0 && val.len == sizeof(CACHE_VERSION)
 	    && memcmp(val.data, &CACHE_VERSION, sizeof(CACHE_VERSION)) == 0) {
 		ret = kr_error(EEXIST);
@@ -95,7 +96,7 @@ static int assert_right_version(struct kr_cache *cache)
 			/* Key/Val is invalidated by cache purge, recreate it */
 			val.data = /*const-cast*/(void *)&CACHE_VERSION;
 			val.len = sizeof(CACHE_VERSION);
-			ret = cache_op(cache, write, &key, &val, 1);
+			ret = cache_write(cache, &key, &val);
 		}
 	}
 	kr_cache_commit(cache);
@@ -123,6 +124,9 @@ int kr_cache_open(struct kr_cache *cache, const struct kr_cdb_api *api, struct k
 	kr_cache_make_checkpoint(cache);
 	(void)assert_right_version(cache);
 
+	if (api != kr_cdb_lmdb() || opts->shards > 1) {
+		return 0; /* no single file to remove in emergency */
+	}
 	char *fpath;
 	ret = asprintf(&fpath, "%s/data.mdb", opts->path);
 	if (ret > 0) {
@@ -141,8 +145,10 @@ const char *kr_cache_emergency_file_to_remove = NULL;
 void kr_cache_close(struct kr_cache *cache)
 {
 	if (cache_isvalid(cache)) {
+		(void)kr_cache_flush(cache);
 		cache_op(cache, close);
 		cache->db = NULL;
+		++cache->generation;
 	}
 	free(/*const-cast*/(char*)kr_cache_emergency_file_to_remove);
 	kr_cache_emergency_file_to_remove = NULL;
@@ -153,6 +159,8 @@ int kr_cache_commit(struct kr_cache *cache)
 	if (!cache_isvalid(cache)) {
 		return kr_error(EINVAL);
 	}
+	cache_l1_commit(cache);
+	cache_pending_commit(cache);
 	if (cache->api->commit) {
 		return cache_op(cache, commit);
 	}
@@ -180,7 +188,9 @@ int kr_cache_clear(struct kr_cache *cache)
 	if (!cache_isvalid(cache)) {
 		return kr_error(EINVAL);
 	}
+	cache_pending_drop(cache);
 	int ret = cache_op(cache, clear);
+	++cache->generation;
 	if (ret == 0) {
 		kr_cache_make_checkpoint(cache);
 		ret = assert_right_version(cache);
@@ -605,7 +615,7 @@ static ssize_t stash_rrset(struct kr_cache *cache, const struct kr_query *qry,
 	{
 	kr_cache_commit(cache);
 	knot_db_val_t val = { NULL, 0 };
-	ret = cache_op(cache, read, &key, &val, 1);
+	ret = cache_read_rmw(cache, &key, &val);
 	if (ret != kr_error(ENOENT)) { // ENOENT might happen in some edge case, I guess
 		assert(!ret);
 		entry_list_t el;
@@ -614,6 +624,12 @@ static ssize_t stash_rrset(struct kr_cache *cache, const struct kr_query *qry,
 	}
 	#endif
 
+	/* The zone cut might have been remembered without these. */
+	if (rr->type == KNOT_RRTYPE_NS || rr->type == KNOT_RRTYPE_DS
+	    || rr->type == KNOT_RRTYPE_DNSKEY) {
+		kr_zonecut_memo_drop(rr->owner);
+	}
+
 	/* Verbose-log some not-too-common cases. */
 	WITH_VERBOSE(qry) { if (kr_rank_test(rank, KR_RANK_AUTH)
 				|| rr->type == KNOT_RRTYPE_NS) {
@@ -712,7 +728,7 @@ static int stash_nsec_p(const knot_dname_t *dname, const char *nsec_p_v,
 	if (ret) return kr_error(ret);
 	knot_db_val_t key = key_exact_type(k, KNOT_RRTYPE_NS);
 	knot_db_val_t val_orig = { NULL, 0 };
-	ret = cache_op(cache, read, &key, &val_orig, 1);
+	ret = cache_read_rmw(cache, &key, &val_orig);
 	if (ret && ret != -ABS(ENOENT)) {
 		VERBOSE_MSG(qry, "=> EL read failed (ret: %d)\n", ret);
 		return kr_ok();
@@ -770,7 +786,7 @@ static int stash_nsec_p(const knot_dname_t *dname, const char *nsec_p_v,
 			data_stride - sizeof(valid_until));
 	}
 	/* Write it all to the cache */
-	ret = cache_op(cache, write, &key, &val, 1);
+	ret = cache_write(cache, &key, &val);
 	if (ret || !val.data) {
 		VERBOSE_MSG(qry, "=> EL write failed (ret: %d)\n", ret);
 		return kr_ok();
@@ -799,7 +815,7 @@ static int peek_exact_real(struct kr_cache *cache, const knot_dname_t *name, uin
 
 	knot_db_val_t key = key_exact_type(k, type);
 	knot_db_val_t val = { NULL, 0 };
-	ret = cache_op(cache, read, &key, &val, 1);
+	ret = cache_read_rmw(cache, &key, &val);
 	if (!ret) ret = entry_h_seek(&val, type);
 	if (ret) return kr_error(ret);
 
@@ -845,6 +861,8 @@ int kr_cache_remove(struct kr_cache *cache, const knot_dname_t *name, uint16_t t
 	if (ret) return kr_error(ret);
 
 	knot_db_val_t key = key_exact_type(k, type);
+	(void)kr_cache_flush(cache);
+	++cache->generation;
 	return cache_op(cache, remove, &key, 1);
 }
 
@@ -857,6 +875,7 @@ int kr_cache_match(struct kr_cache *cache, const knot_dname_t *name,
 	if (!cache->api->match) {
 		return kr_error(ENOSYS);
 	}
+	(void)kr_cache_flush(cache);
 
 	struct key k_storage, *k = &k_storage;
 
@@ -932,6 +951,7 @@ int kr_cache_remove_subtree(struct kr_cache *cache, const knot_dname_t *name,
 		memcpy(keys[i].data, keyval[i][0].data, keys[i].len);
 	}
 	ret = cache_op(cache, remove, keys, count);
+	++cache->generation;
 cleanup:
 	kr_cache_commit(cache); /* Sync even after just kr_cache_match(). */
 	/* Free keys */
@@ -941,3 +961,59 @@ int kr_cache_remove_subtree(struct kr_cache *cache, const knot_dname_t *name,
 	return ret;
 }
 
+
+/** Compose key of an infrastructure record.
+ * CACHE_KEY_DEF: key == '\0' + tag + id; the leading zero places these
+ * among root-zone keys, where tags 'E', '1' and '3' can't collide with them. */
+static knot_db_val_t key_infra(uint8_t buf[KEY_SIZE], int tag,
+				const void *id, size_t id_len)
+{
+	buf[0] = '\0';
+	buf[1] = tag;
+	memcpy(buf + 2, id, id_len);
+	return (knot_db_val_t){ .data = buf, .len = 2 + id_len };
+}
+
+int kr_cache_infra_read(struct kr_cache *cache, int tag, const void *id, size_t id_len,
+			void *data, size_t len)
+{
+	if (!cache_isvalid(cache) || !id || id_len > KNOT_DNAME_MAXLEN || !data) {
+		return kr_error(EINVAL);
+	}
+	uint8_t buf[KEY_SIZE];
+	knot_db_val_t key = key_infra(buf, tag, id, id_len);
+	knot_db_val_t val = { NULL, 0 };
+	/* Not through L1: other instances update these records. */
+	int ret = cache_op(cache, read, &key, &val, 1);
+	if (ret) {
+		return ret;
+	}
+	if (val.len != sizeof(struct infra_h) + len) {
+		return kr_error(ENOENT); /* e.g. written by an incompatible version */
+	}
+	struct infra_h ih;
+	memcpy(&ih, val.data, sizeof(ih));
+	const uint32_t now = time(NULL);
+	if (now > ih.time && now - ih.time > ih.ttl) {
+		return kr_error(ENOENT); /* left for the garbage collector */
+	}
+	memcpy(data, (const uint8_t *)val.data + sizeof(ih), len);
+	return kr_ok();
+}
+
+int kr_cache_infra_write(struct kr_cache *cache, int tag, const void *id, size_t id_len,
+			 const void *data, size_t len)
+{
+	if (!cache_isvalid(cache) || !id || id_len > KNOT_DNAME_MAXLEN || !data) {
+		return kr_error(EINVAL);
+	}
+	uint8_t buf[KEY_SIZE];
+	knot_db_val_t key = key_infra(buf, tag, id, id_len);
+	const struct infra_h ih = { .time = time(NULL), .ttl = KR_CACHE_INFRA_TTL };
+	uint8_t vbuf[sizeof(ih) + len];
+	memcpy(vbuf, &ih, sizeof(ih));
+	memcpy(vbuf + sizeof(ih), data, len);
+	knot_db_val_t val = { .data = vbuf, .len = sizeof(vbuf) };
+	/* Not buffered, so that other instances see it soon; see kr_cache_infra_read() */
+	return cache_op(cache, write, &key, &val, 1);
+}
@@ -21,6 +21,9 @@ int cache_peek(kr_layer_t *ctx, knot_pkt_t *pkt);
 int cache_stash(kr_layer_t *ctx, knot_pkt_t *pkt);
 
 
+struct kr_cache_l1;
+struct kr_cache_pending;
+
 /**
  * Cache structure, keeps API, instance and metadata.
  */
@@ -34,6 +37,9 @@ struct kr_cache
 	/* A pair of stamps for detection of real-time shifts during runtime. */
 	struct timeval checkpoint_walltime; /**< Wall time on the last check-point. */
 	uint64_t checkpoint_monotime; /**< Monotonic milliseconds on the last check-point. */
+	uint32_t generation; /**< Incremented whenever records get removed. */
+	struct kr_cache_l1 *l1; /**< In-memory cache of reads; NULL if disabled. */
+	struct kr_cache_pending *pending; /**< Buffered writes; NULL if disabled. */
 };
 
 /**
@@ -181,3 +187,90 @@ int kr_cache_closest_apex(struct kr_cache *cache, const knot_dname_t *name, bool
  */
 KR_EXPORT
 int kr_unpack_cache_key(knot_db_val_t key, knot_dname_t *buf, uint16_t *type);
+
+/**
+ * Tags of infrastructure records, i.e. state about upstream servers
+ * shared through the cache by all instances using it.  CACHE_KEY_DEF
+ */
+enum kr_cache_infra_tag {
+	KR_CACHE_INFRA_RTT = 'S', /**< kr_nsrep_rtt_lru_entry_t, keyed by raw IP address */
+	KR_CACHE_INFRA_REP = 'R', /**< NS reputation flags, keyed by NS name in wire format */
+};
+
+/** Lifetime of infrastructure records in seconds since their last write;
+ * expired ones aren't read and the garbage collector removes them. */
+#define KR_CACHE_INFRA_TTL 3600
+
+/**
+ * Read a fixed-size infrastructure record.
+ * @param tag  see enum kr_cache_infra_tag
+ * @param id   identifier of the record, at most KNOT_DNAME_MAXLEN bytes
+ * @param data output buffer of exactly len bytes
+ * @return 0 or an errcode, kr_error(ENOENT) if not found, expired or of different size
+ * @note the cache transaction is left open, as with other reads.
+ */
+KR_EXPORT
+int kr_cache_infra_read(struct kr_cache *cache, int tag, const void *id, size_t id_len,
+			void *data, size_t len);
+
+/**
+ * Write a fixed-size infrastructure record, valid for KR_CACHE_INFRA_TTL.
+ * It bypasses the buffer of cache.write_back(), but it's up to the caller
+ * to commit; updates are batched by kr_nsrep_infra_flush().
+ * @return 0 or an errcode
+ */
+KR_EXPORT
+int kr_cache_infra_write(struct kr_cache *cache, int tag, const void *id, size_t id_len,
+			 const void *data, size_t len);
+
+/**
+ * Set the number of slots of the in-memory L1 cache in front of the backend.
+ * It holds copies of recently read values of up to 1 KiB; writes and removals
+ * invalidate it.  Zero disables it.  The number is rounded up to a power of two.
+ * Changes committed by other processes are noticed on the next kr_cache_commit().
+ * @return 0 or an errcode
+ */
+KR_EXPORT
+int kr_cache_l1_set(struct kr_cache *cache, unsigned slots);
+
+/** Return the number of L1 slots, or zero if it's disabled. */
+KR_EXPORT
+unsigned kr_cache_l1_slots(const struct kr_cache *cache);
+
+/**
+ * Buffer writes to the cache and flush them in one transaction.
+ * The buffer is flushed by kr_cache_commit() once max keys are pending,
+ * otherwise it's up to the caller to kr_cache_flush() periodically.
+ * Zero max flushes and disables the buffer.
+ * @return 0 or an errcode
+ */
+KR_EXPORT
+int kr_cache_write_back(struct kr_cache *cache, unsigned max);
+
+/** Return max of kr_cache_write_back(), or zero if it's disabled. */
+KR_EXPORT
+unsigned kr_cache_write_back_max(const struct kr_cache *cache);
+
+/**
+ * Write all pending records to the backend and commit.
+ * @return 0 or an errcode
+ */
+KR_EXPORT
+int kr_cache_flush(struct kr_cache *cache);
+
+/**
+ * Export all unexpired records into a file, replacing it atomically.
+ * The backend needs to support the apply operation.
+ * @return the number of records or an errcode
+ */
+KR_EXPORT
+int kr_cache_snapshot(struct kr_cache *cache, const char *path);
+
+/**
+ * Load records from a file written by kr_cache_snapshot().
+ * Records already present in the cache and expired ones are skipped.
+ * @return the number of records written or an errcode;
+ *	kr_error(ENOTSUP) for a snapshot of a different cache version
+ */
+KR_EXPORT
+int kr_cache_restore(struct kr_cache *cache, const char *path);
@@ -12,6 +12,7 @@
 struct kr_cdb_opts {
 	const char *path; /*!< Cache URI path. */
 	size_t maxsize;   /*!< Suggested cache size in bytes. */
+	unsigned shards;  /*!< Split into this many parts, if supported; 0 or 1 for no split. */
 };
 
 struct kr_cdb_stats {
@@ -29,6 +30,15 @@ struct kr_cdb_stats {
 	uint64_t match_miss;
 	uint64_t read_leq;
 	uint64_t read_leq_miss;
+	uint64_t l1_hit;  /**< reads answered from the in-memory L1 cache */
+	uint64_t l1_miss; /**< reads that went to the backend although L1 is enabled */
+	double usage_percent;
+};
+
+/* Figures of one part of a sharded cache. */
+struct kr_cdb_shard_stats {
+	uint64_t entries;
+	uint64_t commit;
 	double usage_percent;
 };
 
@@ -77,4 +87,26 @@ struct kr_cdb_api {
 			knot_db_val_t *key, knot_db_val_t *val);
 
 	double (*usage_percent)(knot_db_t *db);
+
+	/** Optional: figures of the i-th shard.
+	 * \return kr_error(ENOENT) if there's no such shard. */
+	int (*shard_stats)(knot_db_t *db, unsigned i, struct kr_cdb_shard_stats *stats);
+
+	/** Optional: call f on every key-value pair, in no particular order.
+	 * The values are only valid during the call, and f must not modify the cache.
+	 * \return the first non-zero value returned by f, or kr_error */
+	int (*apply)(knot_db_t *db, struct kr_cdb_stats *stat,
+			int (*f)(const knot_db_val_t *key, const knot_db_val_t *val, void *baton),
+			void *baton);
+
+	/** Optional: length of the longest prefix of key that any key in the database has.
+	 * It's found by a single search for the neighbours of key.
+	 * \return the length or negative kr_error */
+	int (*prefix_len)(knot_db_t *db, struct kr_cdb_stats *stat,
+			const knot_db_val_t *key);
+
+	/** Optional: a counter of commits by other processes noticed so far.
+	 * Missing if the database can't be shared.  Copies of values kept outside
+	 * the database, e.g. in L1, are dropped whenever the counter changes. */
+	uint64_t (*foreign_changes)(knot_db_t *db);
 };
@@ -3,8 +3,11 @@
 */
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -44,6 +47,18 @@ struct lmdb_env
 		MDB_txn *ro, *rw;
 		MDB_cursor *ro_curs;
 	} txn;
+
+	uint64_t commits; /**< RW transactions committed, for per-shard stats */
+	size_t txnid;     /**< ID of the last transaction committed, as far as we know */
+	uint64_t foreign; /**< commits by other processes noticed so far */
+};
+
+/** The cache split into independent environments, each with its own
+ * writer lock and map; see shard_of().  Unsharded cache has just one. */
+struct lmdb_shards
+{
+	unsigned count;
+	struct lmdb_env env[];
 };
 
 struct libknot_lmdb_env {
@@ -151,6 +166,16 @@ static int txn_get_noresize(struct lmdb_env *env, unsigned int flag, MDB_txn **t
 	return ret;
 }
 
+/** Notice transactions committed by other processes since we last looked. */
+static void env_check_foreign(struct lmdb_env *env)
+{
+	MDB_envinfo info;
+	if (mdb_env_info(env->env, &info) == MDB_SUCCESS && info.me_last_txnid != env->txnid) {
+		env->txnid = info.me_last_txnid;
+		++env->foreign;
+	}
+}
+
 /** Obtain a transaction.  (they're cached in env->txn) */
 static int txn_get(struct lmdb_env *env, MDB_txn **txn, bool rdonly)
 {
@@ -172,6 +197,8 @@ static int txn_get(struct lmdb_env *env, MDB_txn **txn, bool rdonly)
 		}
 		int ret = txn_get_noresize(env, 0/*RW*/, &env->txn.rw);
 		if (ret == MDB_SUCCESS) {
+			/* We hold the writer lock, so the last commit can't move now. */
+			env_check_foreign(env);
 			*txn = env->txn.rw;
 			assert(*txn);
 		}
@@ -200,8 +227,12 @@ static int cdb_commit(knot_db_t *db, struct kr_cdb_stats *stats)
 	int ret = kr_ok();
 	if (env->txn.rw) {
 		stats->commit++;
+		env->commits++;
 		ret = lmdb_error(mdb_txn_commit(env->txn.rw));
 		env->txn.rw = NULL; /* the transaction got freed even in case of errors */
+		if (ret == 0) {
+			++env->txnid; /* ours directly follows the one seen in txn_get() */
+		}
 	} else if (env->txn.ro && env->txn.ro_active) {
 		mdb_txn_reset(env->txn.ro);
 		env->txn.ro_active = false;
@@ -364,24 +395,17 @@ static int cdb_open(struct lmdb_env *env, const char *path, size_t mapsize,
 		return lmdb_error(ret);
 	}
 
+	/* Count commits by others only from now on. */
+	env_check_foreign(env);
+	env->foreign = 0;
 	return 0;
 }
 
-static int cdb_init(knot_db_t **db, struct kr_cdb_stats *stats,
-		struct kr_cdb_opts *opts, knot_mm_t *pool)
+static int env_init(struct lmdb_env *env, const char *path, size_t mapsize,
+		struct kr_cdb_stats *stats)
 {
-	if (!db || !stats || !opts) {
-		return kr_error(EINVAL);
-	}
-
-	struct lmdb_env *env = malloc(sizeof(*env));
-	if (!env) {
-		return kr_error(ENOMEM);
-	}
-	memset(env, 0, sizeof(struct lmdb_env));
-
 	/* Clear stale lockfiles. */
-	auto_free char *lockfile = kr_strcatdup(2, opts->path, "/.cachelock");
+	auto_free char *lockfile = kr_strcatdup(2, path, "/.cachelock");
 	if (lockfile) {
 		if (unlink(lockfile) == 0) {
 			kr_log_info("[cache] cleared stale lockfile '%s'\n", lockfile);
@@ -392,21 +416,184 @@ static int cdb_init(knot_db_t **db, struct kr_cdb_stats *stats,
 	}
 
 	/* Open the database. */
-	int ret = cdb_open(env, opts->path, opts->maxsize, stats);
+	return cdb_open(env, path, mapsize, stats);
+}
+
+static void shards_close(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct lmdb_shards *shards = db;
+	for (unsigned i = 0; i < shards->count; ++i) {
+		if (shards->env[i].env) {
+			cdb_close_env(&shards->env[i], stats);
+		}
+	}
+	free(shards);
+}
+
+/** Name of the file with the number of shards, in the directory of a sharded cache. */
+#define SHARDS_FILE "shards"
+
+int kr_cdb_lmdb_shards(const char *path)
+{
+	auto_free char *fname = kr_strcatdup(3, path, "/", SHARDS_FILE);
+	if (!fname) {
+		return kr_error(ENOMEM);
+	}
+	FILE *f = fopen(fname, "r");
+	if (!f) {
+		return errno == ENOENT ? 1 : kr_error(errno);
+	}
+	unsigned count = 0;
+	const bool ok = fscanf(f, "%u", &count) == 1 && count > 1 && count <= INT_MAX;
+	fclose(f);
+	return ok ? count : kr_error(EILSEQ);
+}
+
+/** Record the number of shards; the file appears atomically, complete. */
+static int shards_file_write(const char *path, unsigned count)
+{
+	char tmp[strlen(path) + sizeof(SHARDS_FILE) + 24];
+	snprintf(tmp, sizeof(tmp), "%s/" SHARDS_FILE ".%d", path, (int)getpid());
+	FILE *f = fopen(tmp, "w");
+	if (!f) {
+		return kr_error(errno);
+	}
+	const bool ok = fprintf(f, "%u\n", count) > 0;
+	int ret = fclose(f) == 0 && ok ? 0 : kr_error(EIO);
+	if (ret == 0) {
+		auto_free char *fname = kr_strcatdup(3, path, "/", SHARDS_FILE);
+		ret = !fname ? kr_error(ENOMEM)
+			: link(tmp, fname) == 0 ? 0 : kr_error(errno);
+	}
+	unlink(tmp);
+	return ret;
+}
+
+/** Check that the cache in path wasn't created with another number of shards,
+ * and record the number for a new sharded cache.  Records would get lost
+ * or duplicated in wrong shards otherwise. */
+static int shards_check(const char *path, unsigned count)
+{
+	int found = kr_cdb_lmdb_shards(path);
+	if (found == 1 && count > 1) {
+		/* Either a new directory or an unsharded cache. */
+		auto_free char *data = kr_strcatdup(2, path, "/data.mdb");
+		struct stat st;
+		if (!data) {
+			return kr_error(ENOMEM);
+		}
+		if (stat(data, &st) == 0) {
+			found = 0;
+		} else {
+			int ret = shards_file_write(path, count);
+			/* Possibly another instance has just written it. */
+			found = ret == kr_error(EEXIST) ? kr_cdb_lmdb_shards(path)
+				: ret ? ret : count;
+		}
+	}
+	if (found < 0) {
+		kr_log_error("[cache] failed to read number of shards in %s: %s\n",
+				path, kr_strerror(found));
+		return found;
+	}
+	if (found != count && !(found == 0 && count == 1)) {
+		kr_log_error("[cache] %s holds a cache with a different number of shards "
+				"(%d, not %u); remove it or open it with the same number\n",
+				path, found ? found : 1, count);
+		return kr_error(EINVAL);
+	}
+	return kr_ok();
+}
+
+static int shards_open(knot_db_t **db, struct kr_cdb_stats *stats,
+		struct kr_cdb_opts *opts, knot_mm_t *pool)
+{
+	if (!db || !stats || !opts) {
+		return kr_error(EINVAL);
+	}
+
+	const unsigned count = opts->shards > 1 ? opts->shards : 1;
+	struct lmdb_shards *shards = calloc(1, sizeof(*shards)
+						+ count * sizeof(shards->env[0]));
+	if (!shards) {
+		return kr_error(ENOMEM);
+	}
+	shards->count = count;
+
+	if (count == 1) {
+		int ret = shards_check(opts->path, count);
+		if (ret != 0) {
+			free(shards);
+			return ret;
+		}
+		ret = env_init(&shards->env[0], opts->path, opts->maxsize, stats);
+		if (ret != 0) {
+			free(shards);
+			return ret;
+		}
+		*db = shards;
+		return 0;
+	}
+
+	/* Shards live in subdirectories and split the size evenly. */
+	if (mkdir(opts->path, LMDB_DIR_MODE) == -1 && errno != EEXIST) {
+		free(shards);
+		return kr_error(errno);
+	}
+	int ret = shards_check(opts->path, count);
 	if (ret != 0) {
-		free(env);
+		free(shards);
 		return ret;
 	}
-
-	*db = env;
+	for (unsigned i = 0; i < count; ++i) {
+		char path[strlen(opts->path) + 20];
+		snprintf(path, sizeof(path), "%s/shard-%u", opts->path, i);
+		ret = env_init(&shards->env[i], path, opts->maxsize / count, stats);
+		if (ret != 0) {
+			shards_close(shards, stats);
+			return ret;
+		}
+	}
+	*db = shards;
 	return 0;
 }
 
-static void cdb_deinit(knot_db_t *db, struct kr_cdb_stats *stats)
+/** Return the length of the name that key starts with, or -1.
+ *
+ * CACHE_KEY_DEF: keys start with the name in lookup format terminated by
+ * two zero bytes (just one for the root), and all NSEC* keys of a zone start
+ * with the zone's name.  Only special keys like "VERS" have no name.
+ */
+static int key_name_len(const knot_db_val_t *key)
 {
-	struct lmdb_env *env = db;
-	cdb_close_env(env, stats);
-	free(env);
+	const uint8_t *k = key->data;
+	if (key->len > 0 && k[0] == 0) {
+		return 0;
+	}
+	for (size_t i = 0; i + 1 < key->len; ++i) {
+		if (k[i] == 0 && k[i + 1] == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/** Return the environment where key belongs.
+ *
+ * Keys are distributed by hash of their name, so the ranges searched
+ * by read_leq() stay within one shard.  Keys without a name are kept
+ * in every shard, so that each is a complete cache for kres-cache-gc.
+ */
+static struct lmdb_env *shard_of(struct lmdb_shards *shards, const knot_db_val_t *key)
+{
+	if (shards->count == 1) {
+		return &shards->env[0];
+	}
+	const int len = key_name_len(key);
+	if (len < 0) {
+		return &shards->env[0];
+	}
+	return &shards->env[hash((const char *)key->data, len) % shards->count];
 }
 
 static int cdb_count(knot_db_t *db, struct kr_cdb_stats *stats)
@@ -714,6 +901,84 @@ static int cdb_read_leq(knot_db_t *env, struct kr_cdb_stats *stats,
 	return ret;
 }
 
+/** Length of the common prefix of a and b. */
+static int common_len(const MDB_val *a, const knot_db_val_t *b)
+{
+	const uint8_t *ad = a->mv_data, *bd = b->data;
+	const size_t len = a->mv_size < b->len ? a->mv_size : b->len;
+	size_t i = 0;
+	while (i < len && ad[i] == bd[i]) {
+		++i;
+	}
+	return i;
+}
+
+static int cdb_prefix_len(struct lmdb_env *env, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key)
+{
+	assert(env && key && key->data);
+	MDB_cursor *curs = NULL;
+	int ret = txn_curs_get(env, &curs, stats);
+	if (ret) return ret;
+
+	/* All keys with a prefix of key form a range around it,
+	 * so the nearest keys on both sides have the longest ones. */
+	MDB_val key_m = val_knot2mdb(*key);
+	MDB_val val_m = { 0, NULL };
+	int len = 0;
+	stats->read_leq++;
+	ret = mdb_cursor_get(curs, &key_m, &val_m, MDB_SET_RANGE);
+	if (ret == MDB_SUCCESS) {
+		len = common_len(&key_m, key);
+		ret = mdb_cursor_get(curs, &key_m, &val_m, MDB_PREV);
+	} else if (ret == MDB_NOTFOUND) {
+		ret = mdb_cursor_get(curs, &key_m, &val_m, MDB_LAST);
+	}
+	if (ret == MDB_SUCCESS) {
+		const int len_prev = common_len(&key_m, key);
+		len = len_prev > len ? len_prev : len;
+	} else if (ret != MDB_NOTFOUND) {
+		return lmdb_error(ret);
+	}
+	if (len == 0) {
+		stats->read_leq_miss++;
+	}
+	return len;
+}
+
+static int cdb_apply(struct lmdb_env *env, struct kr_cdb_stats *stats,
+		int (*f)(const knot_db_val_t *key, const knot_db_val_t *val, void *baton),
+		void *baton)
+{
+	MDB_txn *txn = NULL;
+	int ret = txn_get(env, &txn, true);
+	if (ret != 0) {
+		return ret;
+	}
+	MDB_cursor *cur = NULL;
+	ret = mdb_cursor_open(txn, env->dbi, &cur);
+	if (ret != 0) {
+		return lmdb_error(ret);
+	}
+
+	MDB_val cur_key = { 0, NULL };
+	MDB_val cur_val = { 0, NULL };
+	stats->match++;
+	ret = mdb_cursor_get(cur, &cur_key, &cur_val, MDB_FIRST);
+	while (ret == MDB_SUCCESS) {
+		const knot_db_val_t key = val_mdb2knot(cur_key);
+		const knot_db_val_t val = val_mdb2knot(cur_val);
+		int ret_f = f(&key, &val, baton);
+		if (ret_f) {
+			mdb_cursor_close(cur);
+			return ret_f;
+		}
+		ret = mdb_cursor_get(cur, &cur_key, &cur_val, MDB_NEXT);
+	}
+	mdb_cursor_close(cur);
+	return ret == MDB_NOTFOUND ? kr_ok() : lmdb_error(ret);
+}
+
 static double cdb_usage(knot_db_t *db)
 {
 	const size_t db_size = knot_db_lmdb_get_mapsize(db);
@@ -724,11 +989,216 @@ static double cdb_usage(knot_db_t *db)
 }
 
 
+/* Operations on the whole (possibly sharded) cache follow. */
+
+static int shards_count(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct lmdb_shards *shards = db;
+	int count = 0;
+	for (unsigned i = 0; i < shards->count; ++i) {
+		int ret = cdb_count(&shards->env[i], stats);
+		if (ret < 0) {
+			return ret;
+		}
+		/* Count the replicated version key just once. */
+		count += i == 0 ? ret : MAX(ret - 1, 0);
+	}
+	return count;
+}
+
+static int shards_clear(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct lmdb_shards *shards = db;
+	int ret = kr_ok();
+	for (unsigned i = 0; i < shards->count; ++i) {
+		int r = cdb_clear(&shards->env[i], stats);
+		ret = ret ? ret : r;
+	}
+	return ret;
+}
+
+static int shards_commit(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct lmdb_shards *shards = db;
+	int ret = kr_ok();
+	for (unsigned i = 0; i < shards->count; ++i) {
+		int r = cdb_commit(&shards->env[i], stats);
+		ret = ret ? ret : r;
+	}
+	return ret;
+}
+
+static int shards_readv(knot_db_t *db, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key, knot_db_val_t *val, int maxcount)
+{
+	struct lmdb_shards *shards = db;
+	for (int i = 0; i < maxcount; ++i) {
+		int ret = cdb_readv(shard_of(shards, &key[i]), stats, &key[i], &val[i], 1);
+		if (ret) {
+			return ret;
+		}
+	}
+	return kr_ok();
+}
+
+/** Prepare the shard env for writing and return it.
+ *
+ * RW transactions stay open in all the shards written to, until shards_commit().
+ * Processes could deadlock on writer locks of two shards taken in different order,
+ * so they're only taken in ascending order: the writes to shards after this one
+ * get committed first. */
+static struct lmdb_env *shard_for_write(struct lmdb_shards *shards,
+		struct kr_cdb_stats *stats, struct lmdb_env *env)
+{
+	if (env->txn.rw) {
+		return env;
+	}
+	for (unsigned i = env - shards->env + 1; i < shards->count; ++i) {
+		if (shards->env[i].txn.rw) {
+			(void)cdb_commit(&shards->env[i], stats);
+		}
+	}
+	return env;
+}
+
+static int shards_writev(knot_db_t *db, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key, knot_db_val_t *val, int maxcount)
+{
+	struct lmdb_shards *shards = db;
+	for (int i = 0; i < maxcount; ++i) {
+		const knot_db_val_t val_orig = val[i];
+		struct lmdb_env *env = shard_for_write(shards, stats, shard_of(shards, &key[i]));
+		int ret = cdb_writev(env, stats, &key[i], &val[i], 1);
+		/* Replicate keys without a name, e.g. "VERS". */
+		const bool replicate = shards->count > 1 && key_name_len(&key[i]) < 0;
+		for (unsigned j = 1; replicate && ret == 0 && j < shards->count; ++j) {
+			knot_db_val_t v = val_orig;
+			env = shard_for_write(shards, stats, &shards->env[j]);
+			ret = cdb_writev(env, stats, &key[i], &v, 1);
+		}
+		if (ret) {
+			return ret;
+		}
+	}
+	return kr_ok();
+}
+
+static int shards_remove(knot_db_t *db, struct kr_cdb_stats *stats,
+		knot_db_val_t keys[], int maxcount)
+{
+	struct lmdb_shards *shards = db;
+	int deleted = 0;
+	for (int i = 0; i < maxcount; ++i) {
+		struct lmdb_env *env = shard_for_write(shards, stats, shard_of(shards, &keys[i]));
+		int ret = cdb_remove(env, stats, &keys[i], 1);
+		if (ret < 0) {
+			return ret;
+		}
+		deleted += ret;
+	}
+	return deleted;
+}
+
+/** Prefix match has to look into all shards, as names below the prefix are spread. */
+static int shards_match(knot_db_t *db, struct kr_cdb_stats *stats,
+		knot_db_val_t *key, knot_db_val_t keyval[][2], int maxcount)
+{
+	struct lmdb_shards *shards = db;
+	if (shards->count == 1) {
+		return cdb_match(&shards->env[0], stats, key, keyval, maxcount);
+	}
+	int results = 0;
+	for (unsigned i = 0; i < shards->count && results < maxcount; ++i) {
+		int ret = cdb_match(&shards->env[i], stats, key,
+				    keyval + results, maxcount - results);
+		if (ret < 0 && ret != kr_error(ENOENT)) {
+			return ret;
+		}
+		results += MAX(ret, 0);
+	}
+	return results;
+}
+
+static int shards_read_leq(knot_db_t *db, struct kr_cdb_stats *stats,
+		knot_db_val_t *key, knot_db_val_t *val)
+{
+	assert(db && key && key->data && val);
+	return cdb_read_leq(shard_of(db, key), stats, key, val);
+}
+
+static int shards_apply(knot_db_t *db, struct kr_cdb_stats *stats,
+		int (*f)(const knot_db_val_t *key, const knot_db_val_t *val, void *baton),
+		void *baton)
+{
+	struct lmdb_shards *shards = db;
+	for (unsigned i = 0; i < shards->count; ++i) {
+		int ret = cdb_apply(&shards->env[i], stats, f, baton);
+		if (ret) {
+			return ret;
+		}
+	}
+	return kr_ok();
+}
+
+static int shards_prefix_len(knot_db_t *db, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key)
+{
+	/* Keys with different names may be in any of the shards. */
+	struct lmdb_shards *shards = db;
+	int len = 0;
+	for (unsigned i = 0; i < shards->count; ++i) {
+		int ret = cdb_prefix_len(&shards->env[i], stats, key);
+		if (ret < 0) {
+			return ret;
+		}
+		len = ret > len ? ret : len;
+	}
+	return len;
+}
+
+static uint64_t shards_foreign_changes(knot_db_t *db)
+{
+	struct lmdb_shards *shards = db;
+	uint64_t changes = 0;
+	for (unsigned i = 0; i < shards->count; ++i) {
+		env_check_foreign(&shards->env[i]);
+		changes += shards->env[i].foreign;
+	}
+	return changes;
+}
+
+static double env_usage(struct lmdb_env *env)
+{
+	struct libknot_lmdb_env libknot_db = {
+		.shared = false,
+		.dbi = env->dbi,
+		.env = env->env,
+		.pool = NULL,
+	};
+	return cdb_usage(&libknot_db);
+}
+
+static int shard_stats(knot_db_t *db, unsigned i, struct kr_cdb_shard_stats *stats)
+{
+	struct lmdb_shards *shards = db;
+	if (i >= shards->count) {
+		return kr_error(ENOENT);
+	}
+	struct lmdb_env *env = &shards->env[i];
+	struct kr_cdb_stats ignored = { 0 };
+	const int entries = cdb_count(env, &ignored);
+	stats->entries = entries > 0 ? entries : 0;
+	stats->commit = env->commits;
+	stats->usage_percent = env_usage(env);
+	return kr_ok();
+}
+
 /** Conversion between knot and lmdb structs. */
 knot_db_t *knot_db_t_kres2libknot(const knot_db_t * db)
 {
-	/* this is struct lmdb_env as in resolver/cdb_lmdb.c */
-	const struct lmdb_env *kres_db = db;
+	/* this is struct lmdb_shards as in resolver/cdb_lmdb.c;
+	 * only the first shard is converted */
+	const struct lmdb_env *kres_db = &((const struct lmdb_shards *)db)->env[0];
 	struct libknot_lmdb_env *libknot_db = malloc(sizeof(*libknot_db));
 	if (libknot_db != NULL) {
 		libknot_db->shared = false;
@@ -743,11 +1213,15 @@ const struct kr_cdb_api *kr_cdb_lmdb(void)
 {
 	static const struct kr_cdb_api api = {
 		"lmdb",
-		cdb_init, cdb_deinit, cdb_count, cdb_clear, cdb_commit,
-		cdb_readv, cdb_writev, cdb_remove,
-		cdb_match,
-		cdb_read_leq,
+		shards_open, shards_close, shards_count, shards_clear, shards_commit,
+		shards_readv, shards_writev, shards_remove,
+		shards_match,
+		shards_read_leq,
 		cdb_usage,
+		shard_stats,
+		shards_apply,
+		shards_prefix_len,
+		shards_foreign_changes,
 	};
 
 	return &api;
@@ -12,3 +12,8 @@ const struct kr_cdb_api *kr_cdb_lmdb(void);
 
 KR_EXPORT
 knot_db_t *knot_db_t_kres2libknot(const knot_db_t * db);
+
+/** Return the number of shards of the LMDB cache in path, as recorded in it
+ * when it was created sharded; 1 for an unsharded or missing cache. */
+KR_EXPORT
+int kr_cdb_lmdb_shards(const char *path);
@@ -0,0 +1,379 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+/** @file
+ * Cache backend living only in the memory of the process.
+ *
+ * Keys are kept in a qp-trie, which serves exact lookups as well as the
+ * ordered read_leq() and match() operations.  Memory is bounded by the size
+ * passed to open(); when it's exhausted, entries are evicted by the CLOCK
+ * algorithm: each read sets a reference bit and the hand sweeping through
+ * all entries clears it, evicting the first entry found without it.
+ *
+ * Callers may keep using the values until the next commit, same as with LMDB,
+ * so removed and overwritten entries are only freed by commit.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/cache/cdb_memory.h"
+#include "lib/generic/array.h"
+#include "lib/generic/trie.h"
+#include "lib/utils.h"
+
+struct mem_entry {
+	uint32_t key_len;
+	uint32_t val_len;
+	uint32_t clock_idx; /**< position in mem_env::clock */
+	bool referenced;    /**< read since the hand passed it */
+	/** Value aligned to pointer size, followed by the key. */
+	uint8_t data[] __attribute__((aligned(sizeof(void *))));
+};
+
+struct mem_env {
+	trie_t *trie;            /**< key -> struct mem_entry */
+	array_t(struct mem_entry *) clock; /**< all entries in the trie */
+	uint32_t hand;           /**< next position of the CLOCK hand */
+	array_t(struct mem_entry *) dead; /**< to be freed on commit */
+	size_t used;             /**< bytes accounted to live entries */
+	size_t maxsize;
+	bool dirty;              /**< modified since last commit */
+};
+
+/** Rough per-entry overhead of the trie and the clock array. */
+#define MEM_ENTRY_OVERHEAD (4 * sizeof(void *))
+
+static size_t entry_size(uint32_t key_len, uint32_t val_len)
+{
+	return sizeof(struct mem_entry) + val_len + key_len + MEM_ENTRY_OVERHEAD;
+}
+
+static inline uint8_t *entry_key(struct mem_entry *e)
+{
+	return e->data + e->val_len;
+}
+
+static inline knot_db_val_t entry_val(struct mem_entry *e)
+{
+	return (knot_db_val_t){ .data = e->data, .len = e->val_len };
+}
+
+/** Take the entry out of accounting and the clock; it must be out of the trie already. */
+static int entry_retire(struct mem_env *env, struct mem_entry *e)
+{
+	struct mem_entry *last = env->clock.at[env->clock.len - 1];
+	env->clock.at[e->clock_idx] = last;
+	last->clock_idx = e->clock_idx;
+	--env->clock.len;
+	env->used -= entry_size(e->key_len, e->val_len);
+	env->dirty = true;
+	return array_push(env->dead, e) < 0 ? kr_error(ENOMEM) : kr_ok();
+}
+
+/** Evict entries until size more bytes fit. */
+static int evict(struct mem_env *env, size_t size)
+{
+	while (env->used + size > env->maxsize && env->clock.len > 0) {
+		if (env->hand >= env->clock.len) {
+			env->hand = 0;
+		}
+		struct mem_entry *e = env->clock.at[env->hand];
+		if (e->referenced) {
+			e->referenced = false;
+			++env->hand;
+			continue;
+		}
+		trie_del(env->trie, (const char *)entry_key(e), e->key_len, NULL);
+		int ret = entry_retire(env, e);
+		if (ret) {
+			return ret;
+		}
+		/* The newest entry got moved under the hand; give it a chance. */
+		++env->hand;
+	}
+	return kr_ok();
+}
+
+static void free_dead(struct mem_env *env)
+{
+	for (size_t i = 0; i < env->dead.len; ++i) {
+		free(env->dead.at[i]);
+	}
+	env->dead.len = 0;
+}
+
+static int cdb_init(knot_db_t **db, struct kr_cdb_stats *stats,
+		struct kr_cdb_opts *opts, knot_mm_t *pool)
+{
+	if (!db || !stats || !opts) {
+		return kr_error(EINVAL);
+	}
+	struct mem_env *env = calloc(1, sizeof(*env));
+	if (!env) {
+		return kr_error(ENOMEM);
+	}
+	env->trie = trie_create(NULL);
+	if (!env->trie) {
+		free(env);
+		return kr_error(ENOMEM);
+	}
+	env->maxsize = opts->maxsize;
+	stats->open++;
+	*db = env;
+	return kr_ok();
+}
+
+static int free_entry(trie_val_t *val, void *baton)
+{
+	free(*val);
+	return 0;
+}
+
+static void cdb_deinit(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct mem_env *env = db;
+	stats->close++;
+	trie_apply(env->trie, free_entry, NULL);
+	trie_free(env->trie);
+	free_dead(env);
+	array_clear(env->clock);
+	array_clear(env->dead);
+	free(env);
+}
+
+static int cdb_count(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct mem_env *env = db;
+	stats->count++;
+	return trie_weight(env->trie);
+}
+
+static int cdb_clear(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct mem_env *env = db;
+	stats->clear++;
+	free_dead(env);
+	trie_apply(env->trie, free_entry, NULL);
+	trie_clear(env->trie);
+	env->clock.len = 0;
+	env->hand = 0;
+	env->used = 0;
+	env->dirty = false;
+	return kr_ok();
+}
+
+static int cdb_commit(knot_db_t *db, struct kr_cdb_stats *stats)
+{
+	struct mem_env *env = db;
+	if (env->dirty) {
+		stats->commit++;
+		env->dirty = false;
+	}
+	free_dead(env);
+	return kr_ok();
+}
+
+static int cdb_readv(knot_db_t *db, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key, knot_db_val_t *val, int maxcount)
+{
+	struct mem_env *env = db;
+	for (int i = 0; i < maxcount; ++i) {
+		stats->read++;
+		trie_val_t *v = trie_get_try(env->trie, key[i].data, key[i].len);
+		if (!v) {
+			stats->read_miss++;
+			return kr_error(ENOENT);
+		}
+		struct mem_entry *e = *v;
+		e->referenced = true;
+		val[i] = entry_val(e);
+	}
+	return kr_ok();
+}
+
+static int cdb_write(struct mem_env *env, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key, knot_db_val_t *val)
+{
+	stats->write++;
+	const size_t size = entry_size(key->len, val->len);
+	if (size > env->maxsize) {
+		return kr_error(EFBIG);
+	}
+	/* Evict first; modifying the trie invalidates pointers into it. */
+	int ret = evict(env, size);
+	if (ret) {
+		return ret;
+	}
+	struct mem_entry *e = malloc(sizeof(*e) + val->len + key->len);
+	if (!e) {
+		return kr_error(ENOMEM);
+	}
+	e->key_len = key->len;
+	e->val_len = val->len;
+	e->referenced = false;
+	memcpy(entry_key(e), key->data, key->len);
+	/* NULL data with non-zero length reserves space for the caller, like in LMDB. */
+	if (val->data) {
+		memcpy(e->data, val->data, val->len);
+	}
+
+	trie_val_t *v = trie_get_ins(env->trie, key->data, key->len);
+	if (!v) {
+		free(e);
+		return kr_error(ENOMEM);
+	}
+	struct mem_entry *old = *v;
+	if (old) {
+		e->clock_idx = old->clock_idx;
+		env->clock.at[e->clock_idx] = e;
+		env->used -= entry_size(old->key_len, old->val_len);
+		if (array_push(env->dead, old) < 0) {
+			free(old); /* nothing better to do */
+		}
+	} else {
+		e->clock_idx = env->clock.len;
+		if (array_push(env->clock, e) < 0) {
+			trie_del(env->trie, key->data, key->len, NULL);
+			free(e);
+			return kr_error(ENOMEM);
+		}
+	}
+	*v = e;
+	env->used += size;
+	env->dirty = true;
+	*val = entry_val(e);
+	return kr_ok();
+}
+
+static int cdb_writev(knot_db_t *db, struct kr_cdb_stats *stats,
+		const knot_db_val_t *key, knot_db_val_t *val, int maxcount)
+{
+	struct mem_env *env = db;
+	int ret = kr_ok();
+	for (int i = 0; ret == kr_ok() && i < maxcount; ++i) {
+		ret = cdb_write(env, stats, &key[i], &val[i]);
+	}
+	return ret;
+}
+
+static int cdb_remove(knot_db_t *db, struct kr_cdb_stats *stats,
+		knot_db_val_t keys[], int maxcount)
+{
+	struct mem_env *env = db;
+	int deleted = 0;
+	for (int i = 0; i < maxcount; ++i) {
+		stats->remove++;
+		trie_val_t val;
+		if (trie_del(env->trie, keys[i].data, keys[i].len, &val) != 0) {
+			stats->remove_miss++;
+			continue;
+		}
+		int ret = entry_retire(env, val);
+		if (ret) {
+			return ret;
+		}
+		deleted++;
+	}
+	return deleted;
+}
+
+static int cdb_match(knot_db_t *db, struct kr_cdb_stats *stats,
+		knot_db_val_t *key, knot_db_val_t keyval[][2], int maxcount)
+{
+	struct mem_env *env = db;
+	/* Keys with the prefix form a range starting at the prefix itself. */
+	trie_it_t *it = trie_it_begin_geq(env->trie, key->data, key->len);
+	if (!it) {
+		return kr_error(ENOMEM);
+	}
+	stats->match++;
+	int results = 0;
+	for (; !trie_it_finished(it) && results < maxcount; trie_it_next(it)) {
+		size_t len;
+		const char *k = trie_it_key(it, &len);
+		if (len < key->len || memcmp(k, key->data, key->len) != 0) {
+			break; /* past all keys with the prefix */
+		}
+		struct mem_entry *e = *trie_it_val(it);
+		keyval[results][0] = (knot_db_val_t){ .data = entry_key(e), .len = e->key_len };
+		keyval[results][1] = entry_val(e);
+		++results;
+	}
+	trie_it_free(it);
+	if (results == 0)
+		stats->match_miss++;
+	return results;
+}
+
+static int cdb_read_leq(knot_db_t *db, struct kr_cdb_stats *stats,
+		knot_db_val_t *key, knot_db_val_t *val)
+{
+	assert(db && key && key->data && val);
+	struct mem_env *env = db;
+	trie_val_t *v = NULL;
+	stats->read_leq++;
+	int ret = trie_get_leq(env->trie, key->data, key->len, &v);
+	if (ret < 0 || !v) {
+		stats->read_leq_miss++;
+		return ret < 0 ? ret : kr_error(ENOENT);
+	}
+	if (ret > 0) {
+		stats->read_leq_miss++;
+	}
+	struct mem_entry *e = *v;
+	e->referenced = true;
+	*key = (knot_db_val_t){ .data = entry_key(e), .len = e->key_len };
+	*val = entry_val(e);
+	return ret;
+}
+
+struct apply_ctx {
+	int (*f)(const knot_db_val_t *key, const knot_db_val_t *val, void *baton);
+	void *baton;
+};
+
+static int apply_entry(trie_val_t *v, void *baton)
+{
+	struct apply_ctx *ctx = baton;
+	struct mem_entry *e = *v;
+	const knot_db_val_t key = { .data = entry_key(e), .len = e->key_len };
+	const knot_db_val_t val = entry_val(e);
+	return ctx->f(&key, &val, ctx->baton);
+}
+
+static int cdb_apply(knot_db_t *db, struct kr_cdb_stats *stats,
+		int (*f)(const knot_db_val_t *key, const knot_db_val_t *val, void *baton),
+		void *baton)
+{
+	struct mem_env *env = db;
+	struct apply_ctx ctx = { .f = f, .baton = baton };
+	stats->match++;
+	return trie_apply(env->trie, apply_entry, &ctx);
+}
+
+static double cdb_usage(knot_db_t *db)
+{
+	struct mem_env *env = db;
+	return (double)env->used / env->maxsize * 100.0;
+}
+
+const struct kr_cdb_api *kr_cdb_memory(void)
+{
+	static const struct kr_cdb_api api = {
+		"memory",
+		cdb_init, cdb_deinit, cdb_count, cdb_clear, cdb_commit,
+		cdb_readv, cdb_writev, cdb_remove,
+		cdb_match,
+		cdb_read_leq,
+		cdb_usage,
+		NULL,
+		cdb_apply,
+		NULL,
+		NULL,
+	};
+
+	return &api;
+}
@@ -0,0 +1,12 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#pragma once
+
+#include "lib/cache/cdb_api.h"
+#include "lib/defines.h"
+
+/** Cache backend kept in process memory only; selected by the memory:// URI. */
+KR_EXPORT KR_CONST
+const struct kr_cdb_api *kr_cdb_memory(void);
@@ -166,7 +166,7 @@ int entry_h_seek(knot_db_val_t *val, uint16_t type)
 static int cache_write_or_clear(struct kr_cache *cache, const knot_db_val_t *key,
 				knot_db_val_t *val, const struct kr_query *qry)
 {
-	int ret = cache_op(cache, write, key, val, 1);
+	int ret = cache_write(cache, key, val);
 	if (!ret) return kr_ok();
 	/* Clear cache if overfull.  It's nontrivial to do better with LMDB.
 	 * LATER: some garbage-collection mechanism. */
@@ -186,6 +186,34 @@ static int cache_write_or_clear(struct kr_cache *cache, const knot_db_val_t *key
 }
 
 
+/* See the header file. */
+void entry_h_hit(struct kr_cache *cache, knot_db_val_t key, knot_db_val_t val,
+		 knot_mm_t *mm)
+{
+	const struct entry_h *eh = val.data;
+	const uint8_t hits = eh->hits;
+	if (hits >= ENTRY_H_HITS_MAX
+	    || kr_rand_bytes(3) & ((1 << (hits + ENTRY_H_HITS_SAMPLE)) - 1)) {
+		return;
+	}
+	/* Another process may have rewritten the entry since our read,
+	 * so re-read it in the write transaction and bump just the counter
+	 * of the current contents; skip it if the counter moved meanwhile. */
+	knot_db_val_t val_cur = { NULL, 0 };
+	if (cache_read_rmw(cache, &key, &val_cur) || val_cur.len < sizeof(*eh)
+	    || ((const struct entry_h *)val_cur.data)->hits != hits) {
+		return;
+	}
+	/* The value in DB may change or move by the write, so copy it. */
+	knot_db_val_t val_new = { .data = mm_alloc(mm, val_cur.len), .len = val_cur.len };
+	if (!val_new.data) {
+		return;
+	}
+	memcpy(val_new.data, val_cur.data, val_cur.len);
+	((struct entry_h *)val_new.data)->hits = hits + 1;
+	(void)cache_write(cache, &key, &val_new);
+}
+
 /* See the header file. */
 int entry_h_splice(
 	knot_db_val_t *val_new_entry, uint8_t rank,
@@ -214,7 +242,7 @@ int entry_h_splice(
 	int ret = -1;
 	if (!kr_rank_test(rank, KR_RANK_SECURE) || ktype == KNOT_RRTYPE_NS) {
 		knot_db_val_t val;
-		ret = cache_op(cache, read, &key, &val, 1);
+		ret = cache_read_rmw(cache, &key, &val);
 		if (i_type) {
 			if (!ret) ret = entry_list_parse(val, el);
 			if (ret) memset(el, 0, sizeof(el));
@@ -43,11 +43,21 @@ struct entry_h {
 	uint8_t  rank : 6;	/**< See enum kr_rank */
 	bool is_packet : 1;	/**< Negative-answer packet for insecure/bogus name. */
 	bool has_optout : 1;	/**< Only for packets; persisted DNSSEC_OPTOUT. */
-	uint8_t _pad;		/**< We need even alignment for data now. */
+	/** Approximate log2 of reads since stored; see entry_h_hit().
+	 * It also keeps even alignment for data; older versions left it zero. */
+	uint8_t hits;
 	uint8_t data[];
 };
 struct entry_apex;
 
+/** Header of infrastructure records (see enum kr_cache_infra_tag);
+ * the fixed-size data follow.  CACHE_KEY_DEF */
+struct infra_h {
+	uint32_t time;	/**< The time of the write. */
+	uint32_t ttl;	/**< KR_CACHE_INFRA_TTL at the time of the write. */
+	uint8_t data[];
+};
+
 /** Check basic consistency of entry_h for 'E' entries, not looking into ->data.
  * (for is_packet the length of data is checked)
  */
@@ -56,6 +66,22 @@ struct entry_h * entry_h_consistent_E(knot_db_val_t data, uint16_t type);
 
 struct entry_apex * entry_apex_consistent(knot_db_val_t val);
 
+/** Upper bound on entry_h::hits */
+#define ENTRY_H_HITS_MAX 15
+/** log2 of the number of reads per increment of entry_h::hits from zero */
+#define ENTRY_H_HITS_SAMPLE 4
+
+/** Count a read of an 'E' entry (not an entry_apex) in its entry_h::hits.
+ * To keep writes rare, the counter is incremented with probability
+ * 2^-(hits + ENTRY_H_HITS_SAMPLE), i.e. it approximates log2 of the number
+ * of reads, minus ENTRY_H_HITS_SAMPLE.  Any rewrite of the entry,
+ * e.g. when refreshing it after expiry, starts from zero again.
+ * The entry is re-read for the write, so that only the counter changes.
+ * Failed writes are ignored; in particular a full cache isn't cleared here.
+ * \param val the whole value as read; mm allocates the copy to write */
+void entry_h_hit(struct kr_cache *cache, knot_db_val_t key, knot_db_val_t val,
+		 knot_mm_t *mm);
+
 /** Consistency check, ATM common for NSEC and NSEC3. */
 static inline struct entry_h * entry_h_consistent_NSEC(knot_db_val_t data)
 {
@@ -404,6 +430,27 @@ int nsec3_src_synth(struct key *k, struct answer *ans, const knot_dname_t *clenc
 /** Shorthand for operations on cache backend */
 #define cache_op(cache, op, ...) (cache)->api->op((cache)->db, &(cache)->stats, ## __VA_ARGS__)
 
+/** Read a single key, through the L1 cache if enabled; see l1.c */
+int cache_read(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val);
+/** Read a single key bypassing L1, for values that are modified and written back.
+ * Pending writes are still seen. */
+int cache_read_rmw(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val);
+/** Write a single key, like cache_op(cache, write, ...), dropping it from L1. */
+int cache_write(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val);
+/** Values read through L1 before this point may be replaced from now on. */
+void cache_l1_commit(struct kr_cache *cache);
+
+/** Read a key from pending writes; kr_error(ENOENT) if it's not there; see write_back.c */
+int cache_pending_read(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val);
+/** Add a write to pending ones, possibly reserving space like LMDB. */
+int cache_pending_write(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val);
+/** Free replaced values and flush if too many writes are pending. */
+void cache_pending_commit(struct kr_cache *cache);
+/** Forget all pending writes. */
+void cache_pending_drop(struct kr_cache *cache);
+/** Return true if no writes are pending, so the backend has all records. */
+bool cache_pending_empty(const struct kr_cache *cache);
+
 
 static inline uint16_t get_uint16(const void *address)
 {
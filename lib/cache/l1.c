@@ -0,0 +1,200 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/** @file
+ * Small in-memory cache of exact-key reads in front of the cache backend.
+ *
+ * It is a two-way set-associative table of fixed-size slots holding copies
+ * of the values.  Callers may use values until kr_cache_commit(), same as
+ * with LMDB, so a slot handed out in the current "epoch" is never replaced;
+ * removals only mark slots empty and leave the data in place.
+ *
+ * With write-back enabled, reads look into pending writes first; see write_back.c
+ *
+ * L1 is private to the process.  Writes of other processes into a shared backend
+ * are noticed by kr_cdb_api::foreign_changes, checked once per epoch, and then
+ * all slots are dropped; LMDB's read transaction is as old as the epoch anyway.
+ * Read-modify-write paths use cache_read_rmw() to bypass L1 regardless.
+ */
+
+#include "lib/cache/impl.h"
+
+/** Larger values are always read from the backend. */
+#define L1_VAL_MAXLEN 1024
+
+struct l1_slot {
+	uint32_t hash;
+	uint32_t epoch;   /**< l1->epoch when last used */
+	uint32_t stamp;   /**< l1->stamp when filled; the slot is empty if it differs */
+	uint16_t key_len; /**< 0 for an empty slot */
+	uint16_t val_len;
+	uint8_t key[KR_CACHE_KEY_MAXLEN];
+	uint8_t val[L1_VAL_MAXLEN];
+};
+
+struct kr_cache_l1 {
+	uint32_t mask;       /**< number of sets - 1 */
+	uint32_t epoch;      /**< incremented on each commit */
+	uint32_t stamp;      /**< incremented to drop all slots at once */
+	uint32_t generation; /**< kr_cache::generation the slots come from */
+	uint32_t checked;    /**< epoch when foreign changes were last checked */
+	uint64_t foreign;    /**< kr_cdb_api::foreign_changes seen then */
+	struct l1_slot slots[]; /**< two per set */
+};
+
+int kr_cache_l1_set(struct kr_cache *cache, unsigned slots)
+{
+	if (!cache) {
+		return kr_error(EINVAL);
+	}
+	free(cache->l1);
+	cache->l1 = NULL;
+	if (slots == 0) {
+		return kr_ok();
+	}
+	if (slots > (1 << 24)) {
+		return kr_error(EINVAL);
+	}
+	uint32_t sets = 1;
+	while (2 * sets < slots) {
+		sets *= 2;
+	}
+	struct kr_cache_l1 *l1 = calloc(1, sizeof(*l1) + 2 * sets * sizeof(l1->slots[0]));
+	if (!l1) {
+		return kr_error(ENOMEM);
+	}
+	l1->mask = sets - 1;
+	l1->epoch = 1;
+	l1->stamp = 1;
+	l1->generation = cache->generation;
+	cache->l1 = l1;
+	return kr_ok();
+}
+
+unsigned kr_cache_l1_slots(const struct kr_cache *cache)
+{
+	return cache && cache->l1 ? 2 * (cache->l1->mask + 1) : 0;
+}
+
+/** Forget everything if records were removed or others wrote since the last time. */
+static struct kr_cache_l1 *l1_get(struct kr_cache *cache)
+{
+	struct kr_cache_l1 *l1 = cache->l1;
+	if (!l1) {
+		return NULL;
+	}
+	if (l1->generation != cache->generation) {
+		l1->generation = cache->generation;
+		++l1->stamp;
+	}
+	if (l1->checked != l1->epoch && cache->api->foreign_changes) {
+		l1->checked = l1->epoch;
+		const uint64_t foreign = cache->api->foreign_changes(cache->db);
+		if (foreign != l1->foreign) {
+			l1->foreign = foreign;
+			++l1->stamp;
+		}
+	}
+	return l1;
+}
+
+static inline bool l1_slot_empty(const struct kr_cache_l1 *l1, const struct l1_slot *slot)
+{
+	return slot->key_len == 0 || slot->stamp != l1->stamp;
+}
+
+static struct l1_slot *l1_find(struct kr_cache_l1 *l1, const knot_db_val_t *key, uint32_t h)
+{
+	struct l1_slot *set = &l1->slots[2 * (h & l1->mask)];
+	for (int i = 0; i < 2; ++i) {
+		if (!l1_slot_empty(l1, &set[i]) && set[i].key_len == key->len && set[i].hash == h
+		    && memcmp(set[i].key, key->data, key->len) == 0) {
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+int cache_read(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val)
+{
+	if (cache->pending) {
+		int ret = cache_pending_read(cache, key, val);
+		if (ret != kr_error(ENOENT)) {
+			return ret;
+		}
+	}
+	struct kr_cache_l1 *l1 = l1_get(cache);
+	if (!l1 || key->len > KR_CACHE_KEY_MAXLEN) {
+		return cache_op(cache, read, key, val, 1);
+	}
+	const uint32_t h = hash(key->data, key->len);
+	struct l1_slot *slot = l1_find(l1, key, h);
+	if (slot) {
+		++cache->stats.l1_hit;
+		slot->epoch = l1->epoch;
+		val->data = slot->val;
+		val->len = slot->val_len;
+		return kr_ok();
+	}
+	++cache->stats.l1_miss;
+
+	int ret = cache_op(cache, read, key, val, 1);
+	if (ret != 0 || val->len > L1_VAL_MAXLEN) {
+		return ret;
+	}
+	/* Replace an empty or the less recently used slot, unless it's still in use. */
+	struct l1_slot *set = &l1->slots[2 * (h & l1->mask)];
+	for (int i = 0; i < 2; ++i) {
+		if (set[i].epoch == l1->epoch) {
+			continue;
+		}
+		if (!slot || l1_slot_empty(l1, &set[i]) || set[i].epoch < slot->epoch) {
+			slot = &set[i];
+		}
+	}
+	if (!slot) {
+		return ret;
+	}
+	slot->hash = h;
+	slot->epoch = l1->epoch;
+	slot->stamp = l1->stamp;
+	slot->key_len = key->len;
+	slot->val_len = val->len;
+	memcpy(slot->key, key->data, key->len);
+	memcpy(slot->val, val->data, val->len);
+	return ret;
+}
+
+int cache_read_rmw(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val)
+{
+	if (cache->pending) {
+		int ret = cache_pending_read(cache, key, val);
+		if (ret != kr_error(ENOENT)) {
+			return ret;
+		}
+	}
+	return cache_op(cache, read, key, val, 1);
+}
+
+int cache_write(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val)
+{
+	struct kr_cache_l1 *l1 = l1_get(cache);
+	if (l1 && key->len <= KR_CACHE_KEY_MAXLEN) {
+		struct l1_slot *slot = l1_find(l1, key, hash(key->data, key->len));
+		if (slot) {
+			slot->key_len = 0;
+		}
+	}
+	if (cache->pending) {
+		return cache_pending_write(cache, key, val);
+	}
+	return cache_op(cache, write, key, val, 1);
+}
+
+void cache_l1_commit(struct kr_cache *cache)
+{
+	if (cache->l1) {
+		++cache->l1->epoch;
+	}
+}
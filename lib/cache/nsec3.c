@@ -10,6 +10,7 @@
 
 #include "contrib/base32hex.h"
 #include "lib/dnssec/nsec.h"
+#include "lib/dnssec/nsec3.h"
 #include "lib/layer/iterate.h"
 
 #include <libknot/rrtype/nsec3.h>
@@ -99,7 +100,7 @@ static knot_db_val_t key_NSEC3_name(struct key *k, const knot_dname_t *name,
 
 	#else
 	dnssec_binary_t hash = { .size = 0, .data = NULL };
-	int ret = dnssec_nsec3_hash(&dname, &nsec_p->libknot, &hash);
+	int ret = kr_nsec3_hash(&dname, &nsec_p->libknot, &hash);
 	if (ret != DNSSEC_EOK) return VAL_EMPTY;
 	if (hash.size != NSEC3_HASH_LEN || !hash.data) {
 		assert(false);
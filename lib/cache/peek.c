@@ -128,10 +128,13 @@ int peek_nosync(kr_layer_t *ctx, knot_pkt_t *pkt)
 	{
 		knot_db_val_t key = key_exact_type_maypkt(k, qry->stype);
 		knot_db_val_t val = { NULL, 0 };
-		ret = cache_op(cache, read, &key, &val, 1);
+		ret = cache_read(cache, &key, &val);
 		if (!ret) {
 			/* found an entry: test conditions, materialize into pkt, etc. */
 			ret = found_exact_hit(ctx, pkt, val, lowest_rank);
+			if (!ret && k->type != KNOT_RRTYPE_NS) { /* not entry_apex */
+				entry_h_hit(cache, key, val, &req->pool);
+			}
 		}
 	}
 	if (ret && ret != -abs(ENOENT)) {
@@ -254,7 +257,7 @@ int peek_nosync(kr_layer_t *ctx, knot_pkt_t *pkt)
 		k->buf[0] = k->zlf_len;
 		knot_db_val_t key = key_exact_type(k, KNOT_RRTYPE_SOA);
 		knot_db_val_t val = { NULL, 0 };
-		ret = cache_op(cache, read, &key, &val, 1);
+		ret = cache_read(cache, &key, &val);
 		const struct entry_h *eh;
 		if (ret || !(eh = entry_h_consistent_E(val, KNOT_RRTYPE_SOA))) {
 			assert(ret); /* only want to catch `eh` failures */
@@ -569,7 +572,7 @@ static int try_wild(struct key *k, struct answer *ans, const knot_dname_t *clenc
 	knot_db_val_t key = key_exact_type(k, type);
 	/* Find the record. */
 	knot_db_val_t val = { NULL, 0 };
-	int ret = cache_op(cache, read, &key, &val, 1);
+	int ret = cache_read(cache, &key, &val);
 	if (!ret) {
 		ret = entry_h_seek(&val, type);
 	}
@@ -641,6 +644,27 @@ static int check_NS_entry(struct key *k, knot_db_val_t entry, int i,
 			  bool exact_match, bool is_DS,
 			  const struct kr_query *qry, uint32_t timestamp);
 
+/** Names with fewer labels are looked up in closest_NS() directly. */
+#define CLOSEST_NS_PREFIX_LABELS 3
+
+/** \internal for closest_NS.  Find how long a prefix of the name's key exists in cache.
+ *
+ * A single search in the backend finds the neighbours of the key, so that
+ * closest_NS() can skip reads for all the deeper names not present at all.
+ * \return the prefix length; KR_CACHE_KEY_MAXLEN if everything needs to be read.
+ */
+static int closest_NS_prefix_len(struct kr_cache *cache, struct key *k)
+{
+	/* Pending writes aren't seen by the backend. */
+	if (!cache->api->prefix_len || !cache_pending_empty(cache)
+	    || knot_dname_labels(k->zname, NULL) < CLOSEST_NS_PREFIX_LABELS) {
+		return KR_CACHE_KEY_MAXLEN;
+	}
+	const knot_db_val_t key = key_exact_type(k, KNOT_RRTYPE_NS);
+	int ret = cache_op(cache, prefix_len, &key);
+	return ret < 0 ? KR_CACHE_KEY_MAXLEN : ret;
+}
+
 /**
  * Find the longest prefix zone/xNAME (with OK time+rank), starting at k->*.
  *
@@ -664,16 +688,24 @@ static int closest_NS(struct kr_cache *cache, struct key *k, entry_list_t el,
 	}
 
 	int zlf_len = k->buf[0];
+	const int prefix_len = closest_NS_prefix_len(cache, k);
 
 	// LATER(optim): if stype is NS, we check the same value again
 	bool exact_match = true;
 	bool need_zero = true;
 	/* Inspect the NS/xNAME entries, shortening by a label on each iteration. */
 	do {
+		/* CACHE_KEY_DEF: the key of a name and type starts with its lf;
+		 * if no key in cache starts so, there's nothing to read.
+		 * (The '\0' after lf can't be counted, as the searched key
+		 * continues by the next label there.) */
+		if (zlf_len > prefix_len) {
+			goto next_label;
+		}
 		k->buf[0] = zlf_len;
 		knot_db_val_t key = key_exact_type(k, KNOT_RRTYPE_NS);
 		knot_db_val_t val;
-		int ret = cache_op(cache, read, &key, &val, 1);
+		int ret = cache_read(cache, &key, &val);
 		if (ret == -abs(ENOENT)) goto next_label;
 		if (ret) {
 			assert(!ret);
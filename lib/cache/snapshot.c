@@ -0,0 +1,363 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/** @file
+ * Export of the cache contents into a file and loading it back.
+ *
+ * The file starts with a header carrying the value of the "VERS" key, so
+ * a snapshot is only loaded into a cache of the same format.  Records follow
+ * in blocks, each prefixed by its length and a checksum; a zero-length block
+ * ends the file.  Each record is a key and a value, both stored as-is, so the
+ * file is only usable on machines of the same endianness.  Values are padded
+ * to 8-byte alignment within their block.
+ *
+ * Entry inception times are in wall-clock seconds, so the remaining TTLs stay
+ * correct across restarts; records expired by the time of export or import
+ * are skipped.  Records about upstream servers aren't exported.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libknot/descriptor.h>
+
+#include "lib/cache/impl.h"
+
+static const char SNAPSHOT_MAGIC[4] = { 'K', 'R', 'C', 'S' };
+static const uint32_t SNAPSHOT_FORMAT = 1;
+/** Blocks are written once they exceed this size. */
+#define SNAPSHOT_BLOCK 65536
+/** Bound on the length of "VERS" value in the header. */
+#define SNAPSHOT_VERS_MAXLEN 16
+/** Bound on the length of a value, far above anything the cache stores. */
+#define SNAPSHOT_VAL_MAXLEN (1 << 20)
+
+struct snapshot_header {
+	char magic[4];
+	uint32_t format;
+	uint64_t time;     /**< wall-clock time of the export, for information */
+	uint16_t vers_len;
+	uint8_t vers[SNAPSHOT_VERS_MAXLEN];
+};
+
+/** Record header; the key and the value follow. */
+struct snapshot_rec {
+	uint16_t key_len;
+	uint32_t val_len;
+} __attribute__((packed));
+
+/** Offset of a value within the block; they're aligned, as entry_h is read in-place. */
+static inline size_t val_align(size_t off)
+{
+	return (off + 7) & ~(size_t)7;
+}
+
+struct snapshot_block {
+	uint32_t len;  /**< length of the records; zero in the terminating block */
+	uint32_t hash; /**< hash() of the records */
+};
+/** Bound on snapshot_block::len: a full block plus one largest record. */
+#define SNAPSHOT_BLOCK_MAXLEN (SNAPSHOT_BLOCK + sizeof(struct snapshot_rec) \
+		+ KR_CACHE_KEY_MAXLEN + 7 + SNAPSHOT_VAL_MAXLEN)
+
+static bool is_version_key(const knot_db_val_t *key)
+{
+	/* CACHE_KEY_DEF; see assert_right_version() */
+	return key->len == 4 && memcmp(key->data, "VERS", 4) == 0;
+}
+
+/** Records about upstream servers (see enum kr_cache_infra_tag) are short-lived
+ * state of this particular network position, not DNS data.  CACHE_KEY_DEF */
+static bool is_infra_key(const knot_db_val_t *key)
+{
+	const uint8_t *kd = key->data;
+	return key->len >= 2 && kd[0] == '\0'
+		&& (kd[1] == KR_CACHE_INFRA_RTT || kd[1] == KR_CACHE_INFRA_REP);
+}
+
+/** Return true if the value is an entry_h that had expired at now.  CACHE_KEY_DEF */
+static bool is_expired(const knot_db_val_t *key, const knot_db_val_t *val, uint32_t now)
+{
+	const uint8_t *kd = key->data;
+	size_t i;
+	/* Same parsing as kr_gc_key_consistent() */
+	if (key->len >= 2 && kd[0] == '\0') {
+		i = 1;
+	} else {
+		for (i = 2; i < key->len && (kd[i - 1] || kd[i - 2]); ++i);
+		if (i >= key->len) {
+			return false;
+		}
+	}
+	const struct entry_h *eh = NULL;
+	if (kd[i] == 'E' && i + 1 + sizeof(uint16_t) <= key->len) {
+		uint16_t type;
+		memcpy(&type, kd + i + 1, sizeof(type));
+		if (type == KNOT_RRTYPE_NS) {
+			return false; /* struct entry_apex */
+		}
+		eh = entry_h_consistent_E(*val, type);
+	} else if (kd[i] == '1' || kd[i] == '3') {
+		eh = entry_h_consistent_NSEC(*val);
+	}
+	if (!eh) {
+		return false;
+	}
+	const int64_t age = now > eh->time ? now - eh->time : 0;
+	return age > eh->ttl;
+}
+
+struct snapshot_ctx {
+	FILE *f;
+	uint8_t *buf;
+	size_t len;
+	size_t cap;
+	uint32_t now;
+	int count;
+};
+
+static int block_write(struct snapshot_ctx *ctx)
+{
+	const struct snapshot_block block = {
+		.len = ctx->len,
+		.hash = hash((const char *)ctx->buf, ctx->len),
+	};
+	if (fwrite(&block, sizeof(block), 1, ctx->f) != 1
+	    || (ctx->len > 0 && fwrite(ctx->buf, ctx->len, 1, ctx->f) != 1)) {
+		return kr_error(errno);
+	}
+	ctx->len = 0;
+	return kr_ok();
+}
+
+static int snapshot_rec(const knot_db_val_t *key, const knot_db_val_t *val, void *baton)
+{
+	struct snapshot_ctx *ctx = baton;
+	if (is_version_key(key) || is_infra_key(key) || is_expired(key, val, ctx->now)) {
+		return 0;
+	}
+	if (key->len > KR_CACHE_KEY_MAXLEN || val->len > SNAPSHOT_VAL_MAXLEN) {
+		assert(false);
+		return 0;
+	}
+	const struct snapshot_rec rec = { .key_len = key->len, .val_len = val->len };
+	const size_t val_off = val_align(ctx->len + sizeof(rec) + key->len);
+	const size_t len = val_off + val->len - ctx->len;
+	if (ctx->len + len > ctx->cap) {
+		uint8_t *buf = realloc(ctx->buf, ctx->len + len);
+		if (!buf) {
+			return kr_error(ENOMEM);
+		}
+		ctx->buf = buf;
+		ctx->cap = ctx->len + len;
+	}
+	uint8_t *pos = ctx->buf + ctx->len;
+	memcpy(pos, &rec, sizeof(rec));
+	memcpy(pos + sizeof(rec), key->data, key->len);
+	memset(pos + sizeof(rec) + key->len, 0, val_off - (ctx->len + sizeof(rec) + key->len));
+	memcpy(ctx->buf + val_off, val->data, val->len);
+	ctx->len += len;
+	++ctx->count;
+	return ctx->len >= SNAPSHOT_BLOCK ? block_write(ctx) : 0;
+}
+
+/** Read the "VERS" value of the cache into the header. */
+static int header_vers(struct kr_cache *cache, struct snapshot_header *h)
+{
+	knot_db_val_t key = { .data = "VERS", .len = 4 };
+	knot_db_val_t val = { NULL, 0 };
+	int ret = cache_op(cache, read, &key, &val, 1);
+	if (ret) {
+		return ret;
+	}
+	if (val.len > sizeof(h->vers)) {
+		return kr_error(EINVAL);
+	}
+	h->vers_len = val.len;
+	memcpy(h->vers, val.data, val.len);
+	return kr_ok();
+}
+
+int kr_cache_snapshot(struct kr_cache *cache, const char *path)
+{
+	if (!cache || !path || !kr_cache_is_open(cache)) {
+		return kr_error(EINVAL);
+	}
+	if (!cache->api->apply) {
+		return kr_error(ENOTSUP);
+	}
+	int ret = kr_cache_flush(cache);
+	if (ret) {
+		return ret;
+	}
+	struct snapshot_header header = {
+		.format = SNAPSHOT_FORMAT,
+		.time = time(NULL),
+	};
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+	ret = header_vers(cache, &header);
+	if (ret) {
+		return ret;
+	}
+
+	/* Write into a temporary file, so that the snapshot is replaced atomically. */
+	char *tmp_path = NULL;
+	if (asprintf(&tmp_path, "%s.tmp", path) < 0) {
+		return kr_error(ENOMEM);
+	}
+	struct snapshot_ctx ctx = {
+		.f = fopen(tmp_path, "wb"),
+		.now = header.time,
+	};
+	if (!ctx.f) {
+		ret = kr_error(errno);
+		free(tmp_path);
+		return ret;
+	}
+	if (fwrite(&header, sizeof(header), 1, ctx.f) != 1) {
+		ret = kr_error(errno);
+	}
+	if (ret == 0) {
+		ret = cache->api->apply(cache->db, &cache->stats, snapshot_rec, &ctx);
+	}
+	kr_cache_commit(cache);
+	/* The remaining records and the terminating block. */
+	if (ret == 0 && ctx.len > 0) {
+		ret = block_write(&ctx);
+	}
+	if (ret == 0) {
+		ret = block_write(&ctx);
+	}
+	if (fclose(ctx.f) != 0 && ret == 0) {
+		ret = kr_error(errno);
+	}
+	if (ret == 0 && rename(tmp_path, path) != 0) {
+		ret = kr_error(errno);
+	}
+	if (ret) {
+		(void)unlink(tmp_path);
+	}
+	free(tmp_path);
+	free(ctx.buf);
+	return ret ? ret : ctx.count;
+}
+
+/** Write records from one block, skipping expired ones and keys present in the cache. */
+static int restore_block(struct kr_cache *cache, const uint8_t *buf, size_t len, uint32_t now)
+{
+	int count = 0;
+	size_t pos = 0;
+	while (pos < len) {
+		struct snapshot_rec rec;
+		if (len - pos < sizeof(rec)) {
+			return kr_error(EILSEQ);
+		}
+		memcpy(&rec, buf + pos, sizeof(rec));
+		if (rec.key_len > KR_CACHE_KEY_MAXLEN || rec.val_len > SNAPSHOT_VAL_MAXLEN) {
+			return kr_error(EILSEQ);
+		}
+		knot_db_val_t key = { .data = (void *)(buf + pos + sizeof(rec)), .len = rec.key_len };
+		const size_t val_off = val_align(pos + sizeof(rec) + rec.key_len);
+		if (val_off > len || len - val_off < rec.val_len) {
+			return kr_error(EILSEQ);
+		}
+		const knot_db_val_t val_snap = { .data = (void *)(buf + val_off), .len = rec.val_len };
+		pos = val_off + rec.val_len;
+		if (is_version_key(&key) || is_infra_key(&key) || is_expired(&key, &val_snap, now)) {
+			continue;
+		}
+		knot_db_val_t val = { NULL, 0 };
+		if (cache_op(cache, read, &key, &val, 1) == 0) {
+			continue; /* the record in cache is at least as fresh */
+		}
+		val = val_snap;
+		int ret = cache_op(cache, write, &key, &val, 1);
+		if (ret) {
+			return ret;
+		}
+		++count;
+	}
+	return count;
+}
+
+int kr_cache_restore(struct kr_cache *cache, const char *path)
+{
+	if (!cache || !path || !kr_cache_is_open(cache)) {
+		return kr_error(EINVAL);
+	}
+	int ret = kr_cache_flush(cache);
+	if (ret) {
+		return ret;
+	}
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		return kr_error(errno);
+	}
+	/* Lengths in the file are bounded by its size, before anything is allocated. */
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0) {
+		ret = kr_error(errno);
+		fclose(f);
+		return ret;
+	}
+	struct snapshot_header header, ours = { 0 };
+	if (fread(&header, sizeof(header), 1, f) != 1
+	    || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+	    || header.format != SNAPSHOT_FORMAT) {
+		fclose(f);
+		return kr_error(EILSEQ);
+	}
+	ret = header_vers(cache, &ours);
+	if (ret == 0 && (header.vers_len != ours.vers_len
+			 || memcmp(header.vers, ours.vers, ours.vers_len) != 0)) {
+		ret = kr_error(ENOTSUP); /* different cache version */
+	}
+
+	const uint32_t now = time(NULL);
+	uint8_t *buf = NULL;
+	size_t cap = 0;
+	int count = 0;
+	while (ret == 0) {
+		struct snapshot_block block;
+		if (fread(&block, sizeof(block), 1, f) != 1) {
+			ret = kr_error(EILSEQ); /* truncated */
+			break;
+		}
+		if (block.len == 0) {
+			break;
+		}
+		const long pos = ftell(f);
+		if (pos < 0 || block.len > SNAPSHOT_BLOCK_MAXLEN || block.len > st.st_size - pos) {
+			ret = kr_error(EILSEQ);
+			break;
+		}
+		if (block.len > cap) {
+			uint8_t *b = realloc(buf, block.len);
+			if (!b) {
+				ret = kr_error(ENOMEM);
+				break;
+			}
+			buf = b;
+			cap = block.len;
+		}
+		if (fread(buf, block.len, 1, f) != 1
+		    || hash((const char *)buf, block.len) != block.hash) {
+			ret = kr_error(EILSEQ);
+			break;
+		}
+		ret = restore_block(cache, buf, block.len, now);
+		/* One transaction per block. */
+		const int ret_commit = kr_cache_commit(cache);
+		if (ret >= 0) {
+			count += ret;
+			ret = ret_commit;
+		}
+	}
+	fclose(f);
+	free(buf);
+	return ret ? ret : count;
+}
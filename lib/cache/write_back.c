@@ -0,0 +1,178 @@
+/*  Copyright (C) 2020 CZ.NIC, z.s.p.o. <knot-dns@labs.nic.cz>
+ *  SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/** @file
+ * Buffer of cache writes, flushed to the backend in a single transaction.
+ *
+ * Without it, each stash opens and commits its own write transaction.
+ * Exact-key reads see the pending values; read_leq() (i.e. NSEC and NSEC3
+ * lookups) only sees them after the flush.  Values replaced while pending
+ * are freed by the next commit, so callers may use values until then,
+ * same as with LMDB.
+ */
+
+#include "lib/cache/impl.h"
+#include "lib/generic/array.h"
+#include "lib/generic/trie.h"
+
+struct pending_val {
+	uint32_t len;
+	uint8_t data[] __attribute__((aligned(sizeof(void *))));
+};
+
+struct kr_cache_pending {
+	trie_t *vals;  /**< key -> struct pending_val */
+	array_t(struct pending_val *) dead; /**< replaced, to be freed on commit */
+	unsigned max;  /**< flush when this many keys are pending */
+};
+
+static int free_val(trie_val_t *val, void *baton)
+{
+	free(*val);
+	return 0;
+}
+
+static void free_dead(struct kr_cache_pending *p)
+{
+	for (size_t i = 0; i < p->dead.len; ++i) {
+		free(p->dead.at[i]);
+	}
+	p->dead.len = 0;
+}
+
+/** Forget all pending writes. */
+void cache_pending_drop(struct kr_cache *cache)
+{
+	struct kr_cache_pending *p = cache->pending;
+	if (p) {
+		trie_apply(p->vals, free_val, NULL);
+		trie_clear(p->vals);
+		free_dead(p);
+	}
+}
+
+int kr_cache_write_back(struct kr_cache *cache, unsigned max)
+{
+	if (!cache) {
+		return kr_error(EINVAL);
+	}
+	int ret = kr_cache_flush(cache);
+	if (max == 0) {
+		struct kr_cache_pending *p = cache->pending;
+		if (p) {
+			cache_pending_drop(cache);
+			trie_free(p->vals);
+			array_clear(p->dead);
+			free(p);
+			cache->pending = NULL;
+		}
+		return ret;
+	}
+	if (!cache->pending) {
+		struct kr_cache_pending *p = calloc(1, sizeof(*p));
+		if (!p || !(p->vals = trie_create(NULL))) {
+			free(p);
+			return kr_error(ENOMEM);
+		}
+		cache->pending = p;
+	}
+	cache->pending->max = max;
+	return ret;
+}
+
+unsigned kr_cache_write_back_max(const struct kr_cache *cache)
+{
+	return cache && cache->pending ? cache->pending->max : 0;
+}
+
+int kr_cache_flush(struct kr_cache *cache)
+{
+	struct kr_cache_pending *p = cache ? cache->pending : NULL;
+	if (!p || trie_weight(p->vals) == 0 || !kr_cache_is_open(cache)) {
+		return kr_ok();
+	}
+	/* Detach the values, as clearing the cache on ENOSPC drops pending writes. */
+	trie_t *vals = p->vals;
+	p->vals = trie_create(NULL);
+	if (!p->vals) {
+		p->vals = vals;
+		return kr_error(ENOMEM);
+	}
+
+	int ret = kr_ok();
+	trie_it_t *it = trie_it_begin(vals);
+	for (; it && !trie_it_finished(it); trie_it_next(it)) {
+		size_t len;
+		const char *k = trie_it_key(it, &len);
+		const struct pending_val *v = *trie_it_val(it);
+		knot_db_val_t key = { .data = (void *)k, .len = len };
+		knot_db_val_t val = { .data = (void *)v->data, .len = v->len };
+		ret = cache_op(cache, write, &key, &val, 1);
+		if (ret) {
+			break;
+		}
+	}
+	trie_it_free(it);
+	trie_apply(vals, free_val, NULL);
+	trie_free(vals);
+
+	if (ret == kr_error(ENOSPC)) {
+		/* Same as for synchronous writes; see cache_write_or_clear(). */
+		kr_log_info("[cache] clearing because overfull\n");
+		return kr_cache_clear(cache);
+	}
+	const int ret_commit = kr_cache_commit(cache);
+	return ret ? ret : ret_commit;
+}
+
+bool cache_pending_empty(const struct kr_cache *cache)
+{
+	return !cache->pending || trie_weight(cache->pending->vals) == 0;
+}
+
+int cache_pending_read(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val)
+{
+	trie_val_t *v = trie_get_try(cache->pending->vals, key->data, key->len);
+	if (!v) {
+		return kr_error(ENOENT);
+	}
+	struct pending_val *pv = *v;
+	val->data = pv->data;
+	val->len = pv->len;
+	return kr_ok();
+}
+
+int cache_pending_write(struct kr_cache *cache, const knot_db_val_t *key, knot_db_val_t *val)
+{
+	struct kr_cache_pending *p = cache->pending;
+	struct pending_val *pv = malloc(sizeof(*pv) + val->len);
+	if (!pv) {
+		return kr_error(ENOMEM);
+	}
+	pv->len = val->len;
+	/* NULL data with non-zero length reserves space for the caller, like in LMDB. */
+	if (val->data) {
+		memcpy(pv->data, val->data, val->len);
+	}
+	trie_val_t *v = trie_get_ins(p->vals, key->data, key->len);
+	if (!v || (*v && array_push(p->dead, *v) < 0)) {
+		free(pv);
+		return kr_error(ENOMEM);
+	}
+	*v = pv;
+	val->data = pv->data;
+	return kr_ok();
+}
+
+void cache_pending_commit(struct kr_cache *cache)
+{
+	struct kr_cache_pending *p = cache->pending;
+	if (!p) {
+		return;
+	}
+	free_dead(p);
+	if (trie_weight(p->vals) >= p->max) {
+		(void)kr_cache_flush(cache);
+	}
+}
@@ -54,6 +54,7 @@ static inline int KR_COLD kr_error(int x) {
 #define KR_QUERY_NSRETRY_LIMIT 4 /* Maximum number of retries per query. */
 #define KR_COUNT_NO_NSADDR_LIMIT 5
 #define KR_CONSUME_FAIL_ROW_LIMIT 3 /* Maximum number of KR_STATE_FAIL in a row. */
+#define KR_NS_BG_LIMIT 6 /* Maximum number of NS address lookups started in background per request. */
 
 /*
  * Defines.
@@ -17,6 +17,7 @@
 #include <libknot/rrtype/rrsig.h>
 
 #include "contrib/cleanup.h"
+#include "contrib/murmurhash3/murmurhash3.h"
 #include "contrib/wire.h"
 #include "lib/defines.h"
 #include "lib/dnssec/nsec.h"
@@ -25,6 +26,136 @@
 #include "lib/dnssec.h"
 #include "lib/resolve.h"
 
+/**
+ * Parsed DNSKEYs kept for reuse, as importing the public key is expensive.
+ *
+ * It's a two-way set-associative table keyed by the owner and RDATA; a key
+ * is valid until its TTL runs out.  Entries are reference-counted, so that
+ * a key being used isn't freed when replaced in the table.
+ */
+struct key_memo_entry {
+	struct dseckey *key;
+	uint32_t expire;   /**< end of the DNSKEY TTL */
+	uint32_t used;     /**< key_memo.tick when last used */
+	uint32_t refs;     /**< users, plus one while in the table */
+	uint32_t hash;
+	uint16_t owner_len;
+	uint16_t rdlen;
+	uint8_t data[];    /**< owner followed by RDATA */
+};
+
+static struct {
+	struct key_memo_entry **slots; /**< two per set */
+	uint32_t mask;                 /**< number of sets - 1 */
+	uint32_t tick;
+} key_memo;
+
+static void key_memo_unref(struct key_memo_entry *e)
+{
+	if (e && --e->refs == 0) {
+		kr_dnssec_key_free(&e->key);
+		free(e);
+	}
+}
+
+int kr_dnssec_key_memo(unsigned size)
+{
+	if (key_memo.slots) {
+		for (uint32_t i = 0; i < 2 * (key_memo.mask + 1); ++i) {
+			key_memo_unref(key_memo.slots[i]);
+		}
+		free(key_memo.slots);
+		key_memo.slots = NULL;
+	}
+	if (size == 0) {
+		return kr_ok();
+	}
+	uint32_t sets = 1;
+	while (2 * sets < size) {
+		sets *= 2;
+	}
+	key_memo.slots = calloc(2 * sets, sizeof(key_memo.slots[0]));
+	if (!key_memo.slots) {
+		return kr_error(ENOMEM);
+	}
+	key_memo.mask = sets - 1;
+	return kr_ok();
+}
+
+/**
+ * Get a DNSSEC key like kr_dnssec_key_from_rdata(), reusing a parsed one if possible.
+ * @param entry Set to the memo entry or NULL; pass it to key_put() when done.
+ * @param ttl   TTL of the DNSKEY RRset.
+ * @param now   Current time.
+ */
+static int key_get(struct dseckey **key, struct key_memo_entry **entry,
+		   const knot_dname_t *kown, const knot_rdata_t *rd,
+		   uint32_t ttl, uint32_t now)
+{
+	*entry = NULL;
+	const size_t owner_len = knot_dname_size(kown);
+	if (!key_memo.slots || owner_len + rd->len > UINT16_MAX) {
+		return kr_dnssec_key_from_rdata(key, kown, rd->data, rd->len);
+	}
+	const uint32_t h = hash((const char *)kown, owner_len)
+			 ^ hash((const char *)rd->data, rd->len);
+	struct key_memo_entry **set = &key_memo.slots[2 * (h & key_memo.mask)];
+	struct key_memo_entry **slot = NULL;
+	for (int i = 0; i < 2; ++i) {
+		struct key_memo_entry *e = set[i];
+		if (e && e->hash == h && e->owner_len == owner_len && e->rdlen == rd->len
+		    && memcmp(e->data, kown, owner_len) == 0
+		    && memcmp(e->data + owner_len, rd->data, rd->len) == 0) {
+			if ((int32_t)(e->expire - now) >= 0) {
+				e->used = ++key_memo.tick;
+				++e->refs;
+				*key = e->key;
+				*entry = e;
+				return kr_ok();
+			}
+			slot = &set[i]; /* expired; replace it */
+			break;
+		}
+	}
+	if (!slot) {
+		/* An empty or the less recently used slot. */
+		slot = !set[0] || (set[1] && set[0]->used < set[1]->used) ? &set[0] : &set[1];
+	}
+
+	int ret = kr_dnssec_key_from_rdata(key, kown, rd->data, rd->len);
+	if (ret) {
+		return ret;
+	}
+	struct key_memo_entry *e = malloc(sizeof(*e) + owner_len + rd->len);
+	if (!e) {
+		return kr_ok(); /* just don't remember it */
+	}
+	e->key = *key;
+	e->expire = now + ttl;
+	e->used = ++key_memo.tick;
+	e->refs = 2;
+	e->hash = h;
+	e->owner_len = owner_len;
+	e->rdlen = rd->len;
+	memcpy(e->data, kown, owner_len);
+	memcpy(e->data + owner_len, rd->data, rd->len);
+	key_memo_unref(*slot);
+	*slot = e;
+	*entry = e;
+	return kr_ok();
+}
+
+/** Release a key obtained by key_get(). */
+static void key_put(struct dseckey **key, struct key_memo_entry *entry)
+{
+	if (entry) {
+		key_memo_unref(entry);
+		*key = NULL;
+	} else {
+		kr_dnssec_key_free(key);
+	}
+}
+
 /* forward */
 static int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 	knot_rrset_t *covered, size_t key_pos, const struct dseckey *key);
@@ -167,6 +298,7 @@ static int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 	uint32_t timestamp            = vctx->timestamp;
 	bool has_nsec3		      = vctx->has_nsec3;
 	struct dseckey *created_key = NULL;
+	struct key_memo_entry *created_entry = NULL;
 
 	/* It's just caller's approximation that the RR is in that particular zone.
 	 * We MUST guard against attempts of zones signing out-of-bailiwick records. */
@@ -177,8 +309,8 @@ static int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 
 	const knot_rdata_t *key_rdata = knot_rdataset_at(&keys->rrs, key_pos);
 	if (key == NULL) {
-		int ret = kr_dnssec_key_from_rdata(&created_key, keys->owner,
-						   key_rdata->data, key_rdata->len);
+		int ret = key_get(&created_key, &created_entry, keys->owner,
+				  key_rdata, keys->ttl, timestamp);
 		if (ret != 0) {
 			vctx->result = ret;
 			return vctx->result;
@@ -214,7 +346,7 @@ static int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 			                      keys->owner, key_rdata, keytag,
 			                      zone_name, timestamp, vctx);
 			if (retv == kr_error(EAGAIN)) {
-				kr_dnssec_key_free(&created_key);
+				key_put(&created_key, created_entry);
 				vctx->result = retv;
 				return retv;
 			} else if (retv != 0) {
@@ -264,14 +396,14 @@ static int kr_rrset_validate_with_key(kr_rrset_validation_ctx_t *vctx,
 				covered->ttl = ttl_max;
 			}
 
-			kr_dnssec_key_free(&created_key);
+			key_put(&created_key, created_entry);
 			vctx->result = kr_ok();
 			kr_rank_set(&vctx->rrs->at[i]->rank, KR_RANK_SECURE); /* upgrade from bogus */
 			return vctx->result;
 		}
 	}
 	/* No applicable key found, cannot be validated. */
-	kr_dnssec_key_free(&created_key);
+	key_put(&created_key, created_entry);
 	vctx->result = kr_error(ENOENT);
 	return vctx->result;
 }
@@ -317,18 +449,19 @@ int kr_dnskeys_trusted(kr_rrset_validation_ctx_t *vctx, const knot_rrset_t *ta)
 		}
 		
 		struct dseckey *key = NULL;
-		if (kr_dnssec_key_from_rdata(&key, keys->owner, krr->data, krr->len) != 0) {
+		struct key_memo_entry *entry = NULL;
+		if (key_get(&key, &entry, keys->owner, krr, keys->ttl, vctx->timestamp) != 0) {
 			continue;
 		}
 		if (kr_authenticate_referral(ta, (dnssec_key_t *) key) != 0) {
-			kr_dnssec_key_free(&key);
+			key_put(&key, entry);
 			continue;
 		}
 		if (kr_rrset_validate_with_key(vctx, keys, i, key) != 0) {
-			kr_dnssec_key_free(&key);
+			key_put(&key, entry);
 			continue;
 		}
-		kr_dnssec_key_free(&key);
+		key_put(&key, entry);
 		assert (vctx->result == 0);
 		return vctx->result;
 	}
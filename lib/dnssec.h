@@ -133,6 +133,14 @@ int kr_dnssec_key_from_rdata(struct dseckey **key, const knot_dname_t *kown, con
  */
 void kr_dnssec_key_free(struct dseckey **key);
 
+/**
+ * Set the number of parsed DNSKEYs kept for reuse by the validator; 0 disables it.
+ * The keys are shared by the whole process and they're dropped by this call.
+ * @return 0 or error code.
+ */
+KR_EXPORT
+int kr_dnssec_key_memo(unsigned size);
+
 /**
  * Checks whether NSEC/NSEC3 RR selected by iterator matches the supplied name and type.
  * @param rrs     Records selected by iterator.
@@ -3,6 +3,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <libdnssec/binary.h>
@@ -16,6 +17,7 @@
 #include "lib/defines.h"
 #include "lib/dnssec/nsec.h"
 #include "lib/dnssec/nsec3.h"
+#include "lib/generic/lru.h"
 
 #define OPT_OUT_BIT 0x01
 
@@ -56,6 +58,94 @@ static int nsec3_parameters(dnssec_nsec3_params_t *params, const knot_rrset_t *n
 	return kr_ok();
 }
 
+/** Longest hash kept in the memo; SHA-1 is the only algorithm defined so far. */
+#define MEMO_HASH_MAXLEN 20
+
+struct nsec3_memo_val {
+	uint8_t len;
+	uint8_t hash[MEMO_HASH_MAXLEN];
+};
+typedef lru_t(struct nsec3_memo_val) nsec3_memo_lru_t;
+
+/** The memo of NSEC3 hashes; the process is single-threaded, same as its worker. */
+static nsec3_memo_lru_t *nsec3_memo = NULL;
+static struct kr_nsec3_hash_stats nsec3_memo_stats;
+
+int kr_nsec3_hash_memo(unsigned size)
+{
+	lru_free(nsec3_memo);
+	nsec3_memo = NULL;
+	memset(&nsec3_memo_stats, 0, sizeof(nsec3_memo_stats));
+	if (size == 0) {
+		return kr_ok();
+	}
+	lru_create(&nsec3_memo, size, NULL, NULL);
+	return nsec3_memo ? kr_ok() : kr_error(ENOMEM);
+}
+
+struct kr_nsec3_hash_stats kr_nsec3_hash_stats(void)
+{
+	return nsec3_memo_stats;
+}
+
+/** Memo key: { algorithm, iterations, salt length, salt, name }. */
+#define MEMO_KEY_MAXLEN (4 + 255 + KNOT_DNAME_MAXLEN)
+
+static int memo_key(uint8_t *key, const dnssec_binary_t *name,
+		    const dnssec_nsec3_params_t *params)
+{
+	if (params->salt.size > 255 || name->size > KNOT_DNAME_MAXLEN) {
+		return kr_error(EINVAL);
+	}
+	key[0] = params->algorithm;
+	memcpy(key + 1, &params->iterations, sizeof(uint16_t));
+	key[3] = params->salt.size;
+	int len = 4;
+	if (params->salt.size) {
+		memcpy(key + len, params->salt.data, params->salt.size);
+		len += params->salt.size;
+	}
+	memcpy(key + len, name->data, name->size);
+	return len + name->size;
+}
+
+int kr_nsec3_hash(const dnssec_binary_t *name, const dnssec_nsec3_params_t *params,
+		  dnssec_binary_t *hash)
+{
+	if (!name || !params || !hash) {
+		return DNSSEC_EINVAL;
+	}
+	uint8_t key[MEMO_KEY_MAXLEN];
+	const int key_len = nsec3_memo ? memo_key(key, name, params) : -1;
+	if (key_len < 0) {
+		return dnssec_nsec3_hash(name, params, hash);
+	}
+
+	struct nsec3_memo_val *val = lru_get_try(nsec3_memo, (const char *)key, key_len);
+	if (val) {
+		++nsec3_memo_stats.hit;
+		hash->data = malloc(val->len);
+		if (!hash->data) {
+			return DNSSEC_ENOMEM;
+		}
+		memcpy(hash->data, val->hash, val->len);
+		hash->size = val->len;
+		return DNSSEC_EOK;
+	}
+	++nsec3_memo_stats.miss;
+
+	int ret = dnssec_nsec3_hash(name, params, hash);
+	if (ret != DNSSEC_EOK || hash->size > MEMO_HASH_MAXLEN) {
+		return ret;
+	}
+	val = lru_get_new(nsec3_memo, (const char *)key, key_len, NULL);
+	if (val) {
+		val->len = hash->size;
+		memcpy(val->hash, hash->data, hash->size);
+	}
+	return DNSSEC_EOK;
+}
+
 /**
  * Computes a hash of a given domain name.
  * @param hash   Resulting hash, must be freed.
@@ -75,7 +165,7 @@ static int hash_name(dnssec_binary_t *hash, const dnssec_nsec3_params_t *params,
 		.data = (uint8_t *) name,
 	};
 
-	int ret = dnssec_nsec3_hash(&dname, params, hash);
+	int ret = kr_nsec3_hash(&dname, params, hash);
 	if (ret != DNSSEC_EOK) {
 		return kr_error(EINVAL);
 	}
@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <libdnssec/nsec.h>
 #include <libknot/packet/pkt.h>
 
+#include "lib/defines.h"
+
 /**
  * Name error response check (RFC5155 7.2.2).
  * @note No RRSIGs are validated.
@@ -68,3 +71,35 @@ int kr_nsec3_ref_to_unsigned(const knot_pkt_t *pkt);
  */
 int kr_nsec3_matches_name_and_type(const knot_rrset_t *nsec3,
 				   const knot_dname_t *name, uint16_t type);
+
+/** Hit and miss counters of the NSEC3 hash memo; see kr_nsec3_hash(). */
+struct kr_nsec3_hash_stats {
+	uint64_t hit;
+	uint64_t miss;
+};
+
+/**
+ * Set the number of NSEC3 hashes remembered by kr_nsec3_hash(); 0 disables it.
+ *
+ * The memo is shared by the validator and the aggressive cache of the process
+ * and it's also reset by this call.
+ * @return 0 or error code.
+ */
+KR_EXPORT
+int kr_nsec3_hash_memo(unsigned size);
+
+/** Return the counters of the NSEC3 hash memo. */
+KR_EXPORT KR_PURE
+struct kr_nsec3_hash_stats kr_nsec3_hash_stats(void);
+
+/**
+ * Compute the NSEC3 hash of a name, like dnssec_nsec3_hash() but remembering
+ * the results, as iterated hashing is expensive.
+ * @param name   Domain name in wire format.
+ * @param params NSEC3 parameters.
+ * @param hash   Resulting hash, must be freed by dnssec_binary_free().
+ * @return       DNSSEC_EOK or libdnssec error code.
+ */
+KR_EXPORT
+int kr_nsec3_hash(const dnssec_binary_t *name, const dnssec_nsec3_params_t *params,
+		  dnssec_binary_t *hash);
@@ -19,6 +19,7 @@
 #include "lib/defines.h"
 #include "lib/utils.h"
 #include "lib/dnssec/signature.h"
+#include "lib/generic/lru.h"
 
 #include "contrib/wire.h"
 
@@ -107,6 +108,22 @@ static int adjust_wire_ttl(uint8_t *wire, size_t wire_size, uint32_t new_ttl)
 	return kr_ok();
 }
 
+/*!
+ * \brief Signing context together with a digest of the same data.
+ */
+struct sign_data {
+	dnssec_sign_ctx_t *ctx;
+	gnutls_hash_hd_t digest; /*!< NULL if not computed */
+};
+
+static int sign_data_add(struct sign_data *sd, const dnssec_binary_t *data)
+{
+	if (sd->digest && gnutls_hash(sd->digest, data->data, data->size) != 0) {
+		return kr_error(ENOMEM);
+	}
+	return dnssec_sign_add(sd->ctx, data);
+}
+
 /*!
  * \brief Add RRSIG RDATA without signature to signing context.
  *
@@ -118,7 +135,7 @@ static int adjust_wire_ttl(uint8_t *wire, size_t wire_size, uint32_t new_ttl)
  * \return Error code, KNOT_EOK if successful.
  */
 #define RRSIG_RDATA_SIGNER_OFFSET 18
-static int sign_ctx_add_self(dnssec_sign_ctx_t *ctx, const uint8_t *rdata)
+static int sign_ctx_add_self(struct sign_data *ctx, const uint8_t *rdata)
 {
 	assert(ctx);
 	assert(rdata);
@@ -132,7 +149,7 @@ static int sign_ctx_add_self(dnssec_sign_ctx_t *ctx, const uint8_t *rdata)
 		.size = RRSIG_RDATA_SIGNER_OFFSET,
 	};
 
-	result = dnssec_sign_add(ctx, &header);
+	result = sign_data_add(ctx, &header);
 	if (result != DNSSEC_EOK) {
 		return result;
 	}
@@ -144,7 +161,7 @@ static int sign_ctx_add_self(dnssec_sign_ctx_t *ctx, const uint8_t *rdata)
 	signer.data = knot_dname_copy(rdata_signer, NULL);
 	signer.size = knot_dname_size(signer.data);
 
-	result = dnssec_sign_add(ctx, &signer);
+	result = sign_data_add(ctx, &signer);
 	free(signer.data);
 
 	return result;
@@ -161,7 +178,7 @@ static int sign_ctx_add_self(dnssec_sign_ctx_t *ctx, const uint8_t *rdata)
  *
  * \return Error code, KNOT_EOK if successful.
  */
-static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *covered,
+static int sign_ctx_add_records(struct sign_data *ctx, const knot_rrset_t *covered,
                                 uint32_t orig_ttl, int trim_labels)
 {
 	if (!ctx || !covered || trim_labels < 0) {
@@ -186,7 +203,7 @@ static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *cove
 			.size = written,
 			.data = wire_buffer
 		};
-		return dnssec_sign_add(ctx, &wire_binary);
+		return sign_data_add(ctx, &wire_binary);
 	}
 
 	/* RFC4035 5.3.2
@@ -216,7 +233,7 @@ static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *cove
 			.size = rr_size,
 			.data = beginp
 		};
-		ret = dnssec_sign_add(ctx, &wire_binary);
+		ret = sign_data_add(ctx, &wire_binary);
 		if (ret != 0) {
 			break;
 		}
@@ -240,7 +257,7 @@ static int sign_ctx_add_records(dnssec_sign_ctx_t *ctx, const knot_rrset_t *cove
  * \return Error code, KNOT_EOK if successful.
  */
 /* TODO -- Taken from knot/src/knot/dnssec/rrset-sign.c. Re-write for better fit needed. */
-static int sign_ctx_add_data(dnssec_sign_ctx_t *ctx, const uint8_t *rrsig_rdata,
+static int sign_ctx_add_data(struct sign_data *ctx, const uint8_t *rrsig_rdata,
                              const knot_rrset_t *covered, uint32_t orig_ttl, int trim_labels)
 {
 	int result = sign_ctx_add_self(ctx, rrsig_rdata);
@@ -251,6 +268,58 @@ static int sign_ctx_add_data(dnssec_sign_ctx_t *ctx, const uint8_t *rrsig_rdata,
 	return sign_ctx_add_records(ctx, covered, orig_ttl, trim_labels);
 }
 
+/** The digest identifying a verified signature in the memo. */
+#define SIG_MEMO_DIGEST GNUTLS_DIG_SHA256
+#define SIG_MEMO_DIGEST_LEN 32
+
+typedef lru_t(uint8_t) sig_memo_lru_t;
+
+/** The memo of verified signatures; the process is single-threaded, same as its worker. */
+static sig_memo_lru_t *sig_memo = NULL;
+static struct kr_signature_memo_stats sig_memo_stats;
+
+int kr_signature_memo(unsigned size)
+{
+	lru_free(sig_memo);
+	sig_memo = NULL;
+	memset(&sig_memo_stats, 0, sizeof(sig_memo_stats));
+	if (size == 0) {
+		return kr_ok();
+	}
+	lru_create(&sig_memo, size, NULL, NULL);
+	return sig_memo ? kr_ok() : kr_error(ENOMEM);
+}
+
+struct kr_signature_memo_stats kr_signature_memo_stats(void)
+{
+	return sig_memo_stats;
+}
+
+/** Start the digest by the key and the signature; the signed data follow. */
+static gnutls_hash_hd_t sig_memo_digest(const dnssec_key_t *key,
+					const dnssec_binary_t *signature)
+{
+	dnssec_binary_t pubkey = { 0 };
+	if (!sig_memo || dnssec_key_get_pubkey(key, &pubkey) != DNSSEC_EOK
+	    || pubkey.size > UINT16_MAX || signature->size > UINT16_MAX) {
+		return NULL;
+	}
+	gnutls_hash_hd_t digest = NULL;
+	if (gnutls_hash_init(&digest, SIG_MEMO_DIGEST) != 0) {
+		return NULL;
+	}
+	const uint8_t algorithm = dnssec_key_get_algorithm(key);
+	const uint16_t lens[2] = { pubkey.size, signature->size };
+	if (gnutls_hash(digest, &algorithm, sizeof(algorithm)) != 0
+	    || gnutls_hash(digest, lens, sizeof(lens)) != 0
+	    || gnutls_hash(digest, pubkey.data, pubkey.size) != 0
+	    || gnutls_hash(digest, signature->data, signature->size) != 0) {
+		gnutls_hash_deinit(digest, NULL);
+		return NULL;
+	}
+	return digest;
+}
+
 int kr_check_signature(const knot_rdata_t *rrsig,
                        const dnssec_key_t *key, const knot_rrset_t *covered,
                        int trim_labels)
@@ -260,7 +329,7 @@ int kr_check_signature(const knot_rdata_t *rrsig,
 	}
 
 	int ret = 0;
-	dnssec_sign_ctx_t *sign_ctx = NULL;
+	struct sign_data sd = { NULL, NULL };
 	dnssec_binary_t signature = {
 		.data = /*const-cast*/(uint8_t*)knot_rrsig_signature(rrsig),
 		.size = knot_rrsig_signature_len(rrsig),
@@ -270,26 +339,49 @@ int kr_check_signature(const knot_rdata_t *rrsig,
 		goto fail;
 	}
 
-	if (dnssec_sign_new(&sign_ctx, key) != 0) {
+	if (dnssec_sign_new(&sd.ctx, key) != 0) {
 		ret = kr_error(ENOMEM);
 		goto fail;
 	}
+	sd.digest = sig_memo_digest(key, &signature);
 
 	uint32_t orig_ttl = knot_rrsig_original_ttl(rrsig);
 
-	if (sign_ctx_add_data(sign_ctx, rrsig->data, covered, orig_ttl, trim_labels) != 0) {
+	if (sign_ctx_add_data(&sd, rrsig->data, covered, orig_ttl, trim_labels) != 0) {
 		ret = kr_error(ENOMEM);
 		goto fail;
 	}
 
-	if (dnssec_sign_verify(sign_ctx, &signature) != 0) {
+	uint8_t digest[SIG_MEMO_DIGEST_LEN];
+	const bool have_digest = sd.digest;
+	if (have_digest) {
+		gnutls_hash_deinit(sd.digest, digest);
+		sd.digest = NULL;
+		if (lru_get_try(sig_memo, (const char *)digest, sizeof(digest))) {
+			++sig_memo_stats.hit;
+			ret = kr_ok();
+			goto fail;
+		}
+		++sig_memo_stats.miss;
+	}
+
+	if (dnssec_sign_verify(sd.ctx, &signature) != 0) {
 		ret = kr_error(EBADMSG);
 		goto fail;
 	}
 
+	if (have_digest) {
+		uint8_t *val = lru_get_new(sig_memo, (const char *)digest, sizeof(digest), NULL);
+		if (val) {
+			*val = 1;
+		}
+	}
 	ret = kr_ok();
 
 fail:
-	dnssec_sign_free(sign_ctx);
+	if (sd.digest) {
+		gnutls_hash_deinit(sd.digest, NULL);
+	}
+	dnssec_sign_free(sd.ctx);
 	return ret;
 }
@@ -7,6 +7,8 @@
 #include <libdnssec/key.h>
 #include <libknot/rrset.h>
 
+#include "lib/defines.h"
+
 /**
  * Performs referral authentication according to RFC4035 5.2, bullet 2
  * @param ref Referral RRSet. Currently only DS can be used.
@@ -23,7 +25,27 @@ int kr_authenticate_referral(const knot_rrset_t *ref, const dnssec_key_t *key);
  * @param covered     The covered RRSet.
  * @param trim_labels Number of the leftmost labels to be removed and replaced with '*.'.
  * @return            0 if signature valid, error code else.
+ * @note Valid signatures are remembered by a digest of the key, the signature
+ *       and the signed data, so verifying them again skips the public-key crypto.
  */
 int kr_check_signature(const knot_rdata_t *rrsig,
                        const dnssec_key_t *key, const knot_rrset_t *covered,
                        int trim_labels);
+
+/** Hit and miss counters of the memo of verified signatures; see kr_check_signature(). */
+struct kr_signature_memo_stats {
+	uint64_t hit;
+	uint64_t miss;
+};
+
+/**
+ * Set the number of verified signatures remembered by kr_check_signature();
+ * 0 disables it.  The memo is per process and it's also reset by this call.
+ * @return 0 or error code.
+ */
+KR_EXPORT
+int kr_signature_memo(unsigned size);
+
+/** Return the counters of the memo of verified signatures. */
+KR_EXPORT KR_PURE
+struct kr_signature_memo_stats kr_signature_memo_stats(void);
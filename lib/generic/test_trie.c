@@ -89,6 +89,50 @@ static void test_iter(void **state)
 	trie_it_free(it);
 }
 
+/** Compare keys in the order of the trie. */
+static int key_cmp(const char *k1, size_t len1, const char *k2, size_t len2)
+{
+	int ret = memcmp(k1, k2, MIN(len1, len2));
+	if (ret == 0)
+		ret = (len1 > len2) - (len1 < len2);
+	return ret;
+}
+
+static void test_iter_geq(void **state)
+{
+	static const char *probes[] = {
+		"", "A", "work", "workh", "workhand", "p", "zodiacal", "zz", "\xff",
+	};
+	trie_t *t = *state;
+	for (size_t p = 0; p < sizeof(probes) / sizeof(probes[0]); ++p) {
+		const size_t plen = strlen(probes[p]);
+		// find the expected key by a linear search
+		const char *expected = NULL;
+		for (int i = 0; i < dict_size; ++i) {
+			if (key_cmp(dict[i], KEY_LEN(dict[i]), probes[p], plen) >= 0
+			    && (!expected || strcmp(dict[i], expected) < 0))
+				expected = dict[i];
+		}
+		trie_it_t *it = trie_it_begin_geq(t, probes[p], plen);
+		assert_non_null(it);
+		if (expected) {
+			assert_false(trie_it_finished(it));
+			assert_string_equal(trie_it_key(it, NULL), expected);
+		} else {
+			assert_true(trie_it_finished(it));
+		}
+		trie_it_free(it);
+	}
+	// exact matches
+	for (int i = 0; i < dict_size; ++i) {
+		trie_it_t *it = trie_it_begin_geq(t, dict[i], KEY_LEN(dict[i]));
+		assert_non_null(it);
+		assert_false(trie_it_finished(it));
+		assert_string_equal(trie_it_key(it, NULL), dict[i]);
+		trie_it_free(it);
+	}
+}
+
 static void test_queue(void **state)
 {
 	trie_t *t = *state;
@@ -145,6 +189,7 @@ int main(int argc, char **argv)
 		unit_test(test_leq_bug),
 		unit_test(test_missing),
 		unit_test(test_iter),
+		unit_test(test_iter_geq),
 		unit_test(test_queue),
 	        group_test_teardown(test_deinit)
 	};
@@ -672,27 +672,23 @@ static int ns_next_leaf(nstack_t *ns)
 	} while (true);
 }
 
-int trie_get_leq(trie_t *tbl, const char *key, uint32_t len, trie_val_t **val)
+/*!
+ * \brief Advance the node stack (with the root only) to the less-or-equal leaf.
+ *
+ * \return KNOT_EOK for exact match, 1 for previous, KNOT_ENOENT for not-found,
+ *         or KNOT_E*.
+ */
+static int ns_get_leq(nstack_t *ns, const char *key, uint32_t len)
 {
-	assert(tbl && val);
-	*val = NULL; // so on failure we can just return;
-	if (tbl->weight == 0)
-		return KNOT_ENOENT;
-	{ // Intentionally un-indented; until end of function, to bound cleanup attr.
+	assert(ns && ns->len == 1);
 	// First find a key with longest-matching prefix
-	__attribute__((cleanup(ns_cleanup)))
-		nstack_t ns_local;
-	ns_init(&ns_local, tbl);
-	nstack_t *ns = &ns_local;
 	branch_t bp;
 	int un_leaf; // first unmatched character in the leaf
 	ERR_RETURN(ns_find_branch(ns, key, len, &bp, &un_leaf));
 	int un_key = bp.index < len ? (unsigned char)key[bp.index] : -256;
 	node_t *t = ns->stack[ns->len - 1];
-	if (bp.flags == 0) { // found exact match
-		*val = &t->leaf.val;
+	if (bp.flags == 0) // found exact match
 		return KNOT_EOK;
-	}
 	// Get t: the last node on matching path
 	if (isbranch(t) && t->branch.index == bp.index && t->branch.flags == bp.flags) {
 		// t is OK
@@ -723,8 +719,24 @@ int trie_get_leq(trie_t *tbl, const char *key, uint32_t len, trie_val_t **val)
 	}
 success:
 	assert(!isbranch(ns->stack[ns->len - 1]));
-	*val = &ns->stack[ns->len - 1]->leaf.val;
 	return 1;
+}
+
+int trie_get_leq(trie_t *tbl, const char *key, uint32_t len, trie_val_t **val)
+{
+	assert(tbl && val);
+	*val = NULL; // so on failure we can just return;
+	if (tbl->weight == 0)
+		return KNOT_ENOENT;
+	{ // Intentionally un-indented; until end of function, to bound cleanup attr.
+	__attribute__((cleanup(ns_cleanup)))
+		nstack_t ns_local;
+	ns_init(&ns_local, tbl);
+	nstack_t *ns = &ns_local;
+	int ret = ns_get_leq(ns, key, len);
+	if (ret == KNOT_EOK || ret == 1)
+		*val = &ns->stack[ns->len - 1]->leaf.val;
+	return ret;
 	}
 }
 
@@ -859,6 +871,34 @@ trie_it_t* trie_it_begin(trie_t *tbl)
 	return it;
 }
 
+trie_it_t* trie_it_begin_geq(trie_t *tbl, const char *key, uint32_t len)
+{
+	assert(tbl);
+	trie_it_t *it = malloc(sizeof(nstack_t));
+	if (!it)
+		return NULL;
+	ns_init(it, tbl);
+	if (it->len == 0) // empty tbl
+		return it;
+	int ret = ns_get_leq(it, key, len);
+	if (ret == 1) { // the previous leaf -> step to its successor
+		ret = ns_next_leaf(it);
+		if (ret == KNOT_ENOENT) { // all keys are less
+			it->len = 0;
+			ret = KNOT_EOK;
+		}
+	} else if (ret == KNOT_ENOENT) { // all keys are greater
+		it->len = 1; // the root stays at the bottom of the stack
+		ret = ns_first_leaf(it);
+	}
+	if (ret != KNOT_EOK) {
+		ns_cleanup(it);
+		free(it);
+		return NULL;
+	}
+	return it;
+}
+
 void trie_it_next(trie_it_t *it)
 {
 	assert(it && it->len);
@@ -105,6 +105,14 @@ int trie_del_first(trie_t *tbl, char *key, uint32_t *len, trie_val_t *val);
 KR_EXPORT
 trie_it_t* trie_it_begin(trie_t *tbl);
 
+/*!
+ * \brief Create a new iterator pointing to the first element not less than key.
+ *
+ * The iterator is finished right away if all keys are less.
+ */
+KR_EXPORT
+trie_it_t* trie_it_begin_geq(trie_t *tbl, const char *key, uint32_t len);
+
 /*!
  * \brief Advance the iterator to the next element.
  *
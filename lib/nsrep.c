@@ -13,7 +13,10 @@
 #include "lib/rplan.h"
 #include "lib/resolve.h"
 #include "lib/defines.h"
+#include "lib/cache/api.h"
 #include "lib/generic/pack.h"
+#include "lib/generic/trie.h"
+#include "lib/zonecut.h"
 #include "contrib/ucw/lib.h"
 
 /** Some built-in unfairness ... */
@@ -70,6 +73,116 @@ static void update_nsrep_set(struct kr_nsrep *ns, const knot_dname_t *name, uint
 
 #undef ADDR_SET
 
+/** Get the RTT entry for an address.  On a miss in the local LRU
+ * try the record shared by other instances through the cache (if enabled).
+ * @note The insertion may evict other LRU entries, so don't hold pointers to them. */
+static kr_nsrep_rtt_lru_entry_t * rtt_cache_get(struct kr_context *ctx,
+						 const void *addr, size_t addr_len)
+{
+	kr_nsrep_rtt_lru_entry_t *cached = lru_get_try(ctx->cache_rtt, addr, addr_len);
+	if (cached || !ctx->cache_infra_shared) {
+		return cached;
+	}
+	kr_nsrep_rtt_lru_entry_t shared;
+	if (kr_cache_infra_read(&ctx->cache, KR_CACHE_INFRA_RTT, addr, addr_len,
+				&shared, sizeof(shared)) != 0) {
+		return NULL;
+	}
+	cached = lru_get_new(ctx->cache_rtt, addr, addr_len, NULL);
+	if (cached) {
+		*cached = shared;
+	}
+	return cached;
+}
+
+/** Get the reputation of a NS name, see rtt_cache_get(). */
+static unsigned rep_cache_get(struct kr_context *ctx, const knot_dname_t *owner)
+{
+	const size_t owner_len = knot_dname_size(owner);
+	unsigned *cached = lru_get_try(ctx->cache_rep, (const char *)owner, owner_len);
+	if (cached) {
+		return *cached;
+	}
+	unsigned shared = 0;
+	if (!ctx->cache_infra_shared
+	    || kr_cache_infra_read(&ctx->cache, KR_CACHE_INFRA_REP, owner, owner_len,
+				   &shared, sizeof(shared)) != 0) {
+		return 0;
+	}
+	cached = lru_get_new(ctx->cache_rep, (const char *)owner, owner_len, NULL);
+	if (cached) {
+		*cached = shared;
+	}
+	return shared;
+}
+
+/** Remember that the record shared with other instances needs rewriting;
+ * the current value is written by kr_nsrep_infra_flush(). */
+static void infra_mark(struct kr_context *ctx, int tag, const void *id, size_t id_len)
+{
+	if (!ctx->cache_infra_dirty && !(ctx->cache_infra_dirty = trie_create(NULL))) {
+		return;
+	}
+	char key[1 + KNOT_DNAME_MAXLEN];
+	if (id_len > KNOT_DNAME_MAXLEN) {
+		assert(!EINVAL);
+		return;
+	}
+	key[0] = tag;
+	memcpy(key + 1, id, id_len);
+	(void)trie_get_ins(ctx->cache_infra_dirty, key, 1 + id_len);
+}
+
+int kr_nsrep_infra_flush(struct kr_context *ctx)
+{
+	if (!ctx) {
+		return kr_error(EINVAL);
+	}
+	trie_t *dirty = ctx->cache_infra_dirty;
+	if (!dirty || trie_weight(dirty) == 0) {
+		return 0;
+	}
+	trie_it_t *it = trie_it_begin(dirty);
+	if (!it) {
+		return kr_error(ENOMEM);
+	}
+	int count = 0;
+	for (; !trie_it_finished(it); trie_it_next(it)) {
+		size_t len;
+		const char *key = trie_it_key(it, &len);
+		const char *id = key + 1;
+		const size_t id_len = len - 1;
+		int ret = kr_error(ENOENT);
+		if (key[0] == KR_CACHE_INFRA_RTT) {
+			const kr_nsrep_rtt_lru_entry_t *cur =
+				lru_get_try(ctx->cache_rtt, id, id_len);
+			if (cur) {
+				kr_nsrep_rtt_lru_entry_t shared;
+				memset(&shared, 0, sizeof(shared)); /* no garbage in padding */
+				shared.score = cur->score;
+				shared.tout_timestamp = cur->tout_timestamp;
+				shared.srtt = cur->srtt;
+				shared.rttvar = cur->rttvar;
+				shared.loss = cur->loss;
+				ret = kr_cache_infra_write(&ctx->cache, KR_CACHE_INFRA_RTT,
+							   id, id_len, &shared, sizeof(shared));
+			}
+		} else if (key[0] == KR_CACHE_INFRA_REP) {
+			const unsigned *cur = lru_get_try(ctx->cache_rep, id, id_len);
+			if (cur) {
+				ret = kr_cache_infra_write(&ctx->cache, KR_CACHE_INFRA_REP,
+							   id, id_len, cur, sizeof(*cur));
+			}
+		}
+		count += (ret == 0);
+	}
+	trie_it_free(it);
+	trie_clear(dirty);
+	/* All of them in a single transaction. */
+	int ret = kr_cache_commit(&ctx->cache);
+	return ret ? ret : count;
+}
+
 /**
  * \param addr_set pack with one IP address per element */
 static unsigned eval_addr_set(const pack_t *addr_set, struct kr_context *ctx,
@@ -81,6 +194,15 @@ static unsigned eval_addr_set(const pack_t *addr_set, struct kr_context *ctx,
 	unsigned rtt_cache_entry_score[KR_NSREP_MAXADDR] = { score, KR_NS_MAX_SCORE + 1, };
 	uint64_t now = kr_now();
 
+	/* Pull records shared by other instances before we start holding
+	 * pointers into the LRU. */
+	if (rtt_cache && ctx->cache_infra_shared) {
+		for (uint8_t *it = pack_head(*addr_set); it != pack_tail(*addr_set);
+							it = pack_obj_next(it)) {
+			(void)rtt_cache_get(ctx, pack_obj_val(it), pack_obj_len(it));
+		}
+	}
+
 	/* Name server is better candidate if it has address record. */
 	for (uint8_t *it = pack_head(*addr_set); it != pack_tail(*addr_set);
 						it = pack_obj_next(it)) {
@@ -196,11 +318,7 @@ static int eval_nsrep(const knot_dname_t *owner, const pack_t *addr_set, struct
 
 	/* Fetch NS reputation */
 	if (ctx->cache_rep) {
-		unsigned *cached = lru_get_try(ctx->cache_rep, (const char *)owner,
-					       knot_dname_size(owner));
-		if (cached) {
-			reputation = *cached;
-		}
+		reputation = rep_cache_get(ctx, owner);
 	}
 
 	/* Favour nameservers with unknown addresses to probe them,
@@ -226,7 +344,7 @@ static int eval_nsrep(const knot_dname_t *owner, const pack_t *addr_set, struct
 		score = eval_addr_set(addr_set, ctx, qry->flags, score, addr_choice);
 	}
 
-	/* Probabilistic bee foraging strategy (naive).
+	/* Probabilistic bee foraging strategy, i.e. epsilon-greedy over the expected latency.
 	 * The fastest NS is preferred by workers until it is depleted (timeouts or degrades),
 	 * at the same time long distance scouts probe other sources (low probability).
 	 * Servers on TIMEOUT will not have probed at all.
@@ -298,7 +416,7 @@ int kr_nsrep_set(struct kr_query *qry, size_t index, const struct sockaddr *sock
 	/* Retrieve RTT from cache */
 	struct kr_context *ctx = qry->ns.ctx;
 	kr_nsrep_rtt_lru_entry_t *rtt_cache_entry = ctx
-		? lru_get_try(ctx->cache_rtt, kr_inaddr(sock), kr_family_len(sock->sa_family))
+		? rtt_cache_get(ctx, kr_inaddr(sock), kr_family_len(sock->sa_family))
 		: NULL;
 	if (rtt_cache_entry) {
 		qry->ns.score = MIN(qry->ns.score, rtt_cache_entry->score);
@@ -390,10 +508,43 @@ int kr_nsrep_elect_addr(struct kr_query *qry, struct kr_context *ctx)
 
 #undef ELECT_INIT
 
+unsigned kr_nsrep_rto(const kr_nsrep_rtt_lru_entry_t *entry)
+{
+	if (!entry || entry->srtt == 0) {
+		return 0;
+	}
+	return entry->srtt + 4 * entry->rttvar;
+}
+
+/** Add a measured RTT or a timeout (lost) to the record and return its new score.
+ * SRTT and RTTVAR are smoothed like in TCP (RFC 6298), rounded to milliseconds. */
+static unsigned rtt_sample(kr_nsrep_rtt_lru_entry_t *cur, unsigned score, bool lost)
+{
+	if (lost) {
+		cur->loss += (KR_NS_LOSS_ONE - cur->loss) / 8;
+		/* Repeated timeouts mark the address as "timeouted", see KR_NS_TIMEOUT. */
+		return (cur->score + score) / 2;
+	}
+	cur->loss -= (cur->loss + 7) / 8;
+	/* An answer did come, however late. */
+	score = MIN(score, KR_NS_TIMEOUT);
+	if (cur->srtt == 0) {
+		cur->srtt = score;
+		cur->rttvar = score / 2;
+	} else {
+		const unsigned diff = score > cur->srtt ? score - cur->srtt : cur->srtt - score;
+		cur->rttvar = (3 * cur->rttvar + diff + 2) / 4;
+		cur->srtt = (7 * cur->srtt + score + 4) / 8;
+	}
+	/* Each timeout costs waiting for the retransmit. */
+	const unsigned wait = MIN(kr_nsrep_rto(cur), KR_CONN_RETRY);
+	return cur->srtt + cur->loss * wait / KR_NS_LOSS_ONE;
+}
+
 int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
 			unsigned score, kr_nsrep_rtt_lru_t *cache, int umode)
 {
-	if (!cache || umode > KR_NS_MAX || umode < 0) {
+	if (!cache || umode > KR_NS_LOST || umode < 0) {
 		return kr_error(EINVAL);
 	}
 
@@ -424,16 +575,22 @@ int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
 	}
 	/* If there's nothing to update, we reset it unless KR_NS_UPDATE_NORESET
 	 * mode was requested.  New items are zeroed by LRU automatically. */
-	if (is_new_entry && umode != KR_NS_UPDATE_NORESET) {
+	if (is_new_entry && umode != KR_NS_UPDATE_NORESET && umode != KR_NS_LOST) {
 		umode = KR_NS_RESET;
 	}
 	unsigned new_score = 0;
-	/* Update score, by default smooth over last two measurements. */
+	/* Update score, by default to the expected latency. */
 	switch (umode) {
 	case KR_NS_UPDATE:
 	case KR_NS_UPDATE_NORESET:
-		new_score = (cur->score + score) / 2; break;
-	case KR_NS_RESET:  new_score = score; break;
+	case KR_NS_LOST:
+		new_score = rtt_sample(cur, score, umode == KR_NS_LOST); break;
+	case KR_NS_RESET:
+		new_score = score;
+		cur->srtt = score < KR_NS_DEAD ? score : 0;
+		cur->rttvar = cur->srtt / 2;
+		cur->loss = 0;
+		break;
 	case KR_NS_ADD:    new_score = MIN(KR_NS_MAX_SCORE - 1, cur->score + score); break;
 	case KR_NS_MAX:    new_score = MAX(cur->score, score); break;
 	default:           return kr_error(EINVAL);
@@ -442,11 +599,24 @@ int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
 	if (new_score > KR_NS_MAX_SCORE) {
 		new_score = KR_NS_MAX_SCORE;
 	}
-	if (new_score >= KR_NS_TIMEOUT && cur->score < KR_NS_TIMEOUT) {
+	const unsigned old_score = cur->score;
+	if (new_score >= KR_NS_TIMEOUT && old_score < KR_NS_TIMEOUT) {
 		/* Set the timestamp only when NS became "timeouted" */
 		cur->tout_timestamp = kr_now();
 	}
 	cur->score = new_score;
+
+	/* Publish the change to other instances, unless it's just noise. */
+	struct kr_context *ctx = ns ? ns->ctx : NULL;
+	if (ctx && ctx->cache_infra_shared && ctx->cache_rtt == cache) {
+		const unsigned diff = new_score > old_score
+			? new_score - old_score : old_score - new_score;
+		const bool timeout_changed =
+			(new_score >= KR_NS_TIMEOUT) != (old_score >= KR_NS_TIMEOUT);
+		if (is_new_entry || timeout_changed || diff > old_score / 4) {
+			infra_mark(ctx, KR_CACHE_INFRA_RTT, addr_in, addr_len);
+		}
+	}
 	return kr_ok();
 }
 
@@ -459,10 +629,21 @@ int kr_nsrep_update_rep(struct kr_nsrep *ns, unsigned reputation, kr_nsrep_lru_t
 	/* Store in the struct */
 	ns->reputation = reputation;
 	/* Store reputation in the LRU cache */
-	unsigned *cur = lru_get_new(cache, (const char *)ns->name,
-				    knot_dname_size(ns->name), NULL);
-	if (cur) {
-		*cur = reputation;
+	const size_t name_len = knot_dname_size(ns->name);
+	unsigned *cur = lru_get_new(cache, (const char *)ns->name, name_len, NULL);
+	if (!cur) {
+		return kr_ok();
+	}
+	const bool changed = *cur != reputation;
+	*cur = reputation;
+	/* Remembered cuts left out addresses based on the old reputation. */
+	if (changed) {
+		kr_zonecut_memo_drop_ns(ns->name);
+	}
+	/* Publish the change to other instances. */
+	struct kr_context *ctx = ns->ctx;
+	if (changed && ctx && ctx->cache_infra_shared && ctx->cache_rep == cache) {
+		infra_mark(ctx, KR_CACHE_INFRA_REP, ns->name, name_len);
 	}
 	return kr_ok();
 }
@@ -507,9 +688,9 @@ int kr_nsrep_sort(struct kr_nsrep *ns, struct kr_context *ctx)
 		if (sa->sa_family == AF_UNSPEC) {
 			break;
 		}
-		kr_nsrep_rtt_lru_entry_t *rtt_cache_entry = lru_get_try(rtt_cache,
-									kr_inaddr(sa),
-									kr_family_len(sa->sa_family));
+		kr_nsrep_rtt_lru_entry_t *rtt_cache_entry = rtt_cache_get(ctx,
+									  kr_inaddr(sa),
+									  kr_family_len(sa->sa_family));
 		if (!rtt_cache_entry) {
 			scores[i] = 1; /* prefer unknown to probe RTT */
 		} else if (rtt_cache_entry->score < KR_NS_FWD_TIMEOUT) {
@@ -54,22 +54,32 @@ enum kr_ns_rep {
  * KR_NS_UPDATE_NORESET mode had choosen.
  */
 enum kr_ns_update_mode {
-	KR_NS_UPDATE = 0,     /**< Update as smooth over last two measurements */
+	KR_NS_UPDATE = 0,     /**< Add a measurement, see kr_nsrep_update_rtt() */
 	KR_NS_UPDATE_NORESET, /**< Same as KR_NS_UPDATE, but disable fallback to
 			       *   KR_NS_RESET on newly added entries.
 			       *   Zero is used as initial value. */
 	KR_NS_RESET,          /**< Set to given value */
 	KR_NS_ADD,            /**< Increment current value */
-	KR_NS_MAX             /**< Set to maximum of current/proposed value. */
+	KR_NS_MAX,            /**< Set to maximum of current/proposed value. */
+	KR_NS_LOST            /**< Add a timeout, i.e. a query without answer;
+			       *   the score is that of a dead server, e.g. KR_NS_DEAD.
+			       *   Doesn't reset new entries, like KR_NS_UPDATE_NORESET. */
 };
 
 struct kr_nsrep_rtt_lru_entry {
-	unsigned score;	          /* combined rtt */
+	unsigned score;	          /* combined rtt, i.e. the expected latency */
 	uint64_t tout_timestamp;  /* The time when score became
-				   * greater or equal then KR_NS_TIMEOUT.
+				   * greater or equal then KR_NS_TIMEOUT,
+				   * or when the address was last probed after that.
 				   * Is meaningful only when score >= KR_NS_TIMEOUT */
+	uint16_t srtt;            /* smoothed RTT in ms; 0 if not measured yet */
+	uint16_t rttvar;          /* RTT variation in ms */
+	uint16_t loss;            /* smoothed share of timeouts, in 1/KR_NS_LOSS_ONE */
 };
 
+/** Fixed-point one of kr_nsrep_rtt_lru_entry::loss */
+#define KR_NS_LOSS_ONE 1000
+
 typedef struct kr_nsrep_rtt_lru_entry kr_nsrep_rtt_lru_entry_t;
 
 /**
@@ -130,19 +140,42 @@ int kr_nsrep_elect_addr(struct kr_query *qry, struct kr_context *ctx);
 /**
  * Update NS address RTT information.
  *
- * @brief In KR_NS_UPDATE mode reputation is smoothed over last N measurements.
- * 
+ * @brief In KR_NS_UPDATE mode the score gets the expected latency of the address,
+ * i.e. smoothed RTT plus the time lost waiting for retransmits due to timeouts.
+ * Only KR_NS_LOST counts as a timeout; measurements are capped at KR_NS_TIMEOUT,
+ * so that slow answers (e.g. from forwarders) don't look like losses.
+ *
  * @param  ns           updated NS representation
  * @param  addr         chosen address (NULL for first)
  * @param  score        new score (i.e. RTT), see enum kr_ns_score
  * @param  cache        RTT LRU cache
- * @param  umode        update mode (KR_NS_UPDATE or KR_NS_RESET or KR_NS_ADD)
+ * @param  umode        update mode, see enum kr_ns_update_mode
  * @return              0 on success, error code on failure
  */
 KR_EXPORT
 int kr_nsrep_update_rtt(struct kr_nsrep *ns, const struct sockaddr *addr,
 			unsigned score, kr_nsrep_rtt_lru_t *cache, int umode);
 
+/**
+ * Retransmit timeout for an address: SRTT + 4 * RTTVAR, like in TCP (RFC 6298).
+ *
+ * @param  entry        RTT record of the address
+ * @return              the timeout in milliseconds, or 0 if no RTT was measured yet
+ */
+KR_EXPORT
+unsigned kr_nsrep_rto(const kr_nsrep_rtt_lru_entry_t *entry);
+
+/**
+ * Write the RTT and reputation records changed since the last call
+ * into the cache, to be shared with other instances (see cache.ns_share()),
+ * and commit them in a single transaction.
+ *
+ * @param  ctx          resolution context
+ * @return              the number of records written, or an error code
+ */
+KR_EXPORT
+int kr_nsrep_infra_flush(struct kr_context *ctx);
+
 /**
  * Update NSSET reputation information.
  * 
@@ -299,6 +299,47 @@ static int ns_fetch_cut(struct kr_query *qry, const knot_dname_t *requested_name
 	return KR_STATE_PRODUCE;
 }
 
+/** Start a background lookup, unless the request has used up its limit. */
+static void ns_resolve_bg(struct kr_request *req, const knot_dname_t *name, uint16_t type)
+{
+	if (req->count_ns_bg < KR_NS_BG_LIMIT && req->ctx->resolve_bg(req, name, type) == 0) {
+		++req->count_ns_bg;
+	}
+}
+
+/** Look up addresses of the other glueless NS names in background, in parallel
+ * with the sub-query for the elected one.  Whichever address arrives first is used,
+ * see kr_resolve_ns_arrived().  Internal requests don't fan out further. */
+static void ns_resolve_addr_bg(struct kr_query *qry, struct kr_request *req, uint16_t type)
+{
+	struct kr_context *ctx = req->ctx;
+	if (!ctx->resolve_bg || !req->qsource.addr) {
+		return;
+	}
+	const bool want_ipv6 = !ctx->options.NO_IPV6;
+	const bool want_ipv4 = !ctx->options.NO_IPV4;
+	if (type == KNOT_RRTYPE_AAAA && want_ipv4) {
+		ns_resolve_bg(req, qry->ns.name, KNOT_RRTYPE_A);
+	}
+	trie_it_t *it = trie_it_begin(qry->zone_cut.nsset);
+	for (; it && !trie_it_finished(it); trie_it_next(it)) {
+		const knot_dname_t *name = (const knot_dname_t *)trie_it_key(it, NULL);
+		const pack_t *addrs = *trie_it_val(it);
+		/* Names within the cut can't be resolved without its glue. */
+		if (addrs->len > 0 || knot_dname_is_equal(name, qry->ns.name)
+		    || knot_dname_in_bailiwick(name, qry->zone_cut.name) >= 0) {
+			continue;
+		}
+		if (want_ipv6) {
+			ns_resolve_bg(req, name, KNOT_RRTYPE_AAAA);
+		}
+		if (want_ipv4) {
+			ns_resolve_bg(req, name, KNOT_RRTYPE_A);
+		}
+	}
+	trie_it_free(it);
+}
+
 static int ns_resolve_addr(struct kr_query *qry, struct kr_request *req)
 {
 	struct kr_rplan *rplan = &req->rplan;
@@ -360,10 +401,100 @@ static int ns_resolve_addr(struct kr_query *qry, struct kr_request *req)
 		}
 	} else {
 		next->flags.AWAIT_CUT = true;
+		/* Only with the first address family tried for this NS. */
+		if (next_type == KNOT_RRTYPE_AAAA || ctx->options.NO_IPV6) {
+			ns_resolve_addr_bg(qry, req, next_type);
+		}
 	}
 	return ret;
 }
 
+/** Add addresses of ns from cache to the zone cut of qry.
+ * \return true if any was added */
+static bool ns_addr_from_cache(struct kr_request *req, struct kr_query *qry,
+			       const knot_dname_t *ns, uint16_t type)
+{
+	struct kr_cache_p peek;
+	if (kr_cache_peek_exact(&req->ctx->cache, ns, type, &peek) != 0
+	    || kr_cache_ttl(&peek, qry, ns, type) < 0) {
+		return false;
+	}
+	knot_rdataset_t rds = { 0 };
+	if (kr_cache_materialize(&rds, &peek, &req->pool) < 0) {
+		return false;
+	}
+	const int len = type == KNOT_RRTYPE_A ? sizeof(struct in_addr) : sizeof(struct in6_addr);
+	bool added = false;
+	knot_rdata_t *rd = rds.rdata;
+	for (uint16_t i = 0; i < rds.count; ++i, rd = knot_rdataset_next(rd)) {
+		if (rd->len == len && kr_zonecut_add(&qry->zone_cut, ns, rd->data, len) == 0) {
+			added = true;
+		}
+	}
+	return added;
+}
+
+bool kr_resolve_ns_arrived(struct kr_request *request)
+{
+	if (!request) {
+		return false;
+	}
+	/* Find the innermost query waiting for an NS address; the sub-queries
+	 * for that address are above it in the plan. */
+	struct kr_rplan *rplan = &request->rplan;
+	struct kr_query *qry = NULL;
+	for (size_t i = rplan->pending.len; i > 1; --i) {
+		struct kr_query *sub = rplan->pending.at[i - 1];
+		struct kr_query *q = rplan->pending.at[i - 2];
+		if ((q->flags.AWAIT_IPV4 || q->flags.AWAIT_IPV6) && q->ns.name
+		    && sub->parent == q && knot_dname_is_equal(sub->sname, q->ns.name)) {
+			qry = q;
+			break;
+		}
+	}
+	if (!qry || qry->flags.STUB || qry->flags.FORWARD) {
+		return false;
+	}
+	const bool want_ipv6 = !request->ctx->options.NO_IPV6 && !qry->flags.NO_IPV6;
+	const bool want_ipv4 = !request->ctx->options.NO_IPV4 && !qry->flags.NO_IPV4;
+	const knot_dname_t *ns_name = NULL;
+	trie_it_t *it = trie_it_begin(qry->zone_cut.nsset);
+	for (; it && !trie_it_finished(it); trie_it_next(it)) {
+		const knot_dname_t *name = (const knot_dname_t *)trie_it_key(it, NULL);
+		const pack_t *addrs = *trie_it_val(it);
+		/* The elected NS counts, too; its other address family may come first. */
+		if (addrs->len > 0 || knot_dname_in_bailiwick(name, qry->zone_cut.name) >= 0) {
+			continue;
+		}
+		bool found = want_ipv6 && ns_addr_from_cache(request, qry, name, KNOT_RRTYPE_AAAA);
+		found = (want_ipv4 && ns_addr_from_cache(request, qry, name, KNOT_RRTYPE_A)) || found;
+		if (found) {
+			ns_name = name;
+			break;
+		}
+	}
+	trie_it_free(it);
+	if (!ns_name) {
+		return false;
+	}
+
+	/* Drop the sub-queries for the address of the NS elected before. */
+	while (array_tail(rplan->pending) != qry) {
+		struct kr_query *sub = array_tail(rplan->pending);
+		ITERATE_LAYERS(request, sub, reset);
+		kr_rplan_pop(rplan, sub);
+	}
+	WITH_VERBOSE(qry) {
+		KR_DNAME_GET_STR(ns_str, ns_name);
+		VERBOSE_MSG(qry, "=> address of NS '%s' arrived first, continuing with it\n", ns_str);
+	}
+	/* Production continues with electing an address of this NS. */
+	qry->ns.name = ns_name;
+	qry->ns.reputation = 0;
+	memset(qry->ns.addr, 0, sizeof(qry->ns.addr));
+	return true;
+}
+
 static int edns_put(knot_pkt_t *pkt, bool reclaim)
 {
 	if (!pkt->opt_rr) {
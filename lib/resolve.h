@@ -13,6 +13,7 @@
 #include "lib/layer.h"
 #include "lib/generic/map.h"
 #include "lib/generic/array.h"
+#include "lib/generic/trie.h"
 #include "lib/nsrep.h"
 #include "lib/rplan.h"
 #include "lib/module.h"
@@ -158,6 +159,10 @@ struct kr_context
 	kr_nsrep_rtt_lru_t *cache_rtt;
 	unsigned cache_rtt_tout_retry_interval;
 	kr_nsrep_lru_t *cache_rep;
+	/** Share cache_rtt and cache_rep with other instances through the cache. */
+	bool cache_infra_shared;
+	/** Keys of shared records awaiting kr_nsrep_infra_flush(); NULL until needed. */
+	trie_t *cache_infra_dirty;
 	module_array_t *modules;
 	/* The cookie context structure should not be held within the cookies
 	 * module because of better access. */
@@ -165,6 +170,10 @@ struct kr_context
 	kr_cookie_lru_t *cache_cookie;
 	int32_t tls_padding; /**< See net.tls_padding in ../daemon/README.rst -- -1 is "true" (default policy), 0 is "false" (no padding) */
 	knot_mm_t *pool;
+	/** Queue a lookup to be resolved in a request of its own, so that the answer
+	 * gets into cache; NULL if not supported.  See ns_resolve_addr().
+	 * Once it's done, req may be resumed through kr_resolve_ns_arrived(). */
+	int (*resolve_bg)(struct kr_request *req, const knot_dname_t *name, uint16_t type);
 };
 
 /* Kept outside, because kres-gen.lua can't handle this depth
@@ -229,6 +238,7 @@ struct kr_request {
 	unsigned int uid; /** for logging purposes only */
 	unsigned int count_no_nsaddr;
 	unsigned int count_fail_row;
+	unsigned int count_ns_bg; /**< lookups of NS addresses started in background */
 };
 
 /** Initializer for an array of *_selected. */
@@ -281,6 +291,23 @@ int kr_resolve_consume(struct kr_request *request, const struct sockaddr *src, k
 KR_EXPORT
 int kr_resolve_produce(struct kr_request *request, struct sockaddr **dst, int *type, knot_pkt_t *packet);
 
+/**
+ * Continue with a nameserver whose address has arrived in cache meanwhile.
+ *
+ * It applies when a query waits for sub-queries resolving the address of the elected
+ * nameserver, and a nameserver of the same zone cut, possibly the elected one
+ * with the other address family, has got an address in cache,
+ * e.g. from a lookup started through kr_context::resolve_bg.  The sub-queries
+ * are dropped and the query continues with that nameserver.
+ *
+ * @note The caller must abandon the outstanding query and call kr_resolve_produce().
+ *
+ * @param  request request state (waiting for an answer)
+ * @return         true if the resolution plan has changed
+ */
+KR_EXPORT
+bool kr_resolve_ns_arrived(struct kr_request *request);
+
 /**
  * Finalises the outbound query packet with the knowledge of the IP addresses.
  *
@@ -3,8 +3,14 @@
  */
 
 #include <netinet/in.h>
+#include <time.h>
 
 #include "tests/unit/test.h"
+#include "contrib/ucw/mempool.h"
+#include "lib/cache/api.h"
+#include "lib/cache/cdb_memory.h"
+#include "lib/nsrep.h"
+#include "lib/resolve.h"
 #include "lib/zonecut.h"
 
 static void test_zonecut_params(void **state)
@@ -47,11 +53,159 @@ static void test_zonecut_copy(void **state)
 	kr_zonecut_deinit(&cut2);
 }
 
+/** Context for finding cuts in a memory:// cache. */
+static struct {
+	struct kr_context ctx;
+	struct kr_request req;
+	struct kr_query qry;
+	knot_mm_t pool;
+	uint32_t now;
+} memo_env;
+
+static void memo_setup(void **state)
+{
+	memset(&memo_env, 0, sizeof(memo_env));
+	struct kr_cdb_opts opts = { "", 1024 * 1024, 0 };
+	assert_int_equal(kr_cache_open(&memo_env.ctx.cache, kr_cdb_memory(), &opts, NULL), 0);
+	lru_create(&memo_env.ctx.cache_rep, 64, NULL, NULL);
+	assert_non_null(memo_env.ctx.cache_rep);
+	memo_env.pool.ctx = mp_new(4096);
+	memo_env.pool.alloc = (knot_mm_alloc_t)mp_alloc;
+	memo_env.req.ctx = &memo_env.ctx;
+	memo_env.qry.request = &memo_env.req;
+	memo_env.now = time(NULL);
+	assert_int_equal(kr_zonecut_memo(16), 0);
+}
+
+static void memo_teardown(void **state)
+{
+	kr_zonecut_memo(0);
+	lru_free(memo_env.ctx.cache_rep);
+	kr_cache_close(&memo_env.ctx.cache);
+	mp_delete(memo_env.pool.ctx);
+}
+
+static void memo_insert(const char *owner, uint16_t type, const void *rdata,
+			uint16_t rdlen, uint32_t ttl, uint8_t rank)
+{
+	knot_dname_t owner_wire[KNOT_DNAME_MAXLEN];
+	assert_non_null(knot_dname_from_str(owner_wire, owner, sizeof(owner_wire)));
+	knot_rrset_t rr;
+	knot_rrset_init(&rr, owner_wire, type, KNOT_CLASS_IN, ttl);
+	assert_int_equal(knot_rrset_add_rdata(&rr, rdata, rdlen, NULL), 0);
+	assert_int_equal(kr_cache_insert_rr(&memo_env.ctx.cache, &rr, NULL, rank,
+					    memo_env.now), 0);
+	knot_rdataset_clear(&rr.rrs, NULL);
+	assert_int_equal(kr_cache_commit(&memo_env.ctx.cache), 0);
+}
+
+/** Cache example.com with a single NS that has both addresses. */
+static void memo_insert_cut(uint32_t addr_ttl)
+{
+	const uint8_t ns[] = "\2ns\7example\3com";
+	const uint8_t a[4] = { 192, 0, 2, 1 };
+	const uint8_t aaaa[16] = { 0x20, 0x01, 0x0d, 0xb8, [15] = 1 };
+	const uint8_t rank = KR_RANK_INSECURE | KR_RANK_AUTH;
+	memo_insert("example.com", KNOT_RRTYPE_NS, ns, sizeof(ns), 3600, rank);
+	memo_insert("ns.example.com", KNOT_RRTYPE_A, a, sizeof(a), addr_ttl, rank);
+	memo_insert("ns.example.com", KNOT_RRTYPE_AAAA, aaaa, sizeof(aaaa), 3600, rank);
+}
+
+/** Find the cut for www.example.com, age seconds after the records were cached. */
+static void memo_find(uint32_t age)
+{
+	struct kr_zonecut cut;
+	assert_int_equal(kr_zonecut_init(&cut, (const uint8_t *)"", &memo_env.pool), 0);
+	memo_env.qry.timestamp.tv_sec = memo_env.now + age;
+	bool secured = false;
+	assert_int_equal(kr_zonecut_find_cached(&memo_env.ctx, &cut,
+			(const uint8_t *)"\3www\7example\3com", &memo_env.qry, &secured), 0);
+	assert_true(knot_dname_is_equal(cut.name, (const uint8_t *)"\7example\3com"));
+	assert_non_null(kr_zonecut_find(&cut, (const uint8_t *)"\2ns\7example\3com"));
+	kr_zonecut_deinit(&cut);
+}
+
+static void memo_assert_stats(uint64_t hit, uint64_t miss)
+{
+	const struct kr_zonecut_memo_stats stats = kr_zonecut_memo_stats();
+	assert_int_equal(stats.hit, hit);
+	assert_int_equal(stats.miss, miss);
+}
+
+static void test_zonecut_memo_hit(void **state)
+{
+	memo_insert_cut(3600);
+	memo_find(0);
+	memo_assert_stats(0, 1);
+	memo_find(10);
+	memo_find(20);
+	memo_assert_stats(2, 1);
+}
+
+static void test_zonecut_memo_expire(void **state)
+{
+	memo_insert_cut(30);
+	memo_find(0);
+	memo_find(10);
+	memo_assert_stats(1, 1);
+	/* The A record has expired, so the cut is found in cache again. */
+	memo_find(31);
+	memo_assert_stats(1, 2);
+}
+
+static void test_zonecut_memo_stash(void **state)
+{
+	const uint8_t ns[] = "\2ns\7example\3com";
+	const uint8_t insecure = KR_RANK_INSECURE | KR_RANK_AUTH;
+	const uint8_t ds[4 + 32] = { 0, 1, 13, 2 };
+	const uint8_t dnskey[4 + 64] = { 1, 1, 3, 13 };
+	const struct {
+		uint16_t type;
+		const uint8_t *rdata;
+		uint16_t rdlen;
+		uint8_t rank; /**< the NS needs a higher one to get overwritten */
+	} stashed[] = {
+		{ KNOT_RRTYPE_NS, ns, sizeof(ns), KR_RANK_SECURE },
+		{ KNOT_RRTYPE_DS, ds, sizeof(ds), insecure },
+		{ KNOT_RRTYPE_DNSKEY, dnskey, sizeof(dnskey), insecure },
+	};
+	memo_insert_cut(3600);
+	memo_find(0);
+	for (int i = 0; i < sizeof(stashed) / sizeof(stashed[0]); ++i) {
+		memo_find(0);
+		memo_assert_stats(i + 1, i + 1);
+		memo_insert("example.com", stashed[i].type, stashed[i].rdata,
+			    stashed[i].rdlen, 3600, stashed[i].rank);
+		/* The cut is found in cache again and remembered. */
+		memo_find(0);
+		memo_assert_stats(i + 1, i + 2);
+	}
+}
+
+static void test_zonecut_memo_reputation(void **state)
+{
+	memo_insert_cut(3600);
+	memo_find(0);
+	memo_find(0);
+	memo_assert_stats(1, 1);
+	struct kr_nsrep ns = {
+		.name = (const uint8_t *)"\2ns\7example\3com",
+		.ctx = &memo_env.ctx,
+	};
+	assert_int_equal(kr_nsrep_update_rep(&ns, KR_NS_NOIP6, memo_env.ctx.cache_rep), 0);
+	memo_find(0);
+	memo_assert_stats(1, 2);
+}
+
 int main(void)
 {
 	const UnitTest tests[] = {
 	        unit_test(test_zonecut_params),
-	        unit_test(test_zonecut_copy)
+	        unit_test(test_zonecut_copy),
+	        unit_test_setup_teardown(test_zonecut_memo_hit, memo_setup, memo_teardown),
+	        unit_test_setup_teardown(test_zonecut_memo_expire, memo_setup, memo_teardown),
+	        unit_test_setup_teardown(test_zonecut_memo_stash, memo_setup, memo_teardown),
+	        unit_test_setup_teardown(test_zonecut_memo_reputation, memo_setup, memo_teardown),
 	};
 
 	return run_tests(tests);
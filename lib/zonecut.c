@@ -5,6 +5,8 @@
 #include "lib/zonecut.h"
 
 #include "contrib/cleanup.h"
+#include "contrib/murmurhash3/murmurhash3.h"
+#include "lib/cache/cdb_memory.h"
 #include "lib/defines.h"
 #include "lib/generic/pack.h"
 #include "lib/layer.h"
@@ -287,7 +289,8 @@ int kr_zonecut_set_sbelt(struct kr_context *ctx, struct kr_zonecut *cut)
 
 /** Fetch address for zone cut.  Any rank is accepted (i.e. glue as well). */
 static addrset_info_t fetch_addr(pack_t *addrs, const knot_dname_t *ns, uint16_t rrtype,
-				 knot_mm_t *mm_pool, const struct kr_query *qry)
+				 knot_mm_t *mm_pool, const struct kr_query *qry,
+				 int32_t * restrict ttl)
 // LATER(optim.): excessive data copying
 {
 	int rdlen;
@@ -312,6 +315,7 @@ static addrset_info_t fetch_addr(pack_t *addrs, const knot_dname_t *ns, uint16_t
 	if (new_ttl < 0) {
 		return AI_UNKNOWN;
 	}
+	*ttl = MIN(*ttl, new_ttl);
 
 	knot_rrset_t cached_rr;
 	knot_rrset_init(&cached_rr, /*const-cast*/(knot_dname_t *)ns, rrtype,
@@ -367,10 +371,13 @@ static addrset_info_t fetch_addr(pack_t *addrs, const knot_dname_t *ns, uint16_t
 	return result;
 }
 
-/** Fetch best NS for zone cut. */
+/** Fetch best NS for zone cut.
+ * @param ttl      lowered to the TTL of NS and addresses
+ * @param complete set iff all NSs have their addresses in cache and independently of qry
+ */
 static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut,
 		    const knot_dname_t *name, const struct kr_query *qry,
-		    uint8_t * restrict rank)
+		    uint8_t * restrict rank, int32_t * restrict ttl, bool * restrict complete)
 {
 	struct kr_cache_p peek;
 	int ret = kr_cache_peek_exact(&ctx->cache, name, KNOT_RRTYPE_NS, &peek);
@@ -387,6 +394,8 @@ static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut,
 	if (new_ttl < 0) {
 		return kr_error(ESTALE);
 	}
+	*ttl = MIN(*ttl, new_ttl);
+	*complete = true;
 	/* Materialize the rdataset temporarily, for simplicity. */
 	knot_rdataset_t ns_rds = { 0 };
 	ret = kr_cache_materialize(&ns_rds, &peek, cut->pool);
@@ -419,10 +428,12 @@ static int fetch_ns(struct kr_context *ctx, struct kr_zonecut *cut,
 		unsigned reputation = (cached) ? *cached : 0;
 		infos[0] = (reputation & KR_NS_NOIP4) || qry->flags.NO_IPV4
 			? AI_REPUT
-			: fetch_addr(*pack, ns_name, KNOT_RRTYPE_A, cut->pool, qry);
+			: fetch_addr(*pack, ns_name, KNOT_RRTYPE_A, cut->pool, qry, ttl);
 		infos[1] = (reputation & KR_NS_NOIP6) || qry->flags.NO_IPV6
 			? AI_REPUT
-			: fetch_addr(*pack, ns_name, KNOT_RRTYPE_AAAA, cut->pool, qry);
+			: fetch_addr(*pack, ns_name, KNOT_RRTYPE_AAAA, cut->pool, qry, ttl);
+		*complete = *complete && (infos[0] == AI_OK || infos[1] == AI_OK)
+			&& infos[0] >= AI_EMPTY && infos[1] >= AI_EMPTY;
 
 		#if 0 /* rather unlikely to be useful unless changing some zcut code */
 		WITH_VERBOSE(qry) {
@@ -520,6 +531,220 @@ static int fetch_secure_rrset(knot_rrset_t **rr, struct kr_cache *cache,
 	return kr_ok();
 }
 
+/**
+ * Zone cuts found in cache, kept fully materialized for reuse.
+ *
+ * Only cuts where all NSs have their addresses in cache are kept, so that
+ * they don't depend on the query.  An entry is valid until the lowest of its
+ * TTLs runs out, until NS, DS or DNSKEY of its name gets stashed, until
+ * reputation of one of its NSs changes, or until any records get removed
+ * from the cache.  Other processes may change a shared cache without us
+ * noticing, so then entries are kept for CUT_MEMO_TTL_SHARED at most.
+ * The table is two-way set-associative, same as the memo of DNSKEYs in lib/dnssec.c
+ */
+#define CUT_MEMO_TTL_SHARED 5 /**< in seconds */
+
+struct cut_memo_entry {
+	struct kr_zonecut cut; /**< allocated by malloc() */
+	uint32_t hash;
+	uint32_t time;       /**< when the cut was found; its TTLs are relative to it */
+	uint32_t expire;     /**< end of the lowest TTL */
+	uint32_t used;       /**< cut_memo.tick when last used */
+	uint32_t generation; /**< kr_cache::generation */
+	uint8_t rank;        /**< of the NS RRset */
+	bool has_trust;      /**< DS and DNSKEY were looked up */
+};
+
+static struct {
+	struct cut_memo_entry **slots; /**< two per set */
+	uint32_t mask;                 /**< number of sets - 1 */
+	uint32_t tick;
+	struct kr_zonecut_memo_stats stats;
+} cut_memo;
+
+static void cut_memo_free(struct cut_memo_entry *e)
+{
+	if (e) {
+		kr_zonecut_deinit(&e->cut);
+		free(e);
+	}
+}
+
+int kr_zonecut_memo(unsigned size)
+{
+	if (cut_memo.slots) {
+		for (uint32_t i = 0; i < 2 * (cut_memo.mask + 1); ++i) {
+			cut_memo_free(cut_memo.slots[i]);
+		}
+		free(cut_memo.slots);
+		cut_memo.slots = NULL;
+	}
+	memset(&cut_memo.stats, 0, sizeof(cut_memo.stats));
+	if (size == 0) {
+		return kr_ok();
+	}
+	uint32_t sets = 1;
+	while (2 * sets < size) {
+		sets *= 2;
+	}
+	cut_memo.slots = calloc(2 * sets, sizeof(cut_memo.slots[0]));
+	if (!cut_memo.slots) {
+		return kr_error(ENOMEM);
+	}
+	cut_memo.mask = sets - 1;
+	return kr_ok();
+}
+
+struct kr_zonecut_memo_stats kr_zonecut_memo_stats(void)
+{
+	return cut_memo.stats;
+}
+
+/** Return the pair of slots for name; NULL if the memo is disabled. */
+static struct cut_memo_entry **cut_memo_set(const knot_dname_t *name, uint32_t *hash_out)
+{
+	if (!cut_memo.slots) {
+		return NULL;
+	}
+	knot_dname_storage_t lower;
+	const size_t len = knot_dname_to_wire(lower, name, sizeof(lower));
+	knot_dname_to_lower(lower);
+	const uint32_t h = hash((const char *)lower, len);
+	*hash_out = h;
+	return &cut_memo.slots[2 * (h & cut_memo.mask)];
+}
+
+static struct cut_memo_entry **cut_memo_find(struct cut_memo_entry **set, uint32_t h,
+					     const knot_dname_t *name)
+{
+	for (int i = 0; i < 2; ++i) {
+		if (set[i] && set[i]->hash == h && knot_dname_is_case_equal(set[i]->cut.name, name)) {
+			return &set[i];
+		}
+	}
+	return NULL;
+}
+
+void kr_zonecut_memo_drop(const knot_dname_t *name)
+{
+	uint32_t h;
+	struct cut_memo_entry **set = cut_memo_set(name, &h);
+	struct cut_memo_entry **slot = set ? cut_memo_find(set, h, name) : NULL;
+	if (slot) {
+		cut_memo_free(*slot);
+		*slot = NULL;
+	}
+}
+
+void kr_zonecut_memo_drop_ns(const knot_dname_t *ns_name)
+{
+	if (!cut_memo.slots) {
+		return;
+	}
+	const size_t ns_size = knot_dname_size(ns_name);
+	for (uint32_t i = 0; i < 2 * (cut_memo.mask + 1); ++i) {
+		struct cut_memo_entry *e = cut_memo.slots[i];
+		if (e && trie_get_try(e->cut.nsset, (const char *)ns_name, ns_size)) {
+			cut_memo_free(e);
+			cut_memo.slots[i] = NULL;
+		}
+	}
+}
+
+static void rrset_age(knot_rrset_t *rr, uint32_t age)
+{
+	if (rr) {
+		rr->ttl = rr->ttl > age ? rr->ttl - age : 0;
+	}
+}
+
+/** Fill the cut from the memo.
+ * \param secured as in kr_zonecut_find_cached()
+ * \return true on success; the cut may be partly filled otherwise */
+static bool cut_memo_get(struct kr_context *ctx, struct kr_zonecut *cut,
+			 const knot_dname_t *name, const struct kr_query *qry,
+			 bool * restrict secured)
+{
+	uint32_t h;
+	struct cut_memo_entry **set = cut_memo_set(name, &h);
+	if (!set || qry->flags.NO_IPV4 || qry->flags.NO_IPV6) {
+		return false;
+	}
+	struct cut_memo_entry **slot = cut_memo_find(set, h, name);
+	const uint32_t now = qry->timestamp.tv_sec;
+	struct cut_memo_entry *e = slot ? *slot : NULL;
+	if (e && (e->generation != ctx->cache.generation || (int32_t)(e->expire - now) < 0)) {
+		cut_memo_free(e);
+		*slot = e = NULL;
+	}
+	const bool insecure = e && kr_rank_test(e->rank, KR_RANK_INSECURE);
+	const bool want_trust = (*secured && !insecure) || name[0] == '\0';
+	if (!e || (want_trust && !e->has_trust)) {
+		return false;
+	}
+
+	if (kr_zonecut_copy(cut, &e->cut) != 0
+	    || (want_trust && kr_zonecut_copy_trust(cut, &e->cut) != 0)) {
+		trie_clear(cut->nsset);
+		return false;
+	}
+	const uint32_t age = now - e->time;
+	rrset_age(cut->key, age);
+	rrset_age(cut->trust_anchor, age);
+	update_cut_name(cut, e->cut.name);
+	if (insecure) {
+		*secured = false;
+	}
+	e->used = ++cut_memo.tick;
+	++cut_memo.stats.hit;
+	WITH_VERBOSE(qry) {
+		auto_free char *name_str = kr_dname_text(name);
+		VERBOSE_MSG(qry, "found cut: %s (memoized, rank 0%.2o)\n",
+				name_str, e->rank);
+	}
+	return true;
+}
+
+/** Remember the cut just found in cache. */
+static void cut_memo_put(struct kr_context *ctx, const struct kr_zonecut *cut,
+			 const struct kr_query *qry, uint8_t rank, int32_t ttl, bool has_trust)
+{
+	uint32_t h;
+	struct cut_memo_entry **set = cut_memo_set(cut->name, &h);
+	if (!set || qry->flags.NO_IPV4 || qry->flags.NO_IPV6) {
+		return;
+	}
+	if (has_trust) {
+		if (cut->key) ttl = MIN(ttl, (int32_t)cut->key->ttl);
+		if (cut->trust_anchor) ttl = MIN(ttl, (int32_t)cut->trust_anchor->ttl);
+	}
+	if (ctx->cache.api != kr_cdb_memory()) {
+		ttl = MIN(ttl, CUT_MEMO_TTL_SHARED);
+	}
+	struct cut_memo_entry *e = calloc(1, sizeof(*e));
+	if (!e || kr_zonecut_init(&e->cut, cut->name, NULL) != 0
+	    || kr_zonecut_copy(&e->cut, cut) != 0
+	    || (has_trust && kr_zonecut_copy_trust(&e->cut, cut) != 0)) {
+		cut_memo_free(e);
+		return;
+	}
+	e->hash = h;
+	e->time = qry->timestamp.tv_sec;
+	e->expire = e->time + ttl;
+	e->used = ++cut_memo.tick;
+	e->generation = ctx->cache.generation;
+	e->rank = rank;
+	e->has_trust = has_trust;
+
+	struct cut_memo_entry **slot = cut_memo_find(set, h, cut->name);
+	if (!slot) {
+		/* An empty or the less recently used slot. */
+		slot = !set[0] || (set[1] && set[0]->used < set[1]->used) ? &set[0] : &set[1];
+	}
+	cut_memo_free(*slot);
+	*slot = e;
+}
+
 int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut,
 			   const knot_dname_t *name, const struct kr_query *qry,
 			   bool * restrict secured)
@@ -541,10 +766,16 @@ int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut,
 	int ret;
 	const knot_dname_t *label = qname;
 	while (true) {
+		const bool is_root = (label[0] == '\0');
+		if (cut_memo_get(ctx, cut, label, qry, secured)) {
+			ret = kr_ok();
+			break;
+		}
 		/* Fetch NS first and see if it's insecure. */
 		uint8_t rank = 0;
-		const bool is_root = (label[0] == '\0');
-		ret = fetch_ns(ctx, cut, label, qry, &rank);
+		int32_t ttl = INT32_MAX;
+		bool complete = false;
+		ret = fetch_ns(ctx, cut, label, qry, &rank, &ttl, &complete);
 		if (ret == 0) {
 			/* Flag as insecure if cached as this */
 			if (kr_rank_test(rank, KR_RANK_INSECURE)) {
@@ -552,7 +783,8 @@ int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut,
 			}
 			/* Fetch DS and DNSKEY if caller wants secure zone cut */
 			int ret_ds = 1, ret_dnskey = 1;
-			if (*secured || is_root) {
+			const bool has_trust = *secured || is_root;
+			if (has_trust) {
 				ret_ds = fetch_secure_rrset(&cut->trust_anchor, &ctx->cache,
 						label, KNOT_RRTYPE_DS, cut->pool, qry);
 				ret_dnskey = fetch_secure_rrset(&cut->key, &ctx->cache,
@@ -565,6 +797,12 @@ int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut,
 					"found cut: %s (rank 0%.2o return codes: DS %d, DNSKEY %d)\n",
 					label_str, rank, ret_ds, ret_dnskey);
 			}
+			if (cut_memo.slots) {
+				++cut_memo.stats.miss;
+			}
+			if (complete) {
+				cut_memo_put(ctx, cut, qry, rank, ttl, has_trust);
+			}
 			ret = kr_ok();
 			break;
 		} /* else */
@@ -154,11 +154,42 @@ int kr_zonecut_set_sbelt(struct kr_context *ctx, struct kr_zonecut *cut);
  * @param qry       query for timestamp and stale-serving decisions
  * @param secured   set to true if want secured zone cut, will return false if it is provably insecure
  * @return 0 or error code (ENOENT if it doesn't find anything)
+ * @note Cuts found are remembered for reuse; see kr_zonecut_memo().
  */
 KR_EXPORT
 int kr_zonecut_find_cached(struct kr_context *ctx, struct kr_zonecut *cut,
 			   const knot_dname_t *name, const struct kr_query *qry,
 			   bool * restrict secured);
+
+/** Hit and miss counters of the memo of zone cuts. */
+struct kr_zonecut_memo_stats {
+	uint64_t hit;
+	uint64_t miss;
+};
+
+/**
+ * Set the number of zone cuts remembered by kr_zonecut_find_cached(); 0 disables it.
+ * The memo is per process and it's also reset by this call.
+ * @return 0 or error code
+ */
+KR_EXPORT
+int kr_zonecut_memo(unsigned size);
+
+/** Return the counters of the memo of zone cuts. */
+KR_EXPORT KR_PURE
+struct kr_zonecut_memo_stats kr_zonecut_memo_stats(void);
+
+/**
+ * Forget the remembered zone cut at name, as its NS, DS or DNSKEY changed in cache.
+ * @param name zone cut name
+ */
+void kr_zonecut_memo_drop(const knot_dname_t *name);
+
+/**
+ * Forget the remembered zone cuts that contain the NS name, as its reputation changed.
+ * @param ns_name name of the nameserver
+ */
+void kr_zonecut_memo_drop_ns(const knot_dname_t *ns_name);
 /**
  * Check if any address is present in the zone cut.
  *
@@ -10,3 +10,6 @@ echo "Test LRU with increasing overfill, misses should increase ~ linearly"
 for num in 65536 32768 16384 8192 4096; do
     "${MESON_BUILD_ROOT}/${MESON_SUBDIR}/bench_lru" 23 "${MESON_SOURCE_ROOT}/${MESON_SUBDIR}/bench_lru_set1.tsv" - "${num}"
 done
+
+echo "Replay RTTs of a lossy upstream, compare retransmit timeouts"
+"${MESON_BUILD_ROOT}/${MESON_SUBDIR}/bench_nsrep" "${MESON_SOURCE_ROOT}/${MESON_SUBDIR}/bench_nsrep_set1.tsv"
@@ -1,12 +1,30 @@
 -- SPDX-License-Identifier: GPL-3.0-or-later
+-- the tests run against the default backend, or the one passed when loading this file
+local storage = ... or 'lmdb://'
+local ffi = require('ffi')
+
+local function closest_apex(name)
+	local apex_array = ffi.new('knot_dname_t *[1]')
+	local ret = ffi.C.kr_cache_closest_apex(kres.context().cache, name, false, apex_array)
+	if ret < 0 then return nil end
+	local apex = kres.dname2str(apex_array[0])
+	ffi.C.free(apex_array[0])
+	return apex
+end
+
 -- test if cache module properties work
 local function test_properties()
 	is(type(cache), 'table', 'cache module is loaded')
+	if storage ~= 'lmdb://' then
+		ok(cache.open(100 * MB, storage), 'cache can be opened with ' .. storage)
+	end
 	is(cache.count(), 0, 'cache is empty on startup')
 	local backends = cache.backends()
 	is(type(backends), 'table', 'cache provides a list of backends')
-	ok(backends['lmdb'], 'cache provides built-in lmdb backend')
-	is(cache.current_storage, 'lmdb://', 'cache starts with lmdb backend')
+	isnt(backends['lmdb'], nil, 'cache provides built-in lmdb backend')
+	isnt(backends['memory'], nil, 'cache provides built-in memory backend')
+	ok(backends[storage:match('^(%w+)://')], 'cache marks the backend in use')
+	is(cache.current_storage, storage, 'cache starts with ' .. storage .. ' backend')
 	is(cache.current_size, 100 * MB, 'cache starts with default size limit')
 	is(cache.max_ttl(10), 10, 'allows setting maximum TTL')
 	is(cache.max_ttl(), 10, 'stored maximum TTL')
@@ -23,7 +41,7 @@ local function test_stats()
 	boom(cache.count, {}, '.count() does not work on closed cache')
 	boom(cache.get, { 'key' }, '.get(...) does not work on closed cache')
 
-	ok(cache.open(100 * MB), 'cache can be reopened')
+	ok(cache.open(100 * MB, storage), 'cache can be reopened')
 	local s = cache.stats()
 	is(type(s), 'table', 'stats returns a table')
 	-- Just checking the most useful fields
@@ -32,9 +50,9 @@ end
 
 -- test if cache can be resized or shrunk
 local function test_resize()
-	ok(cache.open(200 * MB, 'lmdb://'), 'cache can be resized')
+	ok(cache.open(200 * MB, storage), 'cache can be resized')
 	is(cache.current_size, 200 * MB, 'cache was resized')
-	ok(cache.open(50 * MB), 'cache can be shrunk')
+	ok(cache.open(50 * MB, storage), 'cache can be shrunk')
 	is(cache.current_size, 50 * MB, 'cache was shrunk')
 end
 
@@ -59,9 +77,27 @@ local function test_context_cache()
 	ok(c:insert(rr_ns, nil, 0), 'cache insertion works (NS)')
 end
 
+-- test that the closest zone cut is found for names missing in cache
+local function test_closest_apex()
+	local c = kres.context().cache
+	ok(cache.clear(), 'cache can be cleared')
+	local rr = kres.rrset(todname('example.com'), kres.type.NS, kres.class.IN, 3600)
+	local rdata = todname('ns.example.com')
+	ok(rr:add_rdata(rdata, #rdata), 'adding rdata works')
+	ok(c:insert(rr, nil, 0), 'cache insertion works (NS)')
+	ok(c:commit(), 'cache commit works')
+	is(closest_apex(todname('example.com')), 'example.com.', 'NS is found for its owner')
+	is(closest_apex(todname('www.example.com')), 'example.com.',
+		'NS of the parent is found for a name missing in cache')
+	is(closest_apex(todname('a.b.www.example.com')), 'example.com.',
+		'NS of an ancestor is found for a deeper name')
+	is(closest_apex(todname('www.example.net')), '.', 'root is found for another TLD')
+end
+
 return {
 	test_properties,
 	test_stats,
 	test_resize,
 	test_context_cache,
+	test_closest_apex,
 }
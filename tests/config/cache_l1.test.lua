@@ -0,0 +1,55 @@
+-- SPDX-License-Identifier: GPL-3.0-or-later
+-- test the in-memory L1 cache in front of the cache backend
+local ffi = require('ffi')
+
+local function closest_apex(name)
+	local apex_array = ffi.new('knot_dname_t *[1]')
+	local ret = ffi.C.kr_cache_closest_apex(kres.context().cache, name, false, apex_array)
+	if ret < 0 then return nil end
+	local apex = kres.dname2str(apex_array[0])
+	ffi.C.free(apex_array[0])
+	return apex
+end
+
+-- test that L1 answers repeated reads and forgets cleared records
+local function check_l1(backend)
+	ok(cache.open(10 * MB, backend), 'cache can be opened with ' .. backend)
+	is(cache.l1(1000), 1024, 'L1 slots are rounded up to a power of two')
+	is(cache.l1(), 1024, 'L1 slots are stored')
+
+	local c = kres.context().cache
+	local rr = kres.rrset('\3com\0', kres.type.NS, kres.class.IN, 3600)
+	local rdata = todname('a.gtld-servers.net')
+	ok(rr:add_rdata(rdata, #rdata), 'adding rdata works')
+	ok(c:insert(rr, nil, 0), 'cache insertion works (NS)')
+	ok(c:commit(), 'cache commit works')
+
+	local s = cache.stats()
+	is(closest_apex(todname('www.com')), 'com.', 'NS is found in cache')
+	ok(cache.stats().l1_miss > s.l1_miss, 'first read misses L1')
+	s = cache.stats()
+	is(closest_apex(todname('www.com')), 'com.', 'NS is found in cache again')
+	ok(cache.stats().l1_hit > s.l1_hit, 'second read hits L1')
+
+	ok(cache.clear(), 'cache can be cleared')
+	is(closest_apex(todname('www.com')), '.', 'cleared NS is not served from L1')
+end
+
+local function test_l1_lmdb()
+	is(cache.l1(), 0, 'L1 is disabled by default')
+	check_l1('lmdb://')
+	is(cache.l1(0), 0, 'L1 can be disabled')
+	boom(cache.l1, {-1}, 'negative number of slots is refused')
+	boom(cache.l1, {'x'}, 'non-numeric number of slots is refused')
+end
+
+local function test_l1_memory()
+	check_l1('memory://')
+	ok(cache.open(10 * MB, 'lmdb://'), 'cache can be reopened with lmdb backend')
+	is(cache.l1(), 1024, 'L1 is kept when switching the backend')
+end
+
+return {
+	test_l1_lmdb,
+	test_l1_memory,
+}
@@ -0,0 +1,3 @@
+-- SPDX-License-Identifier: GPL-3.0-or-later
+-- run the cache tests against the memory:// backend
+return assert(loadfile(env.SOURCE_PATH .. '/cache.test.lua'))('memory://')
@@ -0,0 +1,112 @@
+-- SPDX-License-Identifier: GPL-3.0-or-later
+-- test LMDB cache split into several shards
+local ffi = require('ffi')
+
+-- read_leq() of the backend, reached through a copy of the kr_cdb_api layout
+ffi.cdef([[
+struct test_cdb_val { void *data; size_t len; };
+struct test_cdb_api {
+	const char *name;
+	void *open, *close, *count, *clear, *commit, *read, *write, *remove, *match;
+	int (*read_leq)(void *db, void *stats,
+			struct test_cdb_val *key, struct test_cdb_val *val);
+};
+]])
+
+local function read_leq(key)
+	local c = kres.context().cache
+	local api = ffi.cast('const struct test_cdb_api *', c.api)
+	local k = ffi.new('struct test_cdb_val', { ffi.cast('void *', key), #key })
+	local v = ffi.new('struct test_cdb_val')
+	local ret = api.read_leq(c.db, c.stats, k, v)
+	if ret < 0 then return nil end
+	return ffi.string(k.data, k.len), ret
+end
+
+local function closest_apex(name)
+	local apex_array = ffi.new('knot_dname_t *[1]')
+	local ret = ffi.C.kr_cache_closest_apex(kres.context().cache, name, false, apex_array)
+	if ret < 0 then return nil end
+	local apex = kres.dname2str(apex_array[0])
+	ffi.C.free(apex_array[0])
+	return apex
+end
+
+local names = {}
+for i = 1, 20 do
+	table.insert(names, 'zone' .. i .. '.test')
+end
+
+-- test that sharded cache is opened and each shard starts with the version key
+local function test_open()
+	ok(cache.open(10 * MB, 'lmdb://shards', 2), 'cache can be opened with 2 shards')
+	is(cache.current_shards, 2, 'number of shards is stored')
+	ok(cache.clear(), 'cache can be cleared')
+	is(cache.count(), 0, 'cache is empty after clear')
+	local shards = cache.stats().shards
+	is(#shards, 2, 'stats list both shards')
+	is(shards[1].entries, 1, 'the first shard holds just the version key')
+	is(shards[2].entries, 1, 'the second shard holds just the version key')
+end
+
+-- test that records of different names are spread and found again
+local function test_records()
+	local c = kres.context().cache
+	for _, owner in ipairs(names) do
+		local rr = kres.rrset(todname(owner), kres.type.NS, kres.class.IN, 3600)
+		local rdata = todname('ns.' .. owner)
+		rr:add_rdata(rdata, #rdata)
+		ok(c:insert(rr, nil, 0), 'cache insertion works (NS ' .. owner .. ')')
+	end
+	ok(c:commit(), 'cache commit works')
+	is(cache.count(), #names, 'all records are counted once')
+	local shards = cache.stats().shards
+	ok(shards[1].entries > 1 and shards[2].entries > 1, 'records are spread to both shards')
+	for _, owner in ipairs(names) do
+		is(closest_apex(todname('www.' .. owner)), owner .. '.', 'NS is found for ' .. owner)
+	end
+end
+
+-- test that a range of NSEC keys is searched in the shard of its zone
+local function test_nsec_range()
+	local c = kres.context().cache
+	local zone = todname('shard.test')
+	local rr = kres.rrset(todname('a.shard.test'), kres.type.NSEC, kres.class.IN, 3600)
+	-- next name m.shard.test, type bitmap with A
+	local rdata = todname('m.shard.test') .. '\0\1\64'
+	ok(rr:add_rdata(rdata, #rdata), 'adding NSEC rdata works')
+	local rrsig = kres.rrset(todname('a.shard.test'), kres.type.RRSIG, kres.class.IN, 3600)
+	-- type covered, algorithm, labels, original TTL, expiration, inception, key tag
+	local sig = '\0\47' .. '\13' .. '\3' .. '\0\0\14\16'
+		.. '\255\255\255\255' .. '\0\0\0\0' .. '\0\1'
+		.. zone .. string.rep('\0', 64)
+	ok(rrsig:add_rdata(sig, #sig), 'adding RRSIG rdata works')
+	ok(c:insert(rr, rrsig, kres.rank.SECURE), 'cache insertion works (NSEC)')
+	ok(c:commit(), 'cache commit works')
+
+	-- CACHE_KEY_DEF: zone's lf + '\0' + '1' + lf of the name within zone
+	local key_a = 'test\0shard\0' .. '\0' .. '1' .. 'a'
+	local key, ret = read_leq('test\0shard\0' .. '\0' .. '1' .. 'c')
+	is(key, key_a, 'NSEC covering a name is found')
+	ok(ret > 0, 'NSEC is found as a lesser key')
+	key, ret = read_leq(key_a)
+	is(key, key_a, 'NSEC is found by its exact key')
+	is(ret, 0, 'NSEC is found as equal key')
+end
+
+-- test that the number of shards can't change without removing the cache
+local function test_reopen()
+	boom(cache.open, {10 * MB, 'lmdb://shards', 3}, 'cache with 2 shards can\'t be opened with 3')
+	boom(cache.open, {10 * MB, 'lmdb://shards'}, 'cache with 2 shards can\'t be opened unsharded')
+	ok(cache.open(10 * MB, 'lmdb://shards', 2), 'cache can be reopened with 2 shards')
+	is(cache.count(), #names + 1, 'records survive reopening')
+	is(closest_apex(todname('www.' .. names[1])), names[1] .. '.', 'NS is found after reopening')
+	ok(cache.open(10 * MB, 'lmdb://'), 'unsharded cache can be opened elsewhere')
+end
+
+return {
+	test_open,
+	test_records,
+	test_nsec_range,
+	test_reopen,
+}
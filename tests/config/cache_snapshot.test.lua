@@ -0,0 +1,86 @@
+-- SPDX-License-Identifier: GPL-3.0-or-later
+-- test saving the cache into a file and loading it back
+local ffi = require('ffi')
+
+local function closest_apex(name)
+	local apex_array = ffi.new('knot_dname_t *[1]')
+	local ret = ffi.C.kr_cache_closest_apex(kres.context().cache, name, false, apex_array)
+	if ret < 0 then return nil end
+	local apex = kres.dname2str(apex_array[0])
+	ffi.C.free(apex_array[0])
+	return apex
+end
+
+local function read_file(path)
+	local f = assert(io.open(path, 'rb'))
+	local data = f:read('*a')
+	f:close()
+	return data
+end
+
+local function write_file(path, data)
+	local f = assert(io.open(path, 'wb'))
+	f:write(data)
+	f:close()
+end
+
+-- test that a record survives snapshot, clear and restore
+local function test_roundtrip()
+	ok(cache.open(10 * MB, 'lmdb://'), 'cache can be opened')
+	ok(cache.clear(), 'cache can be cleared')
+	local c = kres.context().cache
+	local rr = kres.rrset(todname('snapshot.test'), kres.type.NS, kres.class.IN, 3600)
+	local rdata = todname('ns.snapshot.test')
+	ok(rr:add_rdata(rdata, #rdata), 'adding rdata works')
+	ok(c:insert(rr, nil, 0), 'cache insertion works (NS)')
+	ok(c:commit(), 'cache commit works')
+	is(closest_apex(todname('www.snapshot.test')), 'snapshot.test.', 'NS is in cache')
+
+	local written = cache.snapshot('cache.snapshot')
+	ok(written >= 1, 'snapshot writes records')
+	ok(cache.clear(), 'cache can be cleared')
+	is(closest_apex(todname('www.snapshot.test')), '.', 'NS is gone after clear')
+	is(cache.restore('cache.snapshot'), written, 'restore loads all records')
+	is(closest_apex(todname('www.snapshot.test')), 'snapshot.test.', 'NS is back after restore')
+	is(cache.restore('cache.snapshot'), 0, 'records present in cache are skipped')
+end
+
+-- test that damaged snapshots are rejected
+local function test_damaged()
+	local data = read_file('cache.snapshot')
+	ok(#data > 64, 'snapshot file is not empty')
+	boom(cache.restore, {'nonexistent.snapshot'}, 'missing file is rejected')
+
+	write_file('truncated.snapshot', data:sub(1, #data - 4))
+	ok(cache.clear(), 'cache can be cleared')
+	boom(cache.restore, {'truncated.snapshot'}, 'truncated file is rejected')
+
+	-- flip a byte inside the records, before the terminating block
+	local pos = #data - 20
+	local flipped = string.char(255 - data:byte(pos))
+	write_file('corrupted.snapshot', data:sub(1, pos - 1) .. flipped .. data:sub(pos + 1))
+	ok(cache.clear(), 'cache can be cleared')
+	boom(cache.restore, {'corrupted.snapshot'}, 'corrupted file is rejected')
+	is(closest_apex(todname('www.snapshot.test')), '.', 'nothing is loaded from the damaged block')
+
+	-- block lengths beyond the end of the file; the header is 40 bytes
+	local function u32(n)
+		return string.char(n % 256, math.floor(n / 2^8) % 256,
+			math.floor(n / 2^16) % 256, math.floor(n / 2^24) % 256)
+	end
+	for _, len in ipairs({ 0xfffffff0, #data }) do
+		write_file('overlong.snapshot', data:sub(1, 40) .. u32(len) .. u32(0) .. data:sub(49))
+		ok(cache.clear(), 'cache can be cleared')
+		boom(cache.restore, {'overlong.snapshot'},
+			string.format('block of length %d is rejected', len))
+		is(closest_apex(todname('www.snapshot.test')), '.', 'nothing is loaded from the overlong block')
+	end
+
+	write_file('garbage.snapshot', string.rep('x', 100))
+	boom(cache.restore, {'garbage.snapshot'}, 'file without the header is rejected')
+end
+
+return {
+	test_roundtrip,
+	test_damaged,
+}
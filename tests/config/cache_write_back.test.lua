@@ -0,0 +1,75 @@
+-- SPDX-License-Identifier: GPL-3.0-or-later
+-- test buffering of cache writes
+local ffi = require('ffi')
+
+local function closest_apex(name)
+	local apex_array = ffi.new('knot_dname_t *[1]')
+	local ret = ffi.C.kr_cache_closest_apex(kres.context().cache, name, false, apex_array)
+	if ret < 0 then return nil end
+	local apex = kres.dname2str(apex_array[0])
+	ffi.C.free(apex_array[0])
+	return apex
+end
+
+local function insert_ns(owner)
+	local c = kres.context().cache
+	local rr = kres.rrset(todname(owner), kres.type.NS, kres.class.IN, 3600)
+	local rdata = todname('ns.' .. owner)
+	ok(rr:add_rdata(rdata, #rdata), 'adding rdata works')
+	ok(c:insert(rr, nil, 0), 'cache insertion works (NS)')
+	ok(c:commit(), 'cache commit works')
+end
+
+-- test parameter checks
+local function test_params()
+	ok(cache.open(10 * MB, 'lmdb://'), 'cache can be opened')
+	ok(cache.clear(), 'cache can be cleared')
+	local max, interval = cache.write_back()
+	is(max, 0, 'write-back is disabled by default')
+	is(interval, 50, 'default interval is 50 ms')
+	boom(cache.write_back, {-1}, 'negative max_records is rejected')
+	boom(cache.write_back, {100000}, 'too large max_records is rejected')
+	boom(cache.write_back, {16, 0}, 'zero interval is rejected')
+	boom(cache.write_back, {16, 10001}, 'too long interval is rejected')
+	boom(cache.write_back, {'x'}, 'non-number max_records is rejected')
+end
+
+-- test that buffered records are visible before and written after the flush
+local function test_flush_interval()
+	local max, interval = cache.write_back(100, 200)
+	same({max, interval}, {100, 200}, 'write-back can be enabled')
+	local count = cache.count()
+	insert_ns('wb1.test')
+	is(closest_apex(todname('www.wb1.test')), 'wb1.test.', 'buffered NS is found before the flush')
+	is(cache.count(), count, 'buffered NS is not written yet')
+	worker.sleep(0.5)
+	ok(cache.count() > count, 'NS is written after the interval')
+	is(closest_apex(todname('www.wb1.test')), 'wb1.test.', 'written NS is found')
+end
+
+-- test that buffered records are written once max_records accumulate
+local function test_flush_max()
+	cache.write_back(1, 10000)
+	local count = cache.count()
+	insert_ns('wb2.test')
+	ok(cache.count() > count, 'NS is written on commit with max_records reached')
+	is(closest_apex(todname('www.wb2.test')), 'wb2.test.', 'written NS is found')
+end
+
+-- test that disabling write-back writes buffered records
+local function test_disable()
+	cache.write_back(100, 10000)
+	local count = cache.count()
+	insert_ns('wb3.test')
+	is(cache.count(), count, 'buffered NS is not written yet')
+	is(cache.write_back(0), 0, 'write-back can be disabled')
+	ok(cache.count() > count, 'NS is written when disabling write-back')
+	is(closest_apex(todname('www.wb3.test')), 'wb3.test.', 'written NS is found')
+end
+
+return {
+	test_params,
+	test_flush_interval,
+	test_flush_max,
+	test_disable,
+}
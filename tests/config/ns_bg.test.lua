@@ -0,0 +1,86 @@
+-- SPDX-License-Identifier: GPL-3.0-or-later
+-- test lookups of NS addresses started in background (worker.ns_bg)
+local ffi = require('ffi')
+
+local PORT = 36653
+
+-- upstream which never answers, so that the background lookups stay in flight
+modules.load('hints > iterate')
+hints.root({['k.root-servers.net.'] = '192.0.2.1'})
+trust_anchors.remove('.')
+
+-- fail client requests as soon as they have queued some background lookups
+package.loaded['kres_modules.ns_bg_fail'] = {
+	layer = {
+		produce = function (state, req)
+			if req.count_ns_bg > 0 then
+				return kres.FAIL
+			end
+			return state
+		end
+	}
+}
+modules.load('ns_bg_fail')
+
+-- glueless delegation; both NS names are outside of the delegated zone
+local function insert_delegation()
+	local c = kres.context().cache
+	local rr = kres.rrset(todname('example.test.'), kres.type.NS, kres.class.IN, 3600)
+	for _, ns in ipairs({'ns1.a-other.test.', 'ns2.b-other.test.'}) do
+		local rdata = todname(ns)
+		ok(rr:add_rdata(rdata, #rdata), 'adding NS rdata works')
+	end
+	ok(c:insert(rr, nil, ffi.C.KR_RANK_INSECURE + ffi.C.KR_RANK_AUTH),
+		'cache insertion works (NS)')
+	ok(c:commit(), 'cache commit works')
+end
+
+local function query_udp(qname, qtype)
+	local socket = require('cqueues.socket')
+	local pkt = kres.packet(512)
+	pkt:question(todname(qname), kres.class.IN, qtype)
+	pkt:rd(true)
+	local s = socket.connect({ host = '127.0.0.1', port = PORT, type = socket.SOCK_DGRAM })
+	s:setmode('bn', 'bn')
+	s:write(pkt:towire())
+	local answer = s:xread('*a', 'bn', 5)
+	s:close()
+	return answer
+end
+
+-- the client request finishes while its background lookups are still running
+local function test_finish_while_in_flight()
+	is(worker.ns_bg(true), true, 'background lookups can be enabled')
+	ok(cache.open(10 * MB, 'lmdb://'), 'cache can be opened')
+	insert_delegation()
+	ok(net.listen('127.0.0.1', PORT), 'listening on UDP')
+
+	local started = worker.stats().ns_bg
+	local answer = query_udp('www.example.test.', kres.type.A)
+	ok(answer, 'client request is answered')
+	if answer then
+		local pkt = kres.packet(#answer, answer)
+		ok(pkt:parse(), 'answer can be parsed')
+		is(pkt:rcode(), kres.rcode.SERVFAIL, 'client request failed')
+	end
+	worker.sleep(0.1) -- lookups are started from the event loop
+	ok(worker.stats().ns_bg > started, 'background lookups were started')
+
+	-- the lookups end with the finished client request still registered as their waiter
+	local deadline = 30
+	while worker.stats().concurrent > 0 and deadline > 0 do
+		worker.sleep(0.1)
+		deadline = deadline - 0.1
+	end
+	is(worker.stats().concurrent, 0, 'background lookups finish after the client request')
+	ok(net.close('127.0.0.1', PORT), 'listener can be closed')
+end
+
+if not worker.bg_worker then
+	pass('skipping ns_bg test because it doesnt support background worker')
+	done()
+else
+	return {
+		test_finish_while_in_flight,
+	}
+end
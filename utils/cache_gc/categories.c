@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include "categories.h"
 
+#include <time.h>
+
 #include <libknot/libknot.h>
 #include "lib/utils.h"
 
@@ -18,11 +20,32 @@ static bool rrtype_is_infrastructure(uint16_t r)
 	}
 }
 
+/** Whether kresd counts reads of such records, see entry_h_hit() */
+static bool rrtype_has_hits(uint16_t r)
+{
+	switch (r) {
+	case KNOT_RRTYPE_NS:
+	case KNOT_RRTYPE_NSEC:
+	case KNOT_RRTYPE_NSEC3:
+		return false;
+	default:
+		return true;
+	}
+}
+
 static int get_random(int to)
 {
 	// We don't need these to be really unpredictable,
 	// but this should be cheap enough not to be noticeable.
-	return kr_rand_bytes(1) % to;
+	// kr_rand_bytes() isn't thread-safe, so each thread has its own xorshift.
+	static __thread uint32_t state = 0;
+	if (state == 0) {
+		state = ((uintptr_t)&state ^ time(NULL)) | 1;
+	}
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state % to;
 }
 
 // TODO this is just an example, make this more clever
@@ -33,6 +56,10 @@ category_t kr_gc_categorize(gc_record_info_t * info)
 	if (!info->valid)
 		return CATEGORIES - 1;
 
+	/* State of upstream servers is small and cheap to keep until it expires. */
+	if (info->infra)
+		return (info->expires_in <= 0 ? 60 : 20) + get_random(5);
+
 	switch (info->no_labels) {
 	case 0:		/* root zone */
 		res = 5;
@@ -48,6 +75,17 @@ category_t kr_gc_categorize(gc_record_info_t * info)
 		break;
 	}
 
+	/* Records rarely read since stored (e.g. random subdomains) go first,
+	 * frequently read ones last.  Reads of NS entries (shared with xNAME)
+	 * and NSEC* ones aren't counted, so these are left alone. */
+	if (rrtype_has_hits(info->rrtype)) {
+		if (info->hits == 0) {
+			res += 5;
+		} else {
+			res -= info->hits < 5 ? info->hits : 5;
+		}
+	}
+
 	if (info->expires_in <= 0) {
 		res += 40;
 	}
@@ -8,9 +8,21 @@
 //#include <lib/defines.h>
 
 #include <ctype.h>		//DEBUG
+#include <pthread.h>
 #include <time.h>
 #include <sys/stat.h>
 
+knot_db_val_t *dbval_copy(const knot_db_val_t * from)
+{
+	knot_db_val_t *to = malloc(sizeof(knot_db_val_t) + from->len);
+	if (to != NULL) {
+		memcpy(to, from, sizeof(knot_db_val_t));
+		to->data = to + 1;	// == ((uit8_t *)to) + sizeof(knot_db_val_t)
+		memcpy(to->data, from->data, from->len);
+	}
+	return to;
+}
+
 int kr_gc_cache_open(const char *cache_path, struct kr_cache *kres_db,
 		     knot_db_t ** libknot_db)
 {
@@ -139,7 +151,20 @@ static const struct entry_h *val2entry(const knot_db_val_t val, uint16_t ktype)
 	return NULL;
 }
 
-int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ctx)
+/** Read the header of an infrastructure record.  false if it isn't one.  CACHE_KEY_DEF */
+static bool val2infra(const knot_db_val_t key, const knot_db_val_t val, struct infra_h *ih)
+{
+	const uint8_t *kd = key.data;
+	if (key.len < 2 || kd[0] != '\0'
+	    || (kd[1] != KR_CACHE_INFRA_RTT && kd[1] != KR_CACHE_INFRA_REP)
+	    || val.len < sizeof(*ih))
+		return false;
+	memcpy(ih, val.data, sizeof(*ih));
+	return true;
+}
+
+/** Call back for each record from it on; KNOT_ELIMIT from callback stops quietly. */
+static int iter_records(knot_db_iter_t *it, kr_gc_iter_callback callback, void *ctx)
 {
 #ifdef DEBUG
 	unsigned int counter_iter = 0;
@@ -147,24 +172,10 @@ int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ct
 	unsigned int counter_kr_consistent = 0;
 #endif
 
-	knot_db_txn_t txn = { 0 };
-	knot_db_iter_t *it = NULL;
 	const knot_db_api_t *api = knot_db_lmdb_api();
 	gc_record_info_t info = { 0 };
 	int64_t now = time(NULL);
-
-	int ret = api->txn_begin(knot_db, &txn, KNOT_DB_RDONLY);
-	if (ret != KNOT_EOK) {
-		printf("Error starting DB transaction (%s).\n", knot_strerror(ret));
-		return ret;
-	}
-
-	it = api->iter_begin(&txn, KNOT_DB_FIRST);
-	if (it == NULL) {
-		printf("Error iterationg database.\n");
-		api->txn_abort(&txn);
-		return KNOT_ERROR;
-	}
+	int ret;
 
 	while (it != NULL) {
 		knot_db_val_t key = { 0 }, val = { 0 };
@@ -182,6 +193,7 @@ int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ct
 
 		info.entry_size = key.len + val.len;
 		info.valid = false;
+		info.infra = false;
 		const uint16_t *entry_type =
 		    ret == KNOT_EOK ? kr_gc_key_consistent(key) : NULL;
 		const struct entry_h *entry = NULL;
@@ -201,6 +213,14 @@ int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ct
 			info.rrtype = *entry_type;
 			info.expires_in = entry->time + entry->ttl - now;
 			info.no_labels = entry_labels(&key, *entry_type);
+			info.hits = entry->hits;
+		} else if (ret == KNOT_EOK && entry_type == NULL) {
+			struct infra_h ih;
+			if (val2infra(key, val, &ih)) {
+				info.valid = true;
+				info.infra = true;
+				info.expires_in = (int64_t)ih.time + ih.ttl - now;
+			}
 		}
 #ifdef DEBUG
 		counter_kr_consistent += info.valid;
@@ -216,10 +236,11 @@ int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ct
 		ret = callback(&key, &info, ctx);
 
 		if (ret != KNOT_EOK) {
-			printf("Error iterating database (%s).\n",
-			       knot_strerror(ret));
+			if (ret != KNOT_ELIMIT) {
+				printf("Error iterating database (%s).\n",
+				       knot_strerror(ret));
+			}
 			api->iter_finish(it);
-			api->txn_abort(&txn);
 			return ret;
 		}
 
@@ -227,10 +248,237 @@ int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ct
 		it = api->iter_next(it);
 	}
 
-	api->txn_abort(&txn);
 #ifdef DEBUG
 	printf("DEBUG: iterated %u items, gc consistent %u, kr consistent %u\n",
 	       counter_iter, counter_gc_consistent, counter_kr_consistent);
 #endif
 	return KNOT_EOK;
 }
+
+int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ctx)
+{
+	knot_db_txn_t txn = { 0 };
+	const knot_db_api_t *api = knot_db_lmdb_api();
+
+	int ret = api->txn_begin(knot_db, &txn, KNOT_DB_RDONLY);
+	if (ret != KNOT_EOK) {
+		printf("Error starting DB transaction (%s).\n", knot_strerror(ret));
+		return ret;
+	}
+
+	knot_db_iter_t *it = api->iter_begin(&txn, KNOT_DB_FIRST);
+	if (it == NULL) {
+		printf("Error iterationg database.\n");
+		api->txn_abort(&txn);
+		return KNOT_ERROR;
+	}
+
+	ret = iter_records(it, callback, ctx);
+	api->txn_abort(&txn);
+	return ret;
+}
+
+int kr_gc_cache_iter_from(knot_db_txn_t * txn, knot_db_val_t * from,
+			  kr_gc_iter_callback callback, void *ctx)
+{
+	const knot_db_api_t *api = knot_db_lmdb_api();
+	knot_db_iter_t *it = api->iter_begin(txn, from ? KNOT_DB_NOOP : KNOT_DB_FIRST);
+	if (it != NULL && from != NULL) {
+		it = api->iter_seek(it, from, KNOT_DB_GEQ);
+	}
+	// NULL iterator: no records from there on
+	return iter_records(it, callback, ctx);
+}
+
+// section: parallel iteration
+
+/** Every n-th key is remembered to split the keys for the next iteration. */
+#define GC_SAMPLE_EVERY 1024
+/** Chunks per thread; threads take the next chunk when done, which evens out the load. */
+#define GC_CHUNKS_PER_THREAD 4
+
+typedef struct {
+	knot_db_val_t *from;	// first key, NULL = from the start
+	knot_db_val_t *to;	// key after the last one, NULL = until the end
+	array_t(knot_db_val_t *) samples;
+} gc_chunk_t;
+
+typedef struct {
+	knot_db_t *knot_db;
+	kr_gc_iter_callback callback;
+	gc_chunk_t *chunks;
+	size_t chunk_count;
+	size_t next_chunk;
+	int ret;		// the first error
+	pthread_mutex_t lock;
+} gc_iter_parallel_t;
+
+typedef struct {
+	gc_iter_parallel_t *par;
+	gc_chunk_t *chunk;
+	void *ctx;
+	size_t seen;
+	pthread_t thread;
+} gc_iter_thread_t;
+
+/** Compare keys in the order of LMDB. */
+static int key_cmp(const knot_db_val_t *a, const knot_db_val_t *b)
+{
+	int cmp = memcmp(a->data, b->data, a->len < b->len ? a->len : b->len);
+	if (cmp == 0) {
+		cmp = a->len < b->len ? -1 : (a->len > b->len ? 1 : 0);
+	}
+	return cmp;
+}
+
+static int cb_chunk(const knot_db_val_t * key, gc_record_info_t * info, void *vctx)
+{
+	gc_iter_thread_t *t = vctx;
+	gc_chunk_t *chunk = t->chunk;
+	if (chunk->to != NULL && key_cmp(key, chunk->to) >= 0) {
+		return KNOT_ELIMIT;
+	}
+	if (++t->seen % GC_SAMPLE_EVERY == 0) {
+		knot_db_val_t *sample = dbval_copy(key);
+		if (sample == NULL || array_push(chunk->samples, sample) < 0) {
+			free(sample);
+			return KNOT_ENOMEM;
+		}
+	}
+	return t->par->callback(key, info, t->ctx);
+}
+
+static void *iter_thread(void *arg)
+{
+	gc_iter_thread_t *t = arg;
+	gc_iter_parallel_t *par = t->par;
+	const knot_db_api_t *api = knot_db_lmdb_api();
+	for (;;) {
+		pthread_mutex_lock(&par->lock);
+		const bool done = par->ret != KNOT_EOK || par->next_chunk >= par->chunk_count;
+		t->chunk = done ? NULL : &par->chunks[par->next_chunk++];
+		pthread_mutex_unlock(&par->lock);
+		if (t->chunk == NULL) {
+			return NULL;
+		}
+
+		knot_db_txn_t txn = { 0 };
+		int ret = api->txn_begin(par->knot_db, &txn, KNOT_DB_RDONLY);
+		if (ret == KNOT_EOK) {
+			ret = kr_gc_cache_iter_from(&txn, t->chunk->from, cb_chunk, t);
+			api->txn_abort(&txn);
+		} else {
+			printf("Error starting DB transaction (%s).\n", knot_strerror(ret));
+		}
+		if (ret != KNOT_EOK && ret != KNOT_ELIMIT) {
+			pthread_mutex_lock(&par->lock);
+			if (par->ret == KNOT_EOK) {
+				par->ret = ret;
+			}
+			pthread_mutex_unlock(&par->lock);
+		}
+	}
+}
+
+/** Split by the first byte of keys, in absence of anything better. */
+static int ranges_init(kr_gc_ranges_t *ranges)
+{
+	for (int byte = 1; byte <= UINT8_MAX; ++byte) {
+		const uint8_t data = byte;
+		const knot_db_val_t key = { .data = (void *)&data, .len = 1 };
+		knot_db_val_t *bound = dbval_copy(&key);
+		if (bound == NULL || array_push(ranges->bounds, bound) < 0) {
+			free(bound);
+			return KNOT_ENOMEM;
+		}
+	}
+	return KNOT_EOK;
+}
+
+/** Replace bounds of ranges by evenly spaced samples (which are sorted). */
+static void ranges_update(kr_gc_ranges_t *ranges, gc_chunk_t *chunks,
+			  size_t chunk_count, size_t want)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < chunk_count; ++i) {
+		total += chunks[i].samples.len;
+	}
+	const bool update = total >= want;
+	if (update) {
+		kr_gc_ranges_free(ranges);
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < chunk_count; ++i) {
+		for (size_t j = 0; j < chunks[i].samples.len; ++j, ++n) {
+			knot_db_val_t *sample = chunks[i].samples.at[j];
+			// the n-th sample is taken if it crosses the next multiple of total/want
+			const bool take = update && n > 0
+				&& (n * want) / total != ((n - 1) * want) / total;
+			if (!take || array_push(ranges->bounds, sample) < 0) {
+				free(sample);
+			}
+		}
+		array_clear(chunks[i].samples);
+	}
+}
+
+void kr_gc_ranges_free(kr_gc_ranges_t *ranges)
+{
+	for (size_t i = 0; i < ranges->bounds.len; ++i) {
+		free(ranges->bounds.at[i]);
+	}
+	array_clear(ranges->bounds);
+}
+
+int kr_gc_cache_iter_parallel(knot_db_t * knot_db, kr_gc_iter_callback callback,
+			      void *ctxs[], unsigned threads, kr_gc_ranges_t * ranges)
+{
+	if (ranges->bounds.len == 0) {
+		int ret = ranges_init(ranges);
+		if (ret != KNOT_EOK) {
+			kr_gc_ranges_free(ranges);
+			return ret;
+		}
+	}
+	const size_t chunk_count = ranges->bounds.len + 1;
+	gc_chunk_t *chunks = calloc(chunk_count, sizeof(*chunks));
+	if (chunks == NULL) {
+		return KNOT_ENOMEM;
+	}
+	for (size_t i = 0; i < chunk_count; ++i) {
+		chunks[i].from = i > 0 ? ranges->bounds.at[i - 1] : NULL;
+		chunks[i].to = i + 1 < chunk_count ? ranges->bounds.at[i] : NULL;
+	}
+
+	gc_iter_parallel_t par = {
+		.knot_db = knot_db,
+		.callback = callback,
+		.chunks = chunks,
+		.chunk_count = chunk_count,
+		.ret = KNOT_EOK,
+	};
+	pthread_mutex_init(&par.lock, NULL);
+	gc_iter_thread_t t[threads];
+	unsigned started = 0;
+	for (; started < threads; ++started) {
+		t[started] = (gc_iter_thread_t){ .par = &par, .ctx = ctxs[started] };
+		if (pthread_create(&t[started].thread, NULL, iter_thread, &t[started]) != 0) {
+			break;
+		}
+	}
+	if (started == 0) {
+		iter_thread(&t[0]); // no threads, do it here
+	}
+	for (unsigned i = 0; i < started; ++i) {
+		pthread_join(t[i].thread, NULL);
+	}
+	pthread_mutex_destroy(&par.lock);
+
+	if (par.ret == KNOT_EOK) {
+		ranges_update(ranges, chunks, chunk_count, threads * GC_CHUNKS_PER_THREAD);
+	} else {
+		ranges_update(ranges, chunks, chunk_count, SIZE_MAX); // just free samples
+	}
+	free(chunks);
+	return par.ret;
+}
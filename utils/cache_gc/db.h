@@ -2,6 +2,7 @@
 #pragma once
 
 #include <lib/cache/api.h>
+#include <lib/generic/array.h>
 #include <libknot/libknot.h>
 
 #include "kr_cache_gc.h"
@@ -16,4 +17,27 @@ typedef int (*kr_gc_iter_callback)(const knot_db_val_t * key,
 
 int kr_gc_cache_iter(knot_db_t * knot_db, kr_gc_iter_callback callback, void *ctx);
 
+/** Iterate within txn from the first key >= from (NULL = from the start).
+ * The callback may return KNOT_ELIMIT to stop, which is then returned;
+ * KNOT_EOK means the end was reached. */
+int kr_gc_cache_iter_from(knot_db_txn_t * txn, knot_db_val_t * from,
+			  kr_gc_iter_callback callback, void *ctx);
+
+/** Split of the keys into ranges for kr_gc_cache_iter_parallel(). */
+typedef struct {
+	array_t(knot_db_val_t *) bounds;	// sorted keys, each starts a range
+} kr_gc_ranges_t;
+
+void kr_gc_ranges_free(kr_gc_ranges_t * ranges);
+
+/** Like kr_gc_cache_iter(), but with threads walking ranges of keys in parallel,
+ * each with its own read transaction.  Callbacks from the i-th thread get ctxs[i].
+ * The ranges are split by the first byte at first and then updated,
+ * so that the next iteration over the same cache splits the keys evenly. */
+int kr_gc_cache_iter_parallel(knot_db_t * knot_db, kr_gc_iter_callback callback,
+			      void *ctxs[], unsigned threads, kr_gc_ranges_t * ranges);
+
 const uint16_t *kr_gc_key_consistent(knot_db_val_t key);
+
+/** Copy the value into a single allocation. */
+knot_db_val_t *dbval_copy(const knot_db_val_t * from);
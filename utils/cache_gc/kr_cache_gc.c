@@ -49,19 +49,6 @@ static unsigned long gc_timer_usecs(gc_timer_t * t)
 		(end.tv_nsec - start->tv_nsec) / 1000UL);
 }
 
-// section: dbval_copy
-
-static knot_db_val_t *dbval_copy(const knot_db_val_t * from)
-{
-	knot_db_val_t *to = malloc(sizeof(knot_db_val_t) + from->len);
-	if (to != NULL) {
-		memcpy(to, from, sizeof(knot_db_val_t));
-		to->data = to + 1;	// == ((uit8_t *)to) + sizeof(knot_db_val_t)
-		memcpy(to->data, from->data, from->len);
-	}
-	return to;
-}
-
 // section: rrtype list
 
 dynarray_declare(rrtype, uint16_t, DYNARRAY_VISIBILITY_STATIC, 64)
@@ -143,9 +130,44 @@ int cb_delete_categories(const knot_db_val_t * key, gc_record_info_t * info,
 	return KNOT_EOK;
 }
 
+/** Find the lowest category such that records in it and above add up to percent of all. */
+static category_t limit_category(const size_t sizes[CATEGORIES], double percent)
+{
+	ssize_t sumsize = 0;
+	for (int i = 0; i < CATEGORIES; ++i) {
+		sumsize += sizes[i];
+	}
+	/* use less precise variant to avoid 32-bit overflow */
+	ssize_t amount_tofree = sumsize / 100 * percent;
+
+#ifdef DEBUG
+	printf("tofree: %zd / %zd\n", amount_tofree, sumsize);
+	for (int i = 0; i < CATEGORIES; i++) {
+		if (sizes[i] > 0) {
+			printf("category %.2d size %zu\n", i, sizes[i]);
+		}
+	}
+#endif
+
+	category_t limit = CATEGORIES;
+	while (limit > 0 && amount_tofree > 0) {
+		amount_tofree -= sizes[--limit];
+	}
+	return limit;
+}
+
 struct kr_cache_gc_state {
 	struct kr_cache kres_db;
 	knot_db_t *db;
+
+	// the rest is only used in incremental mode
+	knot_db_val_t *cursor;	// where the next step starts, NULL = start of a lap
+	size_t cats_lap[CATEGORIES];	// sizes seen so far in the current lap
+	size_t cats_prev[CATEGORIES];	// sizes seen in the last complete lap
+	bool have_prev;
+	size_t laps;		// complete laps over the cache
+
+	kr_gc_ranges_t ranges;	// split of keys for parallel iteration
 };
 
 void kr_cache_gc_free_state(kr_cache_gc_state_t **state)
@@ -155,10 +177,211 @@ void kr_cache_gc_free_state(kr_cache_gc_state_t **state)
 		return;
 	}
 	kr_gc_cache_close(&(*state)->kres_db, (*state)->db);
+	free((*state)->cursor);
+	kr_gc_ranges_free(&(*state)->ranges);
 	free(*state);
 	*state = NULL;
 }
 
+// section: parallel iteration
+
+/** Sum category sizes over the whole cache, possibly by several threads. */
+static int gc_compute_categories(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t *state,
+				 ctx_compute_categories_t *cats)
+{
+	const unsigned threads = cfg->threads;
+	if (threads <= 1) {
+		return kr_gc_cache_iter(state->db, cb_compute_categories, cats);
+	}
+	ctx_compute_categories_t cats_th[threads];
+	void *ctxs[threads];
+	memset(cats_th, 0, sizeof(cats_th));
+	for (unsigned i = 0; i < threads; ++i) {
+		ctxs[i] = &cats_th[i];
+	}
+	int ret = kr_gc_cache_iter_parallel(state->db, cb_compute_categories, ctxs,
+					    threads, &state->ranges);
+	for (unsigned i = 0; i < threads; ++i) {
+		for (int c = 0; c < CATEGORIES; ++c) {
+			cats->categories_sizes[c] += cats_th[i].categories_sizes[c];
+		}
+		cats->records += cats_th[i].records;
+	}
+	return ret;
+}
+
+/** Collect keys to delete, possibly by several threads splitting temporary memory. */
+static int gc_choose_records(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t *state,
+			     ctx_delete_categories_t *to_del)
+{
+	const unsigned threads = cfg->threads;
+	if (threads <= 1) {
+		return kr_gc_cache_iter(state->db, cb_delete_categories, to_del);
+	}
+	ctx_delete_categories_t del_th[threads];
+	void *ctxs[threads];
+	memset(del_th, 0, sizeof(del_th));
+	for (unsigned i = 0; i < threads; ++i) {
+		del_th[i].limit_category = to_del->limit_category;
+		del_th[i].cfg_temp_keys_space = to_del->cfg_temp_keys_space / threads;
+		if (to_del->cfg_temp_keys_space > 0 && del_th[i].cfg_temp_keys_space == 0) {
+			del_th[i].cfg_temp_keys_space = 1; // 0 would mean unlimited
+		}
+		ctxs[i] = &del_th[i];
+	}
+	int ret = kr_gc_cache_iter_parallel(state->db, cb_delete_categories, ctxs,
+					    threads, &state->ranges);
+	for (unsigned i = 0; i < threads; ++i) {
+		dynarray_foreach(entry, knot_db_val_t *, j, del_th[i].to_delete) {
+			entry_dynarray_add(&to_del->to_delete, j);
+		}
+		entry_dynarray_free(&del_th[i].to_delete);
+		to_del->used_space += del_th[i].used_space;
+		to_del->oversize_records += del_th[i].oversize_records;
+	}
+	return ret;
+}
+
+// section: incremental mode
+
+/** Time limit of one step in incremental mode if -m isn't set (usecs). */
+#define GC_STEP_DURATION_DEFAULT 20000
+
+typedef struct {
+	kr_cache_gc_state_t *state;
+	gc_timer_t timer;
+	unsigned long duration;
+	size_t max_delete;	// 0 = unlimited
+	bool evicting;
+	category_t limit_category;
+	entry_dynarray_t to_delete;
+	knot_db_val_t *stopped_at;	// first key not processed by this step
+	size_t records;
+} ctx_step_t;
+
+int cb_step(const knot_db_val_t * key, gc_record_info_t * info, void *vctx)
+{
+	ctx_step_t *ctx = vctx;
+	if (ctx->records > 0 && (gc_timer_usecs(&ctx->timer) > ctx->duration
+	    || (ctx->max_delete > 0 && ctx->to_delete.size >= ctx->max_delete))) {
+		ctx->stopped_at = dbval_copy(key);
+		return ctx->stopped_at ? KNOT_ELIMIT : KNOT_ENOMEM;
+	}
+	category_t cat = kr_gc_categorize(info);
+	ctx->state->cats_lap[cat] += info->entry_size;
+	ctx->records++;
+	if (ctx->evicting && cat >= ctx->limit_category) {
+		knot_db_val_t *todelete = dbval_copy(key);
+		if (todelete == NULL) {
+			return KNOT_ENOMEM;
+		}
+		entry_dynarray_add(&ctx->to_delete, &todelete);
+	}
+	return KNOT_EOK;
+}
+
+/** Walk the cache from state->cursor for a limited time in one transaction,
+ * updating the category sizes and (if evicting) deleting records in categories
+ * at or above limit. */
+static int gc_step(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t *state,
+		   bool evicting, category_t limit, size_t *deleted)
+{
+	const knot_db_api_t *api = knot_db_lmdb_api();
+	knot_db_txn_t txn = { 0 };
+	int ret = api->txn_begin(state->db, &txn, evicting ? 0 : KNOT_DB_RDONLY);
+	if (ret != KNOT_EOK) {
+		printf("Error starting DB transaction (%s).\n", knot_strerror(ret));
+		return ret;
+	}
+
+	ctx_step_t ctx = {
+		.state = state,
+		.duration = cfg->rw_txn_duration > 0
+			? cfg->rw_txn_duration : GC_STEP_DURATION_DEFAULT,
+		.max_delete = cfg->rw_txn_items,
+		.evicting = evicting,
+		.limit_category = limit,
+	};
+	gc_timer_start(&ctx.timer);
+	ret = kr_gc_cache_iter_from(&txn, state->cursor, cb_step, &ctx);
+	free(state->cursor);
+	state->cursor = ctx.stopped_at;
+	if (ret == KNOT_EOK) { // the lap is complete
+		memcpy(state->cats_prev, state->cats_lap, sizeof(state->cats_prev));
+		memset(state->cats_lap, 0, sizeof(state->cats_lap));
+		state->have_prev = true;
+		state->laps++;
+	} else if (ret == KNOT_ELIMIT) {
+		ret = KNOT_EOK;
+	}
+
+	dynarray_foreach(entry, knot_db_val_t *, i, ctx.to_delete) {
+		if (ret != KNOT_EOK) {
+			break;
+		}
+		ret = api->del(&txn, *i);
+		if (ret == KNOT_EOK) {
+			(*deleted)++;
+		} else if (ret == KNOT_ENOENT) {
+			ret = KNOT_EOK;
+		}
+	}
+	entry_dynarray_deep_free(&ctx.to_delete);
+
+	if (ret == KNOT_EOK && evicting) {
+		ret = api->txn_commit(&txn);
+	} else {
+		api->txn_abort(&txn);
+	}
+	return ret;
+}
+
+/** Incremental mode: instead of analyzing the whole cache and then deleting,
+ * keep walking it in short steps and estimate the category sizes from the last
+ * complete walk.  When usage gets too high, the steps delete records from the
+ * categories to free, each step in a transaction of limited duration. */
+static int gc_incremental(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t *state)
+{
+	const struct kr_cdb_api *cache_api = kr_cdb_lmdb();
+	double db_usage = cache_api->usage_percent(state->db);
+	size_t deleted = 0;
+	if (cfg->dry_run || db_usage < cfg->cache_max_usage) {
+		if (cfg->dry_run) {
+			printf("Usage: %.2lf%%\n", db_usage);
+		}
+		return gc_step(cfg, state, false, CATEGORIES, &deleted);
+	}
+
+	const double usage_target = db_usage * (100 - cfg->cache_to_be_freed) / 100;
+	printf("Usage: %.2lf%%, freeing down to %.2lf%%\n", db_usage, usage_target);
+	gc_timer_t timer_evict = { 0 };
+	gc_timer_start(&timer_evict);
+	const size_t laps_start = state->laps;
+	size_t rw_txn_count = 0;
+	int ret = KNOT_EOK;
+	while (db_usage > usage_target) {
+		// Two laps over the cache should suffice; the estimates are off otherwise.
+		if (state->laps >= laps_start + 2) {
+			printf("Warning: usage still %.2lf%% after two passes.\n", db_usage);
+			break;
+		}
+		const size_t *sizes = state->have_prev ? state->cats_prev : state->cats_lap;
+		const category_t limit = limit_category(sizes,
+				100.0 * (db_usage - usage_target) / db_usage);
+		ret = gc_step(cfg, state, true, limit, &deleted);
+		if (ret != KNOT_EOK) {
+			printf("Error: transaction failed (%s)\n", knot_strerror(ret));
+			break;
+		}
+		rw_txn_count++;
+		usleep(cfg->rw_txn_delay);
+		db_usage = cache_api->usage_percent(state->db);
+	}
+	printf("Deleted %zu records in %.2lf secs, %zu transactions, usage %.2lf%%\n\n",
+	       deleted, gc_timer_end(&timer_evict), rw_txn_count, db_usage);
+	return ret;
+}
+
 int kr_cache_gc(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t **state)
 {
 	assert(cfg && state);
@@ -177,6 +400,14 @@ int kr_cache_gc(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t **state)
 	}
 	knot_db_t *const db = (*state)->db; // frequently used shortcut
 
+	if (cfg->incremental) {
+		int ret = gc_incremental(cfg, *state);
+		if (ret != KNOT_EOK) {
+			kr_cache_gc_free_state(state);
+		}
+		return ret;
+	}
+
 	const struct kr_cdb_api *cache_api = kr_cdb_lmdb();
 	const double db_usage = cache_api->usage_percent(db);
 #if 0				// Probably not worth it, better reduce the risk by checking more often.
@@ -202,7 +433,7 @@ int kr_cache_gc(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t **state)
 	gc_timer_start(&timer_analyze);
 	ctx_compute_categories_t cats = { { 0 }
 	};
-	int ret = kr_gc_cache_iter(db, cb_compute_categories, &cats);
+	int ret = gc_compute_categories(cfg, *state, &cats);
 	if (ret != KNOT_EOK) {
 		kr_cache_gc_free_state(state);
 		return ret;
@@ -212,36 +443,16 @@ int kr_cache_gc(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t **state)
 	// Mixing ^^ page usage and entry sizes (key+value lengths) didn't work
 	// too well, probably due to internal fragmentation after some GC cycles.
 	// Therefore let's scale this by the ratio of these two sums.
-	ssize_t cats_sumsize = 0;
-	for (int i = 0; i < CATEGORIES; ++i) {
-		cats_sumsize += cats.categories_sizes[i];
-	}
-	/* use less precise variant to avoid 32-bit overflow */
-	ssize_t amount_tofree = cats_sumsize / 100 * cfg->cache_to_be_freed;
-
-#ifdef DEBUG
-	printf("tofree: %zd / %zd\n", amount_tofree, cats_sumsize);
-	for (int i = 0; i < CATEGORIES; i++) {
-		if (cats.categories_sizes[i] > 0) {
-			printf("category %.2d size %zu\n", i,
-			       cats.categories_sizes[i]);
-		}
-	}
-#endif
-
-	category_t limit_category = CATEGORIES;
-	while (limit_category > 0 && amount_tofree > 0) {
-		amount_tofree -= cats.categories_sizes[--limit_category];
-	}
+	category_t limit = limit_category(cats.categories_sizes, cfg->cache_to_be_freed);
 
 	printf("Cache analyzed in %.2lf secs, %zu records, limit category is %d.\n",
-	       gc_timer_end(&timer_analyze), cats.records, limit_category);
+	       gc_timer_end(&timer_analyze), cats.records, limit);
 
 	gc_timer_start(&timer_choose);
 	ctx_delete_categories_t to_del = { 0 };
 	to_del.cfg_temp_keys_space = cfg->temp_keys_space;
-	to_del.limit_category = limit_category;
-	ret = kr_gc_cache_iter(db, cb_delete_categories, &to_del);
+	to_del.limit_category = limit;
+	ret = gc_choose_records(cfg, *state, &to_del);
 	if (ret != KNOT_EOK) {
 		entry_dynarray_deep_free(&to_del.to_delete);
 		kr_cache_gc_free_state(state);
@@ -275,8 +486,8 @@ int kr_cache_gc(kr_cache_gc_cfg_t *cfg, kr_cache_gc_state_t **state)
 		case KNOT_EOK:
 			deleted_records++;
 			const uint16_t *entry_type = kr_gc_key_consistent(**i);
-			assert(entry_type != NULL);
-			rrtypelist_add(&deleted_rrtypes, *entry_type);
+			if (entry_type != NULL)	// not for infra records
+				rrtypelist_add(&deleted_rrtypes, *entry_type);
 			break;
 		case KNOT_ENOENT:
 			already_gone++;
@@ -12,6 +12,9 @@ typedef struct {
 	uint16_t rrtype;
 	uint8_t no_labels;	// 0 == ., 1 == root zone member, 2 == TLD member ...
 	uint8_t rank;
+	uint8_t hits;		// approximate log2 of reads (sampled), see entry_h::hits
+	bool infra;		// upstream server state, see enum kr_cache_infra_tag;
+				// only expires_in is valid then
 } gc_record_info_t;
 
 typedef struct {
@@ -28,6 +31,8 @@ typedef struct {
 	uint8_t cache_to_be_freed;	// percent of current cache usage to be freed during GC
 
 	bool dry_run;
+	bool incremental;	// walk the cache in steps of rw_txn_duration instead of whole passes
+	unsigned threads;	// threads walking the cache in parallel (0 or 1 = no extra threads)
 } kr_cache_gc_cfg_t;
 
 /** State persisting across kr_cache_gc() invocations (opaque).
@@ -3,9 +3,11 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <lib/defines.h>
+#include <lib/cache/cdb_lmdb.h>
 #include <libknot/libknot.h>
 
 #include "kresconfig.h"
@@ -41,6 +43,45 @@ static void print_help()
 	printf(" -w <wait_next_rw_txn(usecs)>\n");
 	printf(" -t <temporary_memory(MBytes)>\n");
 	printf(" -n (= dry run)\n");
+	printf(" -i (= incremental, needs -d; -m limits each step)\n");
+	printf(" -j <threads_for_analysis>\n");
+}
+
+/** Configuration and state of GC for one shard of the cache. */
+typedef struct {
+	kr_cache_gc_cfg_t cfg;
+	char *path;	// NULL for unsharded cache
+	kr_cache_gc_state_t *state;
+} gc_shard_t;
+
+static void shards_free(gc_shard_t *shards, unsigned count)
+{
+	for (unsigned i = 0; shards && i < count; ++i) {
+		kr_cache_gc_free_state(&shards[i].state);
+		free(shards[i].path);
+	}
+	free(shards);
+}
+
+/** Prepare GC of a cache with count shards, 1 for unsharded.  NULL if out of memory. */
+static gc_shard_t *shards_alloc(const kr_cache_gc_cfg_t *cfg, unsigned count)
+{
+	gc_shard_t *shards = calloc(count, sizeof(shards[0]));
+	for (unsigned i = 0; shards && i < count; ++i) {
+		shards[i].cfg = *cfg;
+		if (count == 1)
+			break;
+		// Each shard is a separate LMDB with its own size limit.
+		const size_t len = strlen(cfg->cache_path) + 20;
+		shards[i].path = malloc(len);
+		if (!shards[i].path) {
+			shards_free(shards, count);
+			return NULL;
+		}
+		snprintf(shards[i].path, len, "%s/shard-%u", cfg->cache_path, i);
+		shards[i].cfg.cache_path = shards[i].path;
+	}
+	return shards;
 }
 
 static long get_nonneg_optarg()
@@ -76,7 +117,7 @@ int main(int argc, char *argv[])
 	};
 
 	int o;
-	while ((o = getopt(argc, argv, "hnc:d:l:m:u:f:w:t:")) != -1) {
+	while ((o = getopt(argc, argv, "hnic:d:j:l:m:u:f:w:t:")) != -1) {
 		switch (o) {
 		case 'c':
 			cfg.cache_path = optarg;
@@ -107,6 +148,17 @@ int main(int argc, char *argv[])
 		case 'n':
 			cfg.dry_run = true;
 			break;
+		case 'i':
+			cfg.incremental = true;
+			break;
+		case 'j':
+			cfg.threads = get_nonneg_optarg();
+			// each thread takes a slot in the LMDB reader table
+			if (cfg.threads > 16) {
+				print_help();
+				return 1;
+			}
+			break;
 		case ':':
 		case '?':
 		case 'h':
@@ -117,26 +169,47 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (cfg.cache_path == NULL) {
+	if (cfg.cache_path == NULL || (cfg.incremental && cfg.gc_interval == 0)) {
 		print_help();
 		return 1;
 	}
 
+	gc_shard_t *shards = NULL;
+	unsigned count = 0;
 	int exit_code = 0;
-	kr_cache_gc_state_t *gc_state = NULL;
 	do {
-		int ret = kr_cache_gc(&cfg, &gc_state);
-		// ENOENT: kresd may not be started yet or cleared the cache now
-		if (ret && ret != -ENOENT) {
-			printf("Error (%s)\n", knot_strerror(ret));
+		// kresd may have recreated the cache with another number of shards.
+		int ret = kr_cdb_lmdb_shards(cfg.cache_path);
+		if (ret < 0) {
+			printf("Error reading number of shards (%s)\n", knot_strerror(ret));
 			exit_code = 10;
 			break;
 		}
+		if ((unsigned)ret != count) {
+			shards_free(shards, count);
+			count = ret;
+			shards = shards_alloc(&cfg, count);
+			if (!shards) {
+				printf("Out of memory.\n");
+				exit_code = 10;
+				break;
+			}
+		}
+
+		for (unsigned i = 0; i < count && !exit_code; ++i) {
+			ret = kr_cache_gc(&shards[i].cfg, &shards[i].state);
+			// ENOENT: kresd may not be started yet or cleared the cache now
+			if (ret && ret != -ENOENT) {
+				printf("Error (%s)\n", knot_strerror(ret));
+				exit_code = 10;
+			}
+		}
+		if (exit_code)
+			break;
 
 		usleep(cfg.gc_interval);
 	} while (cfg.gc_interval > 0 && !killed);
 
-	kr_cache_gc_free_state(&gc_state);
-
+	shards_free(shards, count);
 	return exit_code;
 }